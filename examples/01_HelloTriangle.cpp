@@ -53,6 +53,7 @@ public:
         // vertex buffer
         WilloRHI::BufferCreateInfo bufferInfo = {
             .size = sizeof(float) * 3 * 3,
+            .usageFlags = WilloRHI::BufferUsageFlag::VERTEX,
             .allocationFlags = WilloRHI::AllocationUsageFlag::HOST_ACCESS_SEQUENTIAL_WRITE
         };
 
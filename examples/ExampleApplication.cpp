@@ -97,7 +97,6 @@ void ExampleApplication::Update()
     if (swapchain.NeedsResize()) {
         int newWidth, newHeight;
         glfwGetWindowSize(window, &newWidth, &newHeight);
-        device.WaitIdle();
         OnResize((uint32_t)newWidth, (uint32_t)newHeight);
     }
 }
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <WilloRHI/WilloRHI.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+// shared bits for the benchmarks, each one is a standalone executable printing its own results
+namespace Benchmark
+{
+    using Clock = std::chrono::steady_clock;
+
+    inline double SecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    inline double MillisecondsSince(Clock::time_point start) {
+        return SecondsSince(start) * 1000.0;
+    }
+
+    // resident set size of this process, 0 where it can't be read
+    inline uint64_t ResidentBytes()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters = {};
+        if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return 0;
+        return counters.WorkingSetSize;
+#else
+        FILE* statm = std::fopen("/proc/self/statm", "r");
+        if (statm == nullptr)
+            return 0;
+
+        unsigned long long size = 0, resident = 0;
+        int numRead = std::fscanf(statm, "%llu %llu", &size, &resident);
+        std::fclose(statm);
+        return numRead == 2 ? resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+    }
+
+    inline double Megabytes(uint64_t bytes) {
+        return (double)bytes / (1024.0 * 1024.0);
+    }
+
+    // "--name value" style arguments, anything missing falls back to the default
+    inline uint64_t ArgumentU64(int argc, char** argv, const char* name, uint64_t defaultValue)
+    {
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::strcmp(argv[i], name) == 0)
+                return std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        return defaultValue;
+    }
+
+    inline std::string ArgumentString(int argc, char** argv, const char* name, const std::string& defaultValue)
+    {
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::strcmp(argv[i], name) == 0)
+                return argv[i + 1];
+        }
+        return defaultValue;
+    }
+
+    inline void OutputMessage(const std::string& message) {
+        std::cout << message << "\n";
+    }
+
+    // no window or swapchain, the benchmarks never present
+    inline WilloRHI::Device CreateDevice(const std::string& name, const WilloRHI::ResourceCountInfo& resourceCounts = {})
+    {
+        WilloRHI::DeviceCreateInfo deviceInfo = {
+            .applicationName = name,
+            .validationLayers = false,
+            .logCallback = &OutputMessage,
+            .logInfo = false,
+            .resourceCounts = resourceCounts
+        };
+        return WilloRHI::Device::CreateDevice(deviceInfo);
+    }
+}
@@ -0,0 +1,110 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// host time to record frames of thousands of barriers and vertex/index binds over a large resource set
+// every command looks up a random resource, so the cost is dominated by how much of each record has to be pulled in
+// pair it with something like `perf stat -e cache-misses,cache-references` for the miss counts themselves
+
+int main(int argc, char** argv)
+{
+    uint32_t numResources = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--resources", 16384);
+    uint32_t numCommands = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--commands", 4096);
+    uint32_t numFrames = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--frames", 200);
+    // barriers are batched into one vkCmdPipelineBarrier2 this often
+    uint32_t flushInterval = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--flush-interval", 32);
+
+    WilloRHI::Device device = Benchmark::CreateDevice("CommandRecording");
+    WilloRHI::Queue queue = WilloRHI::Queue::Create(device, WilloRHI::QueueType::GRAPHICS);
+    WilloRHI::TimelineSemaphore timeline = WilloRHI::TimelineSemaphore::Create(device, 0);
+
+    std::vector<WilloRHI::BufferId> buffers;
+    std::vector<WilloRHI::ImageId> images;
+    for (uint32_t i = 0; i < numResources; i++) {
+        buffers.push_back(device.CreateBuffer({
+            .size = 4096,
+            .usageFlags = WilloRHI::BufferUsageFlag::VERTEX | WilloRHI::BufferUsageFlag::INDEX | WilloRHI::BufferUsageFlag::STORAGE
+        }));
+        images.push_back(device.CreateImage({
+            .dimensions = 2,
+            .size = { 4, 4, 1 },
+            .numLevels = 1,
+            .numLayers = 1,
+            .format = WilloRHI::Format::R8G8B8A8_UNORM,
+            .usageFlags = WilloRHI::ImageUsageFlag::SAMPLED | WilloRHI::ImageUsageFlag::TRANSFER_DST
+        }));
+    }
+
+    // the same sequence every run, so results compare across builds
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> pick(0, numResources - 1);
+
+    // images alternate between two layouts so every barrier is a real transition
+    std::vector<bool> imageReadable(numResources, false);
+
+    double totalRecordMs = 0.0;
+    double worstRecordMs = 0.0;
+
+    for (uint32_t frame = 0; frame < numFrames; frame++) {
+        WilloRHI::CommandList commandList = queue.GetCmdList();
+
+        Benchmark::Clock::time_point start = Benchmark::Clock::now();
+        commandList.Begin();
+
+        for (uint32_t i = 0; i < numCommands; i++) {
+            uint32_t index = pick(random);
+            switch (i % 4) {
+                case 0: {
+                    imageReadable[index] = !imageReadable[index];
+                    commandList.ImageMemoryBarrier(images[index], {
+                        .dstStage = imageReadable[index] ? WilloRHI::PipelineStageFlag::FRAGMENT_SHADER : WilloRHI::PipelineStageFlag::TRANSFER,
+                        .dstAccess = imageReadable[index] ? WilloRHI::MemoryAccessFlag::READ : WilloRHI::MemoryAccessFlag::WRITE,
+                        .dstLayout = imageReadable[index] ? WilloRHI::ImageLayout::READ_ONLY : WilloRHI::ImageLayout::TRANSFER_DST
+                    });
+                    break;
+                }
+                case 1:
+                    commandList.BufferMemoryBarrier(buffers[index], {
+                        .dstStage = WilloRHI::PipelineStageFlag::VERTEX_ATTRIBUTE_INPUT,
+                        .dstAccess = WilloRHI::MemoryAccessFlag::READ
+                    });
+                    break;
+                case 2:
+                    commandList.BindVertexBuffer(buffers[index], 0);
+                    break;
+                case 3:
+                    commandList.BindIndexBuffer(buffers[index], 0, WilloRHI::IndexType::UINT32);
+                    break;
+            }
+
+            if ((i + 1) % flushInterval == 0)
+                commandList.FlushBarriers();
+        }
+
+        commandList.End();
+        double recordMs = Benchmark::MillisecondsSince(start);
+        totalRecordMs += recordMs;
+        worstRecordMs = std::max(worstRecordMs, recordMs);
+
+        queue.Submit({
+            .signalTimelineSemaphores = { { timeline, frame + 1 } },
+            .commandLists = { commandList }
+        });
+        timeline.WaitValue(frame + 1, ~0ull);
+        queue.CollectGarbage();
+    }
+
+    std::printf("%u resources of each type, %u commands per frame, %u frames\n", numResources, numCommands, numFrames);
+    std::printf("recording  %.3f ms/frame average, %.3f ms worst, %.1f ns/command\n",
+        totalRecordMs / numFrames, worstRecordMs, totalRecordMs * 1e6 / ((double)numFrames * numCommands));
+
+    for (WilloRHI::BufferId buffer : buffers)
+        device.DestroyBuffer(buffer);
+    for (WilloRHI::ImageId image : images)
+        device.DestroyImage(image);
+    queue.CollectGarbage();
+
+    return 0;
+}
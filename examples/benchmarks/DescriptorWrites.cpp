@@ -0,0 +1,63 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// threads creating storage buffers, each one queues a descriptor write, then one submit flushes them all
+// with the descriptor buffer path the writes go straight into mapped memory instead, so the flush time is ~0
+
+int main(int argc, char** argv)
+{
+    uint32_t numThreads = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--threads", 8);
+    uint32_t numResources = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--resources", 100000);
+    numThreads = std::max(numThreads, 1u);
+
+    WilloRHI::Device device = Benchmark::CreateDevice("DescriptorWrites");
+    WilloRHI::Queue queue = WilloRHI::Queue::Create(device, WilloRHI::QueueType::GRAPHICS);
+    WilloRHI::TimelineSemaphore timeline = WilloRHI::TimelineSemaphore::Create(device, 0);
+
+    std::vector<WilloRHI::BufferId> buffers(numResources, WilloRHI::INVALID_RESOURCE_ID);
+    std::vector<std::thread> threads;
+
+    Benchmark::Clock::time_point start = Benchmark::Clock::now();
+
+    for (uint32_t t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            for (uint32_t i = t; i < numResources; i += numThreads)
+                buffers[i] = device.CreateBuffer({ .size = 256, .usageFlags = WilloRHI::BufferUsageFlag::STORAGE });
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    double createMs = Benchmark::MillisecondsSince(start);
+
+    // an empty submit, the pending writes are flushed before anything is handed to the queue
+    WilloRHI::CommandList commandList = queue.GetCmdList();
+    commandList.Begin();
+    commandList.End();
+
+    start = Benchmark::Clock::now();
+    queue.Submit({
+        .signalTimelineSemaphores = { { timeline, 1 } },
+        .commandLists = { commandList }
+    });
+    double flushMs = Benchmark::MillisecondsSince(start);
+
+    timeline.WaitValue(1, ~0ull);
+
+    uint32_t numFailed = (uint32_t)std::count(buffers.begin(), buffers.end(), WilloRHI::INVALID_RESOURCE_ID);
+
+    std::printf("%u storage buffers from %u threads, %u failed\n", numResources, numThreads, numFailed);
+    std::printf("create   %.2f ms, %.0f ns/buffer\n", createMs, createMs * 1e6 / numResources);
+    std::printf("submit   %.2f ms including the descriptor flush\n", flushMs);
+
+    for (WilloRHI::BufferId buffer : buffers) {
+        if (buffer != WilloRHI::INVALID_RESOURCE_ID)
+            device.DestroyBuffer(buffer);
+    }
+    queue.CollectGarbage();
+
+    return 0;
+}
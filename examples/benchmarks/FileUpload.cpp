@@ -0,0 +1,96 @@
+#include "Benchmark.hpp"
+
+#include <WilloRHI/UploadManager.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+// streams a multi-gigabyte file into a gpu buffer through UploadManager::UploadBufferFromFile,
+// then reads the same file with plain buffered reads for a baseline
+// a freshly written file sits in the page cache, drop caches between runs (or pass --file) to measure the disk
+
+static constexpr uint64_t MB = 1024ull * 1024ull;
+
+static bool WriteTestFile(const std::string& path, uint64_t size)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    std::vector<char> block(16 * MB);
+    for (size_t i = 0; i < block.size(); i++)
+        block[i] = (char)(i * 31);
+
+    for (uint64_t written = 0; written < size; written += block.size())
+        file.write(block.data(), (std::streamsize)std::min<uint64_t>(block.size(), size - written));
+    return (bool)file;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t size = Benchmark::ArgumentU64(argc, argv, "--size-mb", 2048) * MB;
+    std::string path = Benchmark::ArgumentString(argc, argv, "--file", "");
+    uint32_t readsInFlight = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--reads", 8);
+    uint64_t stagingSize = Benchmark::ArgumentU64(argc, argv, "--staging-mb", 64) * MB;
+    // the file is uploaded in pieces of this size, all into the same buffer
+    uint64_t pieceSize = Benchmark::ArgumentU64(argc, argv, "--piece-mb", 256) * MB;
+
+    bool generated = path.empty();
+    if (generated) {
+        path = "Benchmark_FileUpload.bin";
+        if (!WriteTestFile(path, size)) {
+            std::printf("failed to write %s\n", path.c_str());
+            return 1;
+        }
+    } else {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        size = file ? (uint64_t)file.tellg() : 0;
+    }
+
+    pieceSize = std::min(pieceSize, size);
+
+    WilloRHI::Device device = Benchmark::CreateDevice("FileUpload");
+    WilloRHI::Queue queue = WilloRHI::Queue::Create(device, WilloRHI::QueueType::TRANSFER);
+    WilloRHI::UploadManager uploadManager = WilloRHI::UploadManager::Create(device, queue, {
+        .stagingSize = stagingSize,
+        .maxFileReadsInFlight = readsInFlight
+    });
+
+    WilloRHI::BufferId buffer = device.CreateBuffer({
+        .size = pieceSize,
+        .usageFlags = WilloRHI::BufferUsageFlag::TRANSFER_DST
+    });
+
+    Benchmark::Clock::time_point start = Benchmark::Clock::now();
+
+    bool succeeded = true;
+    for (uint64_t offset = 0; offset < size && succeeded; offset += pieceSize)
+        succeeded = uploadManager.UploadBufferFromFile(buffer, 0, path, offset, std::min(pieceSize, size - offset));
+
+    uploadManager.GetTimeline().WaitValue(uploadManager.Flush(), ~0ull);
+    double uploadSeconds = Benchmark::SecondsSince(start);
+
+    // the same bytes through the page cache into host memory, no gpu involved
+    std::vector<char> hostBuffer(16 * MB);
+    start = Benchmark::Clock::now();
+    {
+        std::ifstream file(path, std::ios::binary);
+        while (file.read(hostBuffer.data(), (std::streamsize)hostBuffer.size()) || file.gcount() > 0) {}
+    }
+    double readSeconds = Benchmark::SecondsSince(start);
+
+    double gigabytes = (double)size / (1024.0 * MB);
+    std::printf("%.2f GB from %s, %u reads in flight, %llu MB staging\n",
+        gigabytes, path.c_str(), readsInFlight, (unsigned long long)(stagingSize / MB));
+    std::printf("UploadBufferFromFile  %.2f s  %.2f GB/s%s\n", uploadSeconds, gigabytes / uploadSeconds, succeeded ? "" : "  (failed)");
+    std::printf("buffered std::ifstream  %.2f s  %.2f GB/s\n", readSeconds, gigabytes / readSeconds);
+
+    device.DestroyBuffer(buffer);
+    queue.CollectGarbage();
+
+    if (generated)
+        std::remove(path.c_str());
+
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,96 @@
+#include "Benchmark.hpp"
+
+#include <WilloRHI/UploadManager.hpp>
+
+#include <vector>
+
+// fills the same set of textures through Device::WriteImage (host image copy) and through UploadManager::UploadImage
+// (staging ring and a copy on a transfer queue), timed until the contents are usable either way
+// WriteImage needs VK_EXT_host_image_copy and a format that supports it, without that only the staging path runs
+
+static std::vector<WilloRHI::ImageId> CreateImages(WilloRHI::Device device, uint32_t count, uint32_t size,
+    WilloRHI::ImageUsageFlags usageFlags)
+{
+    std::vector<WilloRHI::ImageId> images;
+    for (uint32_t i = 0; i < count; i++) {
+        images.push_back(device.CreateImage({
+            .dimensions = 2,
+            .size = { size, size, 1 },
+            .numLevels = 1,
+            .numLayers = 1,
+            .format = WilloRHI::Format::R8G8B8A8_UNORM,
+            .usageFlags = usageFlags
+        }));
+    }
+    return images;
+}
+
+static void DestroyImages(WilloRHI::Device device, const std::vector<WilloRHI::ImageId>& images)
+{
+    for (WilloRHI::ImageId image : images)
+        device.DestroyImage(image);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t numImages = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--images", 64);
+    uint32_t size = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--size", 1024);
+
+    WilloRHI::Device device = Benchmark::CreateDevice("ImageWrites");
+    WilloRHI::Queue queue = WilloRHI::Queue::Create(device, WilloRHI::QueueType::TRANSFER);
+    WilloRHI::UploadManager uploadManager = WilloRHI::UploadManager::Create(device, queue);
+
+    std::vector<uint8_t> pixels((size_t)size * size * 4);
+    for (size_t i = 0; i < pixels.size(); i++)
+        pixels[i] = (uint8_t)(i * 7);
+
+    double gigabytes = (double)pixels.size() * numImages / (1024.0 * 1024.0 * 1024.0);
+    std::printf("%u images of %ux%u RGBA8, %.2f GB in total\n", numImages, size, size, gigabytes);
+
+    // staging path
+    std::vector<WilloRHI::ImageId> images = CreateImages(device, numImages, size,
+        WilloRHI::ImageUsageFlag::SAMPLED | WilloRHI::ImageUsageFlag::TRANSFER_DST);
+
+    Benchmark::Clock::time_point start = Benchmark::Clock::now();
+    for (WilloRHI::ImageId image : images) {
+        uploadManager.UploadImage({
+            .image = image,
+            .data = pixels.data(),
+            .extent = { size, size, 1 }
+        });
+    }
+    uploadManager.GetTimeline().WaitValue(uploadManager.Flush(), ~0ull);
+    double stagingSeconds = Benchmark::SecondsSince(start);
+
+    std::printf("UploadManager::UploadImage  %8.2f ms  %.2f GB/s\n", stagingSeconds * 1000.0, gigabytes / stagingSeconds);
+
+    DestroyImages(device, images);
+    queue.CollectGarbage();
+
+    // host image copy, done once WriteImage returns
+    images = CreateImages(device, numImages, size,
+        WilloRHI::ImageUsageFlag::SAMPLED | WilloRHI::ImageUsageFlag::HOST_TRANSFER);
+
+    bool succeeded = true;
+    start = Benchmark::Clock::now();
+    for (WilloRHI::ImageId image : images) {
+        succeeded = device.WriteImage({
+            .image = image,
+            .data = pixels.data(),
+            .extent = { size, size, 1 }
+        });
+        if (!succeeded)
+            break;
+    }
+    double hostSeconds = Benchmark::SecondsSince(start);
+
+    if (succeeded)
+        std::printf("Device::WriteImage          %8.2f ms  %.2f GB/s\n", hostSeconds * 1000.0, gigabytes / hostSeconds);
+    else
+        std::printf("Device::WriteImage          unsupported on this device\n");
+
+    DestroyImages(device, images);
+    queue.CollectGarbage();
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// threads creating and destroying buffers as fast as they can while the main thread collects garbage
+// only the public api is used, so the same source builds against the free-slot queue ResourceMap used before
+
+static constexpr uint32_t BATCH_SIZE = 64;
+
+static void RunDeviceChurn(WilloRHI::Device device, WilloRHI::Queue queue, uint32_t numThreads, uint64_t numIterations, uint64_t bufferSize)
+{
+    std::atomic<uint32_t> numRunning = numThreads;
+    std::atomic<uint64_t> numFailed = 0;
+    std::vector<std::thread> threads;
+
+    Benchmark::Clock::time_point start = Benchmark::Clock::now();
+
+    for (uint32_t t = 0; t < numThreads; t++) {
+        threads.emplace_back([&]() {
+            WilloRHI::BufferId buffers[BATCH_SIZE] = {};
+            for (uint64_t i = 0; i < numIterations; i++) {
+                for (uint32_t b = 0; b < BATCH_SIZE; b++) {
+                    buffers[b] = device.CreateBuffer({ .size = bufferSize });
+                    if (buffers[b] == WilloRHI::INVALID_RESOURCE_ID)
+                        numFailed.fetch_add(1, std::memory_order_relaxed);
+                }
+                for (uint32_t b = 0; b < BATCH_SIZE; b++) {
+                    if (buffers[b] != WilloRHI::INVALID_RESOURCE_ID)
+                        device.DestroyBuffer(buffers[b]);
+                }
+            }
+            numRunning.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    // destroyed slots only come back once garbage is collected, same as a frame loop would
+    while (numRunning.load(std::memory_order_acquire) > 0) {
+        queue.CollectGarbage();
+        std::this_thread::yield();
+    }
+
+    for (std::thread& thread : threads)
+        thread.join();
+    queue.CollectGarbage();
+
+    double seconds = Benchmark::SecondsSince(start);
+    double numPairs = (double)numThreads * (double)numIterations * BATCH_SIZE;
+    std::printf("%2u threads  %10.0f create+destroy/s  %8.0f per thread  %llu failed\n",
+        numThreads, numPairs / seconds, numPairs / seconds / numThreads, (unsigned long long)numFailed.load());
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxThreads = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--threads", std::max(std::thread::hardware_concurrency(), 1u));
+    uint64_t numIterations = Benchmark::ArgumentU64(argc, argv, "--iterations", 2000);
+    uint64_t bufferSize = Benchmark::ArgumentU64(argc, argv, "--size", 256);
+
+    WilloRHI::Device device = Benchmark::CreateDevice("ResourceChurn");
+    WilloRHI::Queue queue = WilloRHI::Queue::Create(device, WilloRHI::QueueType::GRAPHICS);
+
+    std::printf("Device::CreateBuffer/DestroyBuffer, %llu byte buffers\n", (unsigned long long)bufferSize);
+    for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        RunDeviceChurn(device, queue, numThreads, numIterations, bufferSize);
+
+    device.WaitIdle();
+    return 0;
+}
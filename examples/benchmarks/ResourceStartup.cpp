@@ -0,0 +1,62 @@
+#include "Benchmark.hpp"
+
+#include <vector>
+
+// host memory and time spent bringing a device up, before and after a typical handful of resources exist
+// run with --count at the default and at a small value to see how much of the id space is paid for up front,
+// it only uses the public api so the same source builds against older revisions for comparison
+
+int main(int argc, char** argv)
+{
+    uint32_t count = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--count", WilloRHI::ResourceCountInfo{}.bufferCount);
+    uint32_t numResources = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--resources", 500);
+
+    WilloRHI::ResourceCountInfo resourceCounts = {
+        .bufferCount = count,
+        .imageCount = count,
+        .samplerCount = count
+    };
+
+    uint64_t startResident = Benchmark::ResidentBytes();
+
+    Benchmark::Clock::time_point start = Benchmark::Clock::now();
+    WilloRHI::Device device = Benchmark::CreateDevice("ResourceStartup", resourceCounts);
+    double createMs = Benchmark::MillisecondsSince(start);
+
+    uint64_t deviceResident = Benchmark::ResidentBytes();
+
+    // a few hundred each of buffers and images, roughly what a small scene loads
+    std::vector<WilloRHI::BufferId> buffers;
+    std::vector<WilloRHI::ImageId> images;
+
+    start = Benchmark::Clock::now();
+    for (uint32_t i = 0; i < numResources; i++) {
+        buffers.push_back(device.CreateBuffer({ .size = 1024 }));
+        images.push_back(device.CreateImage({
+            .dimensions = 2,
+            .size = { 64, 64, 1 },
+            .numLevels = 1,
+            .numLayers = 1,
+            .format = WilloRHI::Format::R8G8B8A8_UNORM,
+            .usageFlags = WilloRHI::ImageUsageFlag::SAMPLED | WilloRHI::ImageUsageFlag::TRANSFER_DST
+        }));
+    }
+    double resourcesMs = Benchmark::MillisecondsSince(start);
+
+    uint64_t resourcesResident = Benchmark::ResidentBytes();
+
+    std::printf("slots per resource type      %u\n", count);
+    std::printf("Device::CreateDevice         %.2f ms\n", createMs);
+    std::printf("resident after device        %.1f MB (+%.1f MB)\n",
+        Benchmark::Megabytes(deviceResident), Benchmark::Megabytes(deviceResident - startResident));
+    std::printf("%u buffers + %u images     %.2f ms\n", numResources, numResources, resourcesMs);
+    std::printf("resident after resources     %.1f MB (+%.1f MB)\n",
+        Benchmark::Megabytes(resourcesResident), Benchmark::Megabytes(resourcesResident - deviceResident));
+
+    for (WilloRHI::BufferId buffer : buffers)
+        device.DestroyBuffer(buffer);
+    for (WilloRHI::ImageId image : images)
+        device.DestroyImage(image);
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "Benchmark.hpp"
+
+#include <WilloRHI/StagingWriter.hpp>
+#include <WilloRHI/UploadManager.hpp>
+
+#include <cstring>
+#include <vector>
+
+// host throughput of the staging writers into a HOST_ACCESS_SEQUENTIAL_WRITE mapping, usually write-combined memory,
+// against plain memcpy and a scalar conversion loop, then UploadImage converting RGB8 and RGBA32F sources as it stages
+
+static constexpr uint64_t MB = 1024ull * 1024ull;
+
+template <typename Write_T>
+static void Run(const char* name, uint64_t numBytesWritten, uint32_t numRepeats, Write_T write)
+{
+    // one untimed pass so page faults on the mapping aren't counted
+    write();
+
+    Benchmark::Clock::time_point start = Benchmark::Clock::now();
+    for (uint32_t i = 0; i < numRepeats; i++)
+        write();
+    double seconds = Benchmark::SecondsSince(start);
+
+    std::printf("%-34s %8.2f GB/s written\n", name, (double)numBytesWritten * numRepeats / seconds / (1024.0 * MB));
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t size = Benchmark::ArgumentU64(argc, argv, "--size-mb", 64) * MB;
+    uint32_t numRepeats = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--repeats", 20);
+    uint32_t imageSize = (uint32_t)Benchmark::ArgumentU64(argc, argv, "--image-size", 2048);
+
+    WilloRHI::Device device = Benchmark::CreateDevice("StagingWrites");
+    WilloRHI::Queue queue = WilloRHI::Queue::Create(device, WilloRHI::QueueType::TRANSFER);
+
+    WilloRHI::BufferId staging = device.CreateBuffer({
+        .size = size,
+        .usageFlags = WilloRHI::BufferUsageFlag::TRANSFER_SRC,
+        .allocationFlags = WilloRHI::AllocationUsageFlag::HOST_ACCESS_SEQUENTIAL_WRITE
+    });
+    uint8_t* mapped = static_cast<uint8_t*>(device.GetBufferPointer(staging));
+    if (mapped == nullptr)
+        return 1;
+
+    std::vector<uint8_t> bytes(size);
+    for (uint64_t i = 0; i < size; i++)
+        bytes[i] = (uint8_t)(i * 13);
+
+    // sources sized so each writer fills the whole mapping
+    uint64_t numPixels = size / 4;
+    std::vector<float> floats(numPixels * 4 / 2);
+    for (size_t i = 0; i < floats.size(); i++)
+        floats[i] = (float)(i % 1024) / 1024.0f;
+    std::vector<float> rgbaFloats(numPixels * 4);
+    for (size_t i = 0; i < rgbaFloats.size(); i++)
+        rgbaFloats[i] = (float)(i % 256) / 255.0f;
+
+    std::printf("%llu MB mapping, %u repeats\n", (unsigned long long)(size / MB), numRepeats);
+
+    Run("memcpy", size, numRepeats, [&]() { std::memcpy(mapped, bytes.data(), size); });
+    Run("StreamCopy", size, numRepeats, [&]() { WilloRHI::StreamCopy(mapped, bytes.data(), size); });
+
+    Run("scalar rgb8 -> rgba8", size, numRepeats, [&]() {
+        for (uint64_t i = 0; i < numPixels; i++) {
+            mapped[i * 4 + 0] = bytes[i * 3 + 0];
+            mapped[i * 4 + 1] = bytes[i * 3 + 1];
+            mapped[i * 4 + 2] = bytes[i * 3 + 2];
+            mapped[i * 4 + 3] = 255;
+        }
+    });
+    Run("ExpandRGB8ToRGBA8", size, numRepeats, [&]() { WilloRHI::ExpandRGB8ToRGBA8(mapped, bytes.data(), numPixels); });
+    Run("ConvertFloatToHalf", size, numRepeats, [&]() { WilloRHI::ConvertFloatToHalf(mapped, floats.data(), floats.size()); });
+    Run("PackRGBA32FToSRGB8", size, numRepeats, [&]() { WilloRHI::PackRGBA32FToSRGB8(mapped, rgbaFloats.data(), numPixels); });
+
+    device.DestroyBuffer(staging);
+
+    // the same conversions through the upload path, timed until the copies have landed
+    WilloRHI::UploadManager uploadManager = WilloRHI::UploadManager::Create(device, queue);
+
+    uint64_t numImagePixels = (uint64_t)imageSize * imageSize;
+    std::vector<uint8_t> rgbPixels(numImagePixels * 3, 128);
+    std::vector<float> floatPixels(numImagePixels * 4, 0.5f);
+
+    struct ImageUpload {
+        const char* name;
+        WilloRHI::Format format;
+        WilloRHI::Format sourceFormat;
+        const void* data;
+    };
+    const ImageUpload uploads[] = {
+        { "UploadImage rgb8 -> rgba8", WilloRHI::Format::R8G8B8A8_UNORM, WilloRHI::Format::R8G8B8_UNORM, rgbPixels.data() },
+        { "UploadImage rgba32f -> rgba16f", WilloRHI::Format::R16G16B16A16_SFLOAT, WilloRHI::Format::R32G32B32A32_SFLOAT, floatPixels.data() },
+        { "UploadImage rgba32f -> srgb8", WilloRHI::Format::R8G8B8A8_SRGB, WilloRHI::Format::R32G32B32A32_SFLOAT, floatPixels.data() }
+    };
+
+    for (const ImageUpload& upload : uploads) {
+        WilloRHI::ImageId image = device.CreateImage({
+            .dimensions = 2,
+            .size = { imageSize, imageSize, 1 },
+            .numLevels = 1,
+            .numLayers = 1,
+            .format = upload.format,
+            .usageFlags = WilloRHI::ImageUsageFlag::SAMPLED | WilloRHI::ImageUsageFlag::TRANSFER_DST
+        });
+
+        uint64_t numBytesWritten = numImagePixels * WilloRHI::GetFormatInfo(upload.format).bytes;
+        Run(upload.name, numBytesWritten, numRepeats, [&]() {
+            uploadManager.UploadImage({
+                .image = image,
+                .data = upload.data,
+                .extent = { imageSize, imageSize, 1 },
+                .sourceFormat = upload.sourceFormat
+            });
+            uploadManager.GetTimeline().WaitValue(uploadManager.Flush(), ~0ull);
+        });
+
+        device.DestroyImage(image);
+    }
+
+    queue.CollectGarbage();
+    return 0;
+}
@@ -46,8 +46,9 @@ namespace WilloRHI
         uint64_t bufferOffset = 0;
         uint32_t rowLength = 0;
         uint32_t imageHeight = 0;
-        ImageSubresourceLayers dstSubresource = {};
-        Offset3D dstOffset = {};
+        // the image side of the copy, its destination or its source depending on the direction
+        ImageSubresourceLayers imageSubresource = {};
+        Offset3D imageOffset = {};
         Extent3D extent = {};
     };
 
@@ -105,12 +106,19 @@ namespace WilloRHI
         void PushConstants(uint32_t offset, uint32_t size, void* data);
 
         // barriers
+        // resources last used on a queue of another family are acquired here, Queue::Submit releases them on that queue
         void GlobalMemoryBarrier(const GlobalMemoryBarrierInfo& barrierInfo);
         void ImageMemoryBarrier(ImageId image, const ImageMemoryBarrierInfo& barrierInfo);
         void BufferMemoryBarrier(BufferId buffer, const BufferMemoryBarrierInfo& barrierInfo);
 
         void FlushBarriers();
 
+        // exported and imported resources start out owned by the other process and are acquired on first use
+        // hand them back before the other process uses them, images in the layout it expects them in
+        // the next use here acquires them again, an image in the same layout it was released in
+        void ReleaseBufferToExternal(BufferId buffer);
+        void ReleaseImageToExternal(ImageId image, ImageLayout layout);
+
         // pipelines
         void BindComputePipeline(ComputePipeline pipeline);
         void BindGraphicsPipeline(GraphicsPipeline pipeline);
@@ -139,6 +147,7 @@ namespace WilloRHI
         void CopyImage(ImageId srcImage, ImageId dstImage, uint32_t numRegions, ImageCopyRegion* regions);
         void BlitImage(ImageId srcImage, ImageId dstImage, Filter filter);
         void CopyBufferToImage(BufferId srcBuffer, ImageId dstImage, uint32_t numRegions, BufferImageCopyRegion* regions);
+        void CopyImageToBuffer(ImageId srcImage, BufferId dstBuffer, uint32_t numRegions, BufferImageCopyRegion* regions);
         void CopyBuffer(BufferId srcBuffer, BufferId dstBuffer, uint32_t numRegions, BufferCopyRegion* regions);
 
         void DestroyBuffer(BufferId buffer);
@@ -151,7 +160,7 @@ namespace WilloRHI
         friend ImplQueue;
         std::shared_ptr<ImplCommandList> impl = nullptr;
 
-        CommandList(Device device, std::thread::id threadId, void* nativeHandle);
+        CommandList(Device device, std::thread::id threadId, void* nativeHandle, uint32_t queueFamily);
 
         void* GetNativeHandle() const;
         std::thread::id GetThreadId() const;
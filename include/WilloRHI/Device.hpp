@@ -16,9 +16,10 @@ namespace WilloRHI
     // to reduce memory usage or runtime performance costs of having many descriptors
     struct ResourceCountInfo
     {
-        uint32_t bufferCount = 1u << 20u;
-        uint32_t imageCount = 1u << 20u;
-        uint32_t samplerCount = 1u << 20u;
+        // each count is capped at MAX_RESOURCE_COUNT
+        uint32_t bufferCount = MAX_RESOURCE_COUNT;
+        uint32_t imageCount = MAX_RESOURCE_COUNT;
+        uint32_t samplerCount = MAX_RESOURCE_COUNT;
     };
 
     typedef void(*RHILoggingFunc)(const std::string&);
@@ -29,6 +30,58 @@ namespace WilloRHI
         RHILoggingFunc logCallback = nullptr;
         bool logInfo = false;
         ResourceCountInfo resourceCounts = {};
+        // use VK_EXT_descriptor_buffer for resource descriptors when supported, otherwise an update-after-bind set
+        bool useDescriptorBuffer = true;
+        // keep the bindless address table in device-local memory and upload changed entries on submit
+        // when false the table is host-visible and written in place, which shaders read across the bus on discrete gpus
+        bool deviceLocalAddressTable = true;
+        // buffers up to this size share backing buffers instead of getting their own allocation, 0 disables
+        // a shared buffer's native handle is the backing buffer, GetBufferNativeOffset says where it starts
+        uint64_t smallBufferThreshold = 0;
+        // backing buffers start small and double per kind of buffer up to this size
+        uint64_t smallBufferBlockSize = 16 * 1024 * 1024;
+    };
+
+    // how data reaches device-local memory on this device, picked at creation
+    enum class UploadStrategy : uint32_t {
+        // through a staging buffer and a copy on the gpu
+        STAGING = 0,
+        // all of device-local memory is host visible (resizable bar, integrated gpus), UPLOAD allocations are written in place
+        DIRECT_WRITE = 1
+    };
+
+    struct DefragmentationInfo
+    {
+        // INVALID_RESOURCE_ID defragments the default pools
+        MemoryPoolId memoryPool = INVALID_RESOURCE_ID;
+        // host time spent setting up moves per call, the rest wait for a later pass
+        double timeBudgetMs = 1.0;
+        // 0 for no limit
+        uint64_t maxBytesPerPass = 0;
+        uint32_t maxAllocationsPerPass = 0;
+    };
+
+    struct MappedRange
+    {
+        BufferId buffer = INVALID_RESOURCE_ID;
+        uint64_t offset = 0;
+        uint64_t size = WHOLE_SIZE;
+    };
+
+    struct ImageWriteInfo
+    {
+        ImageId image = INVALID_RESOURCE_ID;
+        const void* data = nullptr;
+        // texels per row and rows per slice of data, 0 for tightly packed
+        uint32_t rowLength = 0;
+        uint32_t imageHeight = 0;
+        ImageSubresourceLayers subresource = {};
+        Offset3D offset = {};
+        Extent3D extent = {};
+        // left in this layout when the driver can transition to it on the host, otherwise in the copy layout for the next barrier
+        ImageLayout finalLayout = ImageLayout::READ_ONLY;
+        // DEPTH or STENCIL for combined depth/stencil formats, empty takes the format's only aspect
+        FormatAspectFlags aspect = {};
     };
 
     class Device
@@ -43,18 +96,60 @@ namespace WilloRHI
 
         void WaitIdle() const;
 
+        UploadStrategy GetUploadStrategy() const;
+
         // resources 
 
         BufferId CreateBuffer(const BufferCreateInfo& createInfo);
+        // wraps existing host memory, such as a memory-mapped file, in a buffer the gpu reads from directly
+        // the memory is widened to minImportedHostPointerAlignment on both ends and has to stay mapped until the buffer is released
+        // needs VK_EXT_external_memory_host, returns INVALID_RESOURCE_ID without it or if the driver refuses the range
+        BufferId ImportHostBuffer(void* pointer, uint64_t size, BufferUsageFlags usageFlags = BufferUsageFlag::STORAGE | BufferUsageFlag::TRANSFER_SRC);
+
+        // sharing memory between processes through VK_KHR_external_memory_fd
+        // export returns an opaque fd the caller owns, or -1 if the resource wasn't created exportable
+        // import takes the create info the exporter used, on the same physical device, and owns the fd only on success
+        // both sides own the memory through the external queue family, see CommandList::ReleaseBufferToExternal
+        int ExportBufferFd(BufferId buffer);
+        int ExportImageFd(ImageId image);
+        BufferId ImportBufferFd(int fd, const BufferCreateInfo& createInfo);
+        ImageId ImportImageFd(int fd, const ImageCreateInfo& createInfo);
         ImageId CreateImage(const ImageCreateInfo& createInfo);
+        // matching views of the same image share one ref-counted id, views are destroyed along with their image
         ImageViewId CreateImageView(const ImageViewCreateInfo& createInfo);
+        // identical sampler descriptions share one ref-counted id, pair every create with a destroy
         SamplerId CreateSampler(const SamplerCreateInfo& createInfo);
 
+        // custom pools to keep allocations with different lifetimes out of each other's blocks
+        // destroying a pool is deferred like any resource, and until everything allocated from it has been destroyed
+        MemoryPoolId CreateMemoryPool(const MemoryPoolCreateInfo& createInfo);
+        void DestroyMemoryPool(MemoryPoolId memoryPool);
+
+        // incremental defragmentation, call once per frame between submissions until it returns true
+        // each pass copies on the given queue after the work already submitted to every queue, nothing waits on the host
+        // moved buffers and images keep their ids and switch to their new memory in the first call after the copies finish,
+        // the old memory is released by a later call once every queue has passed the work submitted by then
+        // writes to a moved resource from work submitted while its copy is in flight don't carry over to the new memory
+        // no command list may be recorded or submitted on another thread during the call
+        // mapped buffers and images, small buffers, and resources without TRANSFER_SRC and TRANSFER_DST usage are never moved
+        bool Defragment(Queue queue, const DefragmentationInfo& info);
+
         void* GetBufferPointer(BufferId buffer);
         void* GetImagePointer(ImageId image);
 
-        // immediate resource destruction
-        // these are gpu-unsafe, only use when you KNOW a resource is no longer needed by GPU
+        // mapped memory isn't always host coherent, flush host writes before the gpu reads them
+        // and invalidate before reading what the gpu wrote, both are no-ops on coherent memory
+        void FlushMappedRanges(uint32_t numRanges, const MappedRange* ranges);
+        void InvalidateMappedRanges(uint32_t numRanges, const MappedRange* ranges);
+
+        // copies texels into an image created with HOST_TRANSFER usage on the calling thread, no command lists or queues involved
+        // the image must not be in use on the gpu, and writes to the same image from several threads need external sync
+        // returns false without VK_EXT_host_image_copy, or if the image's current layout can't be copied to from the host
+        bool WriteImage(const ImageWriteInfo& writeInfo);
+
+        // deferred resource destruction
+        // the resource and its slot are released once every queue has passed the work submitted before this call
+        // ids must not be used after destroying, retired resources are released from Queue::CollectGarbage
 
         void DestroyBuffer(BufferId buffer);
         void DestroyImage(ImageId image);
@@ -71,14 +166,14 @@ namespace WilloRHI
         friend ImplQueue;
         friend ImplCommandList;
         friend ImplPipelineManager;
+        friend ImplTransientAllocator;
+        friend ImplUploadManager;
+        friend ImplReadback;
+        friend ImplReadbackManager;
         std::shared_ptr<ImplDevice> impl = nullptr;
 
-        void LockResources_Shared();
-        void UnlockResources_Shared();
-        void LockResources();
-        void UnlockResources();
-
         void* GetBufferNativeHandle(BufferId handle) const;
+        uint64_t GetBufferNativeOffset(BufferId handle) const;
         void* GetImageNativeHandle(ImageId handle) const;
         void* GetImageViewNativeHandle(ImageViewId handle) const;
         void* GetSamplerNativeHandle(SamplerId handle) const;
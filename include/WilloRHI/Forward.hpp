@@ -31,4 +31,16 @@ namespace WilloRHI
 
     class PipelineManager;
     struct ImplPipelineManager;
+
+    class TransientAllocator;
+    struct ImplTransientAllocator;
+
+    class UploadManager;
+    struct ImplUploadManager;
+
+    class Readback;
+    struct ImplReadback;
+
+    class ReadbackManager;
+    struct ImplReadbackManager;
 }
@@ -45,6 +45,10 @@ namespace WilloRHI
 
     protected:
         friend ImplDevice;
+        friend ImplTransientAllocator;
+        friend ImplUploadManager;
+        friend ImplReadback;
+        friend ImplReadbackManager;
 
         std::shared_ptr<ImplQueue> impl = nullptr;
     };
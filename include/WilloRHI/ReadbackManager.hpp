@@ -0,0 +1,62 @@
+#pragma once
+
+#include "WilloRHI/Device.hpp"
+#include "WilloRHI/Queue.hpp"
+
+#include <stdint.h>
+
+namespace WilloRHI
+{
+    struct ReadbackManagerCreateInfo
+    {
+        // host-cached ring the copies land in, readbacks that don't fit get a buffer of their own
+        uint64_t ringSize = 32 * 1024 * 1024;
+    };
+
+    struct ImageReadbackInfo
+    {
+        ImageId image = INVALID_RESOURCE_ID;
+        ImageSubresourceLayers subresource = {};
+        Offset3D offset = {};
+        Extent3D extent = {};
+    };
+
+    // the result of a readback, ready once the submission copying it has completed on the manager's queue
+    // its memory goes back to the manager when the last copy of the handle is gone
+    class Readback
+    {
+    public:
+        Readback() = default;
+
+        bool IsReady() const;
+        // blocks until ready or timeout nanoseconds have passed, false if not ready or never flushed
+        bool Wait(uint64_t timeout = UINT64_MAX) const;
+
+        // tightly packed, layers one after another for images, nullptr until ready
+        const void* GetData() const;
+        uint64_t GetSize() const;
+
+    protected:
+        friend ImplReadbackManager;
+        std::shared_ptr<ImplReadback> impl = nullptr;
+    };
+
+    // copies device data back to the host without stalling, results are polled or waited on per readback
+    // copies are ordered after everything already submitted to the manager's queue
+    // readbacks must be released before the manager is destroyed
+    class ReadbackManager
+    {
+    public:
+        ReadbackManager() = default;
+        static ReadbackManager Create(Device device, Queue queue, const ReadbackManagerCreateInfo& createInfo = {});
+
+        // thread safe, the copies are recorded and submitted by the next Flush
+        Readback ReadBuffer(BufferId buffer, uint64_t offset, uint64_t size);
+        Readback ReadImage(const ImageReadbackInfo& readbackInfo);
+
+        void Flush();
+
+    protected:
+        std::shared_ptr<ImplReadbackManager> impl = nullptr;
+    };
+}
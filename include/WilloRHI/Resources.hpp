@@ -10,13 +10,42 @@ namespace WilloRHI
     typedef uint32_t ImageId;
     typedef uint32_t ImageViewId;
     typedef uint32_t SamplerId;
+    typedef uint32_t MemoryPoolId;
+
+    // ids pack the descriptor slot into the low bits and a generation into the high bits
+    // the generation changes every time a slot is freed, so stale ids can be detected
+    // shaders mask the slot back out with WilloRHI_RESOURCE_INDEX_MASK
+    constexpr uint32_t RESOURCE_INDEX_BITS = 20;
+    constexpr uint32_t RESOURCE_INDEX_MASK = (1u << RESOURCE_INDEX_BITS) - 1;
+    constexpr uint32_t RESOURCE_GENERATION_MASK = 0xFFFFFFFF >> RESOURCE_INDEX_BITS;
+
+    // largest number of slots per resource type, the all-ones index is reserved
+    constexpr uint32_t MAX_RESOURCE_COUNT = RESOURCE_INDEX_MASK;
+
+    // returned by resource creation when no slot could be allocated
+    constexpr uint32_t INVALID_RESOURCE_ID = 0xFFFFFFFF;
+
+    // sizes covering everything from an offset to the end of the resource
+    constexpr uint64_t WHOLE_SIZE = ~0ull;
+
+    constexpr uint32_t ResourceIndex(uint32_t id) { return id & RESOURCE_INDEX_MASK; }
+    constexpr uint32_t ResourceGeneration(uint32_t id) { return id >> RESOURCE_INDEX_BITS; }
+    constexpr uint32_t MakeResourceId(uint32_t index, uint32_t generation) {
+        return (index & RESOURCE_INDEX_MASK) | (generation << RESOURCE_INDEX_BITS); }
 
     constexpr float LOD_CLAMP_NONE  = 1000.0F;
 
     // createinfo structures
     struct BufferCreateInfo {
         uint64_t size = 0;
+        // buffers always get a device address, only STORAGE buffers get a bindless descriptor
+        BufferUsageFlags usageFlags = BufferUsageFlag::STORAGE | BufferUsageFlag::TRANSFER_SRC | BufferUsageFlag::TRANSFER_DST;
         AllocationUsageFlags allocationFlags = {};
+        // INVALID_RESOURCE_ID allocates from the default pools
+        // pooled buffers always get their own allocation, never a shared small buffer block
+        MemoryPoolId memoryPool = INVALID_RESOURCE_ID;
+        // dedicated memory that Device::ExportBufferFd can hand to another process, never host mapped or pooled
+        bool exportable = false;
     };
 
     struct ImageCreateInfo {
@@ -29,6 +58,30 @@ namespace WilloRHI
         ImageCreateFlags createFlags = {};
         AllocationUsageFlags allocationFlags = {};
         ImageTiling tiling = ImageTiling::OPTIMAL;
+        MemoryPoolId memoryPool = INVALID_RESOURCE_ID;
+        // dedicated memory that Device::ExportImageFd can hand to another process, never host mapped or pooled
+        bool exportable = false;
+    };
+
+    // a pool holds blocks of a single memory type, picked for the resource type and allocation flags given
+    // ids are generational like resource ids, a destroyed pool's id never resolves to a newer pool
+    struct MemoryPoolCreateInfo {
+        MemoryPoolResourceType resourceType = MemoryPoolResourceType::BUFFER;
+        AllocationUsageFlags allocationFlags = {};
+        // image pools pick their memory type for an optimal-tiled image of this format and usage
+        // CreateImage refuses images whose requirements don't include that type
+        Format imageFormat = Format::R8G8B8A8_UNORM;
+        ImageUsageFlags imageUsage = ImageUsageFlag::SAMPLED | ImageUsageFlag::TRANSFER_DST | ImageUsageFlag::COLOUR_ATTACHMENT;
+        // stack or ring allocation instead of general-purpose, for resources freed in the order they were made
+        // a single block is needed to use it as a ring buffer
+        bool linear = false;
+        // 0 lets the allocator pick, and grow, block sizes
+        uint64_t blockSize = 0;
+        uint64_t minBlockCount = 0;
+        // 0 for no limit
+        uint64_t maxBlockCount = 0;
+        // which memory the driver keeps resident under pressure, ignored without VK_EXT_memory_priority
+        float priority = 0.5f;
     };
 
     struct ImageViewCreateInfo {
@@ -36,6 +89,8 @@ namespace WilloRHI
         ImageViewType viewType = ImageViewType::VIEW_TYPE_2D;
         Format format = Format::UNDEFINED;
         ImageSubresourceRange subresource = {};
+
+        bool operator==(const ImageViewCreateInfo&) const = default;
     };
 
     struct SamplerCreateInfo {
@@ -55,5 +110,7 @@ namespace WilloRHI
         float maxLod = LOD_CLAMP_NONE;
         BorderColour borderColour = BorderColour::FLOAT_TRANSPARENT_BLACK;
         bool unnormalizedCoordinates = false;
+
+        bool operator==(const SamplerCreateInfo&) const = default;
     };
 }
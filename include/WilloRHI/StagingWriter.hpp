@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace WilloRHI
+{
+    // writers for HOST_ACCESS_SEQUENTIAL_WRITE mappings, which are usually write-combined
+    // they write every destination byte exactly once, in order, with non-temporal stores where the cpu has them
+    // avx2, ssse3 or sse2 is picked at runtime, anything else gets the scalar versions
+
+    // memcpy that doesn't pull the destination into the cache, falls back to memcpy for small copies
+    void StreamCopy(void* dst, const void* src, uint64_t size);
+
+    // tightly packed rgb8 to rgba8 with a constant alpha
+    void ExpandRGB8ToRGBA8(void* dst, const void* src, uint64_t numPixels, uint8_t alpha = 255);
+
+    // float to ieee half, rounding to nearest even, for R16_SFLOAT style formats
+    void ConvertFloatToHalf(void* dst, const float* src, uint64_t count);
+
+    // linear rgba floats to rgba8 with srgb encoded colour, alpha stays linear, values are clamped to [0, 1]
+    void PackRGBA32FToSRGB8(void* dst, const float* src, uint64_t numPixels);
+}
@@ -23,13 +23,20 @@ namespace WilloRHI
     struct TimelineSemaphore {
     public:
         TimelineSemaphore() = default;
-        static TimelineSemaphore Create(Device device, uint64_t value);
+        // exportable semaphores can be shared with another process through VK_KHR_external_semaphore_fd
+        static TimelineSemaphore Create(Device device, uint64_t value, bool exportable = false);
+        // takes ownership of the fd on success, shares its payload with the exporter's semaphore
+        // an empty semaphore if the import failed
+        static TimelineSemaphore Import(Device device, int fd);
 
         void* GetNativeHandle() const;
 
         void WaitValue(uint64_t value, uint64_t timeout);
         uint64_t GetValue();
 
+        // a new opaque fd the caller owns, -1 if the semaphore wasn't created exportable or the device can't export it
+        int ExportFd();
+
     protected:
         friend ImplDevice;
         friend ImplSwapchain;
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "WilloRHI/Device.hpp"
+#include "WilloRHI/Queue.hpp"
+
+#include <stdint.h>
+
+namespace WilloRHI
+{
+    struct TransientAllocatorCreateInfo
+    {
+        // allocations larger than this get a dedicated chunk of their own
+        uint64_t chunkSize = 4 * 1024 * 1024;
+        uint32_t initialChunkCount = 2;
+    };
+
+    // a slice of a persistently mapped chunk buffer, valid until the owning frame completes on the queue
+    struct TransientAllocation
+    {
+        BufferId buffer = INVALID_RESOURCE_ID;
+        uint64_t offset = 0;
+        uint64_t deviceAddress = 0;
+        void* hostPointer = nullptr;
+    };
+
+    // linear per-frame allocator for constants and small uploads
+    // chunks are recycled once the queue's submission timeline passes the frame they were used in
+    class TransientAllocator
+    {
+    public:
+        TransientAllocator() = default;
+        static TransientAllocator Create(Device device, Queue queue, const TransientAllocatorCreateInfo& createInfo = {});
+
+        // thread safe, a bump of the current chunk's offset in the common case
+        TransientAllocation Allocate(uint64_t size, uint64_t alignment = 16);
+
+        // call once per frame after the frame's work has been submitted to the queue
+        // must not run concurrently with Allocate
+        void EndFrame();
+
+    protected:
+        std::shared_ptr<ImplTransientAllocator> impl = nullptr;
+    };
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+#include <initializer_list>
 #include <string>
 #include <memory>
 #include <stdint.h>
@@ -60,6 +62,8 @@ namespace WilloRHI
         uint32_t numLevels = 1;
         uint32_t baseLayer = 0;
         uint32_t numLayers = 1;
+
+        bool operator==(const ImageSubresourceRange&) const = default;
     };
 
     struct ImageSubresourceLayers
@@ -320,7 +324,241 @@ namespace WilloRHI
         MAX_ENUM = 0x7fffffff,
     };
 
-    // format bits per pixel
+    // values match VkImageAspectFlagBits
+    enum class FormatAspectFlag : uint32_t {
+        COLOUR = 0x00000001,
+        DEPTH = 0x00000002,
+        STENCIL = 0x00000004
+    };
+    WilloRHI_DECLARE_FLAG_TYPE(FormatAspectFlags, FormatAspectFlag, uint32_t)
+
+    enum class FormatCompression : uint32_t {
+        NONE = 0,
+        BC = 1,
+        ETC2 = 2,
+        EAC = 3,
+        ASTC = 4,
+        PVRTC = 5
+    };
+
+    // size of one texel block in bytes and its extent in texels, 1x1 for uncompressed formats
+    // bytes is 0 for multi-planar formats, combined depth/stencil copies go one aspect at a time and can't use bytes either
+    struct FormatInfo {
+        uint32_t bytes = 0;
+        uint32_t blockWidth = 1;
+        uint32_t blockHeight = 1;
+        FormatAspectFlags aspect = {};
+        FormatCompression compression = FormatCompression::NONE;
+        uint32_t numPlanes = 1;
+    };
+
+    // Format values are the core range plus a few extension ranges, packed back to back here
+    struct FormatRange {
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    inline constexpr FormatRange FORMAT_RANGES[] = {
+        { (uint32_t)Format::UNDEFINED, 185 },
+        { (uint32_t)Format::G8B8G8R8_422_UNORM, 34 },
+        { (uint32_t)Format::G8_B8R8_2PLANE_444_UNORM, 4 },
+        { (uint32_t)Format::A4R4G4B4_UNORM_PACK16, 2 },
+        { (uint32_t)Format::ASTC_4x4_SFLOAT_BLOCK, 14 },
+        { (uint32_t)Format::PVRTC1_2BPP_UNORM_BLOCK_IMG, 8 }
+    };
+
+    constexpr uint32_t FormatTableSize()
+    {
+        uint32_t size = 0;
+        for (const FormatRange& range : FORMAT_RANGES)
+            size += range.count;
+        return size;
+    }
+
+    // unknown formats map to the UNDEFINED entry
+    // the core range sits first at base 0, so core formats index the table directly
+    constexpr uint32_t FormatIndex(Format format)
+    {
+        uint32_t value = (uint32_t)format;
+        if (value < FORMAT_RANGES[0].count)
+            return value;
+
+        uint32_t base = 0;
+        for (const FormatRange& range : FORMAT_RANGES) {
+            if (value - range.first < range.count)
+                return base + (value - range.first);
+            base += range.count;
+        }
+        return 0;
+    }
+
+    using FormatTable = std::array<FormatInfo, FormatTableSize()>;
+
+    constexpr FormatTable BuildFormatTable()
+    {
+        FormatTable table = {};
+
+        auto set = [&](std::initializer_list<Format> formats, FormatInfo info) {
+            for (Format format : formats)
+                table[FormatIndex(format)] = info;
+        };
+
+        constexpr FormatAspectFlags COLOUR = FormatAspectFlag::COLOUR;
+        constexpr FormatCompression NONE = FormatCompression::NONE;
+
+        set({ Format::R4G4_UNORM_PACK8, Format::R8_UNORM, Format::R8_SNORM, Format::R8_USCALED, Format::R8_SSCALED,
+            Format::R8_UINT, Format::R8_SINT, Format::R8_SRGB },
+            { 1, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R4G4B4A4_UNORM_PACK16, Format::B4G4R4A4_UNORM_PACK16, Format::R5G6B5_UNORM_PACK16,
+            Format::B5G6R5_UNORM_PACK16, Format::R5G5B5A1_UNORM_PACK16, Format::B5G5R5A1_UNORM_PACK16,
+            Format::A1R5G5B5_UNORM_PACK16, Format::A4R4G4B4_UNORM_PACK16, Format::A4B4G4R4_UNORM_PACK16,
+            Format::R8G8_UNORM, Format::R8G8_SNORM, Format::R8G8_USCALED, Format::R8G8_SSCALED, Format::R8G8_UINT,
+            Format::R8G8_SINT, Format::R8G8_SRGB, Format::R16_UNORM, Format::R16_SNORM, Format::R16_USCALED,
+            Format::R16_SSCALED, Format::R16_UINT, Format::R16_SINT, Format::R16_SFLOAT, Format::R10X6_UNORM_PACK16,
+            Format::R12X4_UNORM_PACK16 },
+            { 2, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R8G8B8_UNORM, Format::R8G8B8_SNORM, Format::R8G8B8_USCALED, Format::R8G8B8_SSCALED,
+            Format::R8G8B8_UINT, Format::R8G8B8_SINT, Format::R8G8B8_SRGB, Format::B8G8R8_UNORM, Format::B8G8R8_SNORM,
+            Format::B8G8R8_USCALED, Format::B8G8R8_SSCALED, Format::B8G8R8_UINT, Format::B8G8R8_SINT,
+            Format::B8G8R8_SRGB },
+            { 3, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R8G8B8A8_UNORM, Format::R8G8B8A8_SNORM, Format::R8G8B8A8_USCALED, Format::R8G8B8A8_SSCALED,
+            Format::R8G8B8A8_UINT, Format::R8G8B8A8_SINT, Format::R8G8B8A8_SRGB, Format::B8G8R8A8_UNORM,
+            Format::B8G8R8A8_SNORM, Format::B8G8R8A8_USCALED, Format::B8G8R8A8_SSCALED, Format::B8G8R8A8_UINT,
+            Format::B8G8R8A8_SINT, Format::B8G8R8A8_SRGB, Format::A8B8G8R8_UNORM_PACK32, Format::A8B8G8R8_SNORM_PACK32,
+            Format::A8B8G8R8_USCALED_PACK32, Format::A8B8G8R8_SSCALED_PACK32, Format::A8B8G8R8_UINT_PACK32,
+            Format::A8B8G8R8_SINT_PACK32, Format::A8B8G8R8_SRGB_PACK32, Format::A2R10G10B10_UNORM_PACK32,
+            Format::A2R10G10B10_SNORM_PACK32, Format::A2R10G10B10_USCALED_PACK32, Format::A2R10G10B10_SSCALED_PACK32,
+            Format::A2R10G10B10_UINT_PACK32, Format::A2R10G10B10_SINT_PACK32, Format::A2B10G10R10_UNORM_PACK32,
+            Format::A2B10G10R10_SNORM_PACK32, Format::A2B10G10R10_USCALED_PACK32, Format::A2B10G10R10_SSCALED_PACK32,
+            Format::A2B10G10R10_UINT_PACK32, Format::A2B10G10R10_SINT_PACK32, Format::R16G16_UNORM, Format::R16G16_SNORM,
+            Format::R16G16_USCALED, Format::R16G16_SSCALED, Format::R16G16_UINT, Format::R16G16_SINT,
+            Format::R16G16_SFLOAT, Format::R32_UINT, Format::R32_SINT, Format::R32_SFLOAT,
+            Format::B10G11R11_UFLOAT_PACK32, Format::E5B9G9R9_UFLOAT_PACK32, Format::R10X6G10X6_UNORM_2PACK16,
+            Format::R12X4G12X4_UNORM_2PACK16 },
+            { 4, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R16G16B16_UNORM, Format::R16G16B16_SNORM, Format::R16G16B16_USCALED, Format::R16G16B16_SSCALED,
+            Format::R16G16B16_UINT, Format::R16G16B16_SINT, Format::R16G16B16_SFLOAT },
+            { 6, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R16G16B16A16_UNORM, Format::R16G16B16A16_SNORM, Format::R16G16B16A16_USCALED,
+            Format::R16G16B16A16_SSCALED, Format::R16G16B16A16_UINT, Format::R16G16B16A16_SINT,
+            Format::R16G16B16A16_SFLOAT, Format::R32G32_UINT, Format::R32G32_SINT, Format::R32G32_SFLOAT,
+            Format::R64_UINT, Format::R64_SINT, Format::R64_SFLOAT, Format::R10X6G10X6B10X6A10X6_UNORM_4PACK16,
+            Format::R12X4G12X4B12X4A12X4_UNORM_4PACK16 },
+            { 8, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R32G32B32_UINT, Format::R32G32B32_SINT, Format::R32G32B32_SFLOAT },
+            { 12, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R32G32B32A32_UINT, Format::R32G32B32A32_SINT, Format::R32G32B32A32_SFLOAT,
+            Format::R64G64_UINT, Format::R64G64_SINT, Format::R64G64_SFLOAT },
+            { 16, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R64G64B64_UINT, Format::R64G64B64_SINT, Format::R64G64B64_SFLOAT },
+            { 24, 1, 1, COLOUR, NONE, 1 });
+
+        set({ Format::R64G64B64A64_UINT, Format::R64G64B64A64_SINT, Format::R64G64B64A64_SFLOAT },
+            { 32, 1, 1, COLOUR, NONE, 1 });
+
+        // 422 formats pack two texels horizontally
+        set({ Format::G8B8G8R8_422_UNORM, Format::B8G8R8G8_422_UNORM },
+            { 4, 2, 1, COLOUR, NONE, 1 });
+
+        set({ Format::G10X6B10X6G10X6R10X6_422_UNORM_4PACK16, Format::B10X6G10X6R10X6G10X6_422_UNORM_4PACK16,
+            Format::G12X4B12X4G12X4R12X4_422_UNORM_4PACK16, Format::B12X4G12X4R12X4G12X4_422_UNORM_4PACK16,
+            Format::G16B16G16R16_422_UNORM, Format::B16G16R16G16_422_UNORM },
+            { 8, 2, 1, COLOUR, NONE, 1 });
+
+        // depth and stencil only copy one aspect at a time, the combined formats' sizes are their texel blocks
+        set({ Format::D16_UNORM }, { 2, 1, 1, FormatAspectFlag::DEPTH, NONE, 1 });
+        set({ Format::X8_D24_UNORM_PACK32, Format::D32_SFLOAT }, { 4, 1, 1, FormatAspectFlag::DEPTH, NONE, 1 });
+        set({ Format::S8_UINT }, { 1, 1, 1, FormatAspectFlag::STENCIL, NONE, 1 });
+        set({ Format::D16_UNORM_S8_UINT }, { 3, 1, 1, FormatAspectFlag::DEPTH | FormatAspectFlag::STENCIL, NONE, 1 });
+        set({ Format::D24_UNORM_S8_UINT }, { 4, 1, 1, FormatAspectFlag::DEPTH | FormatAspectFlag::STENCIL, NONE, 1 });
+        set({ Format::D32_SFLOAT_S8_UINT }, { 5, 1, 1, FormatAspectFlag::DEPTH | FormatAspectFlag::STENCIL, NONE, 1 });
+
+        set({ Format::G8_B8_R8_3PLANE_420_UNORM, Format::G8_B8_R8_3PLANE_422_UNORM, Format::G8_B8_R8_3PLANE_444_UNORM,
+            Format::G10X6_B10X6_R10X6_3PLANE_420_UNORM_3PACK16, Format::G10X6_B10X6_R10X6_3PLANE_422_UNORM_3PACK16,
+            Format::G10X6_B10X6_R10X6_3PLANE_444_UNORM_3PACK16, Format::G12X4_B12X4_R12X4_3PLANE_420_UNORM_3PACK16,
+            Format::G12X4_B12X4_R12X4_3PLANE_422_UNORM_3PACK16, Format::G12X4_B12X4_R12X4_3PLANE_444_UNORM_3PACK16,
+            Format::G16_B16_R16_3PLANE_420_UNORM, Format::G16_B16_R16_3PLANE_422_UNORM,
+            Format::G16_B16_R16_3PLANE_444_UNORM },
+            { 0, 1, 1, COLOUR, NONE, 3 });
+
+        set({ Format::G8_B8R8_2PLANE_420_UNORM, Format::G8_B8R8_2PLANE_422_UNORM, Format::G8_B8R8_2PLANE_444_UNORM,
+            Format::G10X6_B10X6R10X6_2PLANE_420_UNORM_3PACK16, Format::G10X6_B10X6R10X6_2PLANE_422_UNORM_3PACK16,
+            Format::G10X6_B10X6R10X6_2PLANE_444_UNORM_3PACK16, Format::G12X4_B12X4R12X4_2PLANE_420_UNORM_3PACK16,
+            Format::G12X4_B12X4R12X4_2PLANE_422_UNORM_3PACK16, Format::G12X4_B12X4R12X4_2PLANE_444_UNORM_3PACK16,
+            Format::G16_B16R16_2PLANE_420_UNORM, Format::G16_B16R16_2PLANE_422_UNORM,
+            Format::G16_B16R16_2PLANE_444_UNORM },
+            { 0, 1, 1, COLOUR, NONE, 2 });
+
+        set({ Format::BC1_RGB_UNORM_BLOCK, Format::BC1_RGB_SRGB_BLOCK, Format::BC1_RGBA_UNORM_BLOCK,
+            Format::BC1_RGBA_SRGB_BLOCK, Format::BC4_UNORM_BLOCK, Format::BC4_SNORM_BLOCK },
+            { 8, 4, 4, COLOUR, FormatCompression::BC, 1 });
+
+        set({ Format::BC2_UNORM_BLOCK, Format::BC2_SRGB_BLOCK, Format::BC3_UNORM_BLOCK, Format::BC3_SRGB_BLOCK,
+            Format::BC5_UNORM_BLOCK, Format::BC5_SNORM_BLOCK, Format::BC6H_UFLOAT_BLOCK, Format::BC6H_SFLOAT_BLOCK,
+            Format::BC7_UNORM_BLOCK, Format::BC7_SRGB_BLOCK },
+            { 16, 4, 4, COLOUR, FormatCompression::BC, 1 });
+
+        set({ Format::ETC2_R8G8B8_UNORM_BLOCK, Format::ETC2_R8G8B8_SRGB_BLOCK, Format::ETC2_R8G8B8A1_UNORM_BLOCK,
+            Format::ETC2_R8G8B8A1_SRGB_BLOCK },
+            { 8, 4, 4, COLOUR, FormatCompression::ETC2, 1 });
+
+        set({ Format::ETC2_R8G8B8A8_UNORM_BLOCK, Format::ETC2_R8G8B8A8_SRGB_BLOCK },
+            { 16, 4, 4, COLOUR, FormatCompression::ETC2, 1 });
+
+        set({ Format::EAC_R11_UNORM_BLOCK, Format::EAC_R11_SNORM_BLOCK },
+            { 8, 4, 4, COLOUR, FormatCompression::EAC, 1 });
+
+        set({ Format::EAC_R11G11_UNORM_BLOCK, Format::EAC_R11G11_SNORM_BLOCK },
+            { 16, 4, 4, COLOUR, FormatCompression::EAC, 1 });
+
+        set({ Format::PVRTC1_4BPP_UNORM_BLOCK_IMG, Format::PVRTC2_4BPP_UNORM_BLOCK_IMG, Format::PVRTC1_4BPP_SRGB_BLOCK_IMG,
+            Format::PVRTC2_4BPP_SRGB_BLOCK_IMG },
+            { 8, 4, 4, COLOUR, FormatCompression::PVRTC, 1 });
+
+        set({ Format::PVRTC1_2BPP_UNORM_BLOCK_IMG, Format::PVRTC2_2BPP_UNORM_BLOCK_IMG, Format::PVRTC1_2BPP_SRGB_BLOCK_IMG,
+            Format::PVRTC2_2BPP_SRGB_BLOCK_IMG },
+            { 8, 8, 4, COLOUR, FormatCompression::PVRTC, 1 });
+
+        // astc blocks are always 16 bytes, unorm/srgb/sfloat share a block size
+        auto setASTC = [&](std::initializer_list<Format> formats, uint32_t width, uint32_t height) {
+            set(formats, { 16, width, height, COLOUR, FormatCompression::ASTC, 1 });
+        };
+        setASTC({ Format::ASTC_4x4_UNORM_BLOCK, Format::ASTC_4x4_SRGB_BLOCK, Format::ASTC_4x4_SFLOAT_BLOCK }, 4, 4);
+        setASTC({ Format::ASTC_5x4_UNORM_BLOCK, Format::ASTC_5x4_SRGB_BLOCK, Format::ASTC_5x4_SFLOAT_BLOCK }, 5, 4);
+        setASTC({ Format::ASTC_5x5_UNORM_BLOCK, Format::ASTC_5x5_SRGB_BLOCK, Format::ASTC_5x5_SFLOAT_BLOCK }, 5, 5);
+        setASTC({ Format::ASTC_6x5_UNORM_BLOCK, Format::ASTC_6x5_SRGB_BLOCK, Format::ASTC_6x5_SFLOAT_BLOCK }, 6, 5);
+        setASTC({ Format::ASTC_6x6_UNORM_BLOCK, Format::ASTC_6x6_SRGB_BLOCK, Format::ASTC_6x6_SFLOAT_BLOCK }, 6, 6);
+        setASTC({ Format::ASTC_8x5_UNORM_BLOCK, Format::ASTC_8x5_SRGB_BLOCK, Format::ASTC_8x5_SFLOAT_BLOCK }, 8, 5);
+        setASTC({ Format::ASTC_8x6_UNORM_BLOCK, Format::ASTC_8x6_SRGB_BLOCK, Format::ASTC_8x6_SFLOAT_BLOCK }, 8, 6);
+        setASTC({ Format::ASTC_8x8_UNORM_BLOCK, Format::ASTC_8x8_SRGB_BLOCK, Format::ASTC_8x8_SFLOAT_BLOCK }, 8, 8);
+        setASTC({ Format::ASTC_10x5_UNORM_BLOCK, Format::ASTC_10x5_SRGB_BLOCK, Format::ASTC_10x5_SFLOAT_BLOCK }, 10, 5);
+        setASTC({ Format::ASTC_10x6_UNORM_BLOCK, Format::ASTC_10x6_SRGB_BLOCK, Format::ASTC_10x6_SFLOAT_BLOCK }, 10, 6);
+        setASTC({ Format::ASTC_10x8_UNORM_BLOCK, Format::ASTC_10x8_SRGB_BLOCK, Format::ASTC_10x8_SFLOAT_BLOCK }, 10, 8);
+        setASTC({ Format::ASTC_10x10_UNORM_BLOCK, Format::ASTC_10x10_SRGB_BLOCK, Format::ASTC_10x10_SFLOAT_BLOCK }, 10, 10);
+        setASTC({ Format::ASTC_12x10_UNORM_BLOCK, Format::ASTC_12x10_SRGB_BLOCK, Format::ASTC_12x10_SFLOAT_BLOCK }, 12, 10);
+        setASTC({ Format::ASTC_12x12_UNORM_BLOCK, Format::ASTC_12x12_SRGB_BLOCK, Format::ASTC_12x12_SFLOAT_BLOCK }, 12, 12);
+
+        return table;
+    }
+
+    inline constexpr FormatTable FORMAT_TABLE = BuildFormatTable();
+
+    // table lookup, UNDEFINED and unknown formats get an empty entry
+    constexpr const FormatInfo& GetFormatInfo(Format format)
+    {
+        return FORMAT_TABLE[FormatIndex(format)];
+    }
+
+    // format bits per pixel, rounded down for block compressed formats
     uint32_t get_bpp(Format format);
 
     enum class PresentMode : uint32_t {
@@ -383,17 +621,36 @@ namespace WilloRHI
         STORAGE = 0x00000008,
         COLOUR_ATTACHMENT = 0x00000010,
         DEPTH_STENCIL_ATTACHMENT = 0x00000020,
+        // written from the host with Device::WriteImage, dropped when VK_EXT_host_image_copy isn't supported
+        HOST_TRANSFER = 0x00400000,
     };
     WilloRHI_DECLARE_FLAG_TYPE(ImageUsageFlags, ImageUsageFlag, uint32_t)
 
+    enum class BufferUsageFlag : uint32_t {
+        TRANSFER_SRC = 0x00000001,
+        TRANSFER_DST = 0x00000002,
+        STORAGE = 0x00000020,
+        INDEX = 0x00000040,
+        VERTEX = 0x00000080,
+        INDIRECT = 0x00000100,
+    };
+    WilloRHI_DECLARE_FLAG_TYPE(BufferUsageFlags, BufferUsageFlag, uint32_t)
+
     enum class AllocationUsageFlag : uint32_t {
         DEDICATED_MEMORY = 0x00000001,
         CAN_ALIAS = 0x00000200,
         HOST_ACCESS_SEQUENTIAL_WRITE = 0x00000400,
-        HOST_ACCESS_RANDOM = 0x00000800
+        HOST_ACCESS_RANDOM = 0x00000800,
+        // filled from the host, mapped device-local memory under UploadStrategy::DIRECT_WRITE and ordinary device-local memory otherwise
+        UPLOAD = 0x40000000
     };
     WilloRHI_DECLARE_FLAG_TYPE(AllocationUsageFlags, AllocationUsageFlag, uint32_t)
 
+    enum class MemoryPoolResourceType : uint32_t {
+        BUFFER = 0,
+        IMAGE = 1
+    };
+
     enum class ImageCreateFlag : uint32_t {
         ALLOW_MUTABLE_FORMAT = 0x00000008,
         COMPAT_CUBE = 0x00000010,
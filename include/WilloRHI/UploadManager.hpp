@@ -0,0 +1,70 @@
+#pragma once
+
+#include "WilloRHI/Device.hpp"
+#include "WilloRHI/Queue.hpp"
+
+#include <stdint.h>
+#include <string>
+
+namespace WilloRHI
+{
+    struct UploadManagerCreateInfo
+    {
+        // persistently mapped staging ring, larger uploads are streamed through it in pieces
+        // an image slice that can't be split and doesn't fit gets a temporary staging buffer of its own
+        uint64_t stagingSize = 64 * 1024 * 1024;
+        // recorded copies are submitted once this much has been staged since the last flush
+        uint64_t batchSize = 16 * 1024 * 1024;
+        // file reads kept in flight by UploadBufferFromFile
+        uint32_t maxFileReadsInFlight = 8;
+    };
+
+    struct ImageUploadInfo
+    {
+        ImageId image = INVALID_RESOURCE_ID;
+        const void* data = nullptr;
+        // texels per row and rows per slice of data, 0 for tightly packed
+        uint32_t rowLength = 0;
+        uint32_t imageHeight = 0;
+        ImageSubresourceLayers subresource = {};
+        Offset3D offset = {};
+        Extent3D extent = {};
+        // layout the image is left in for whoever uses it next
+        ImageLayout finalLayout = ImageLayout::READ_ONLY;
+        // format of data when it isn't the image's, converted while it's written into staging
+        // supported: RGB8 to RGBA8 (alpha 255), 32-bit floats to 16-bit floats, RGBA32F to R8G8B8A8_SRGB
+        // rowLength and imageHeight still count texels of data
+        Format sourceFormat = Format::UNDEFINED;
+    };
+
+    // streams buffer and image data through a staging ring into copies on its own queue, normally a TRANSFER queue
+    // consumers on another queue family take ownership through a barrier, or implicitly through copies, clears,
+    // vertex/index binds and indirect draws, Queue::Submit then releases them here first
+    // resources only read through descriptors need an ImageMemoryBarrier/BufferMemoryBarrier before that first read
+    class UploadManager
+    {
+    public:
+        UploadManager() = default;
+        static UploadManager Create(Device device, Queue queue, const UploadManagerCreateInfo& createInfo = {});
+
+        // thread safe, data is copied into staging memory before returning
+        // blocks the calling thread only while the ring is full, until an earlier batch completes
+        // buffers created with AllocationUsageFlag::UPLOAD under UploadStrategy::DIRECT_WRITE are written in place instead, and must not be in use on the gpu
+        void UploadBuffer(BufferId buffer, uint64_t offset, const void* data, uint64_t size);
+        void UploadImage(const ImageUploadInfo& uploadInfo);
+
+        // reads straight into staging memory, io_uring and unbuffered where available, and copies each piece once it lands
+        // returns once every read has completed, false if the file couldn't be opened or read in full
+        bool UploadBufferFromFile(BufferId buffer, uint64_t offset, const std::string& path, uint64_t fileOffset, uint64_t size);
+
+        // submits everything staged so far
+        // returns the GetTimeline() value that is reached once it has all landed, wait on it before using the data
+        uint64_t Flush();
+
+        TimelineSemaphore GetTimeline() const;
+        bool IsComplete(uint64_t value) const;
+
+    protected:
+        std::shared_ptr<ImplUploadManager> impl = nullptr;
+    };
+}
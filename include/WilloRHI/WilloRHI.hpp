@@ -11,3 +11,7 @@
 #include "WilloRHI/CommandList.hpp"
 #include "WilloRHI/Queue.hpp"
 #include "WilloRHI/Pipeline.hpp"
+#include "WilloRHI/TransientAllocator.hpp"
+#include "WilloRHI/UploadManager.hpp"
+#include "WilloRHI/ReadbackManager.hpp"
+#include "WilloRHI/StagingWriter.hpp"
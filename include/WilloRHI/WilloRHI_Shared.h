@@ -5,3 +5,5 @@
 #define WilloRHI_SAMPLER_BINDING 3
 // buffer holding BDA pointers, for access w/ indexing
 #define WilloRHI_DEVICE_ADDRESS_BUFFER_BINDING 4
+// resource ids carry a generation in their upper bits, mask it off before indexing
+#define WilloRHI_RESOURCE_INDEX_MASK 0x000FFFFF
@@ -1,4 +1,5 @@
 #include "ImplCommandList.hpp"
+#include "ImplDevice.hpp"
 
 namespace WilloRHI
 {
@@ -9,8 +10,6 @@ namespace WilloRHI
     void CommandList::Begin() { impl->Begin(); }
     void ImplCommandList::Begin()
     {
-        _device.LockResources_Shared();
-
         VkCommandBufferBeginInfo beginInfo = {
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
             .pNext = nullptr,
@@ -19,13 +18,18 @@ namespace WilloRHI
         };
 
         vkBeginCommandBuffer(_vkCommandBuffer, &beginInfo);
+        _descriptorBuffersBound = false;
+        _usedBuffers.clear();
+        _usedImages.clear();
+
+        // opportunistic, Queue::Submit guarantees everything created before it is written
+        _device.impl->FlushDescriptorWrites(false);
     }
 
     void CommandList::End() { impl->End(); }
     void ImplCommandList::End()
     {
         FlushBarriers();
-        _device.UnlockResources_Shared();
         vkEndCommandBuffer(_vkCommandBuffer);
     }
 
@@ -135,59 +139,234 @@ namespace WilloRHI
         impl->ImageMemoryBarrier(image, barrierInfo); }
     void ImplCommandList::ImageMemoryBarrier(ImageId image, const ImageMemoryBarrierInfo& barrierInfo)
     {
+        ImageResource& imageResource = _resources->images.At(image);
+
         VkImageSubresourceRange resourceRange = {
-            .aspectMask = _resources->images.At(image).aspect,
+            .aspectMask = imageResource.aspect,
             .baseMipLevel = barrierInfo.subresourceRange.baseLevel,
             .levelCount = barrierInfo.subresourceRange.numLevels,
             .baseArrayLayer = barrierInfo.subresourceRange.baseLayer,
             .layerCount = barrierInfo.subresourceRange.numLayers
         };
 
-        ImageResource& imageResource = _resources->images.At(image);
-        VkImage vkImage = imageResource.image;
+        PushImageBarrier(imageResource, resourceRange,
+            static_cast<VkPipelineStageFlags2>(barrierInfo.dstStage),
+            static_cast<VkAccessFlags2>(barrierInfo.dstAccess),
+            static_cast<VkImageLayout>(barrierInfo.dstLayout));
+    }
+
+    void CommandList::BufferMemoryBarrier(BufferId buffer, const BufferMemoryBarrierInfo& barrierInfo) {
+        impl->BufferMemoryBarrier(buffer, barrierInfo); }
+    void ImplCommandList::BufferMemoryBarrier(BufferId buffer, const BufferMemoryBarrierInfo& barrierInfo)
+    {
+        PushBufferBarrier(_resources->buffers.At(buffer),
+            static_cast<VkPipelineStageFlags2>(barrierInfo.dstStage),
+            static_cast<VkAccessFlags2>(barrierInfo.dstAccess));
+    }
 
+    void ImplCommandList::PushBufferBarrier(BufferResource& resource, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+    {
+        VkBufferMemoryBarrier2 bufferBarrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+            .pNext = nullptr,
+            .srcStageMask = resource.currentPipelineStage,
+            .srcAccessMask = resource.currentAccessFlags,
+            .dstStageMask = dstStage,
+            .dstAccessMask = dstAccess,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = resource.buffer,
+            .offset = resource.offset,
+            .size = resource.size
+        };
+
+        if (resource.ownerQueueFamily != VK_QUEUE_FAMILY_IGNORED && resource.ownerQueueFamily != _queueFamily) {
+            bufferBarrier.srcQueueFamilyIndex = resource.ownerQueueFamily;
+            bufferBarrier.dstQueueFamilyIndex = _queueFamily;
+
+            // the source queue makes its writes available, this one only makes them visible
+            VkBufferMemoryBarrier2 release = bufferBarrier;
+            release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+            release.dstAccessMask = VK_ACCESS_2_NONE;
+            // another process releases what it shares on its own side
+            if (resource.ownerQueueFamily != VK_QUEUE_FAMILY_EXTERNAL)
+                _bufferReleases.push_back(std::pair(&resource, release));
+
+            bufferBarrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+            bufferBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+        }
+
+        if (!resource.concurrent)
+            MarkUsed(resource);
+        resource.currentPipelineStage = dstStage;
+        resource.currentAccessFlags = dstAccess;
+
+        _bufferBarriers.push_back(bufferBarrier);
+    }
+
+    void ImplCommandList::PushImageBarrier(ImageResource& resource, const VkImageSubresourceRange& range,
+        VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess, VkImageLayout dstLayout)
+    {
         VkImageMemoryBarrier2 imageBarrier = {
             .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
             .pNext = nullptr,
-            .srcStageMask = static_cast<VkPipelineStageFlags2>(imageResource.currentPipelineStage),
-            .srcAccessMask = static_cast<VkAccessFlags2>(imageResource.currentAccessFlags),
-            .dstStageMask = static_cast<VkPipelineStageFlags2>(barrierInfo.dstStage),
-            .dstAccessMask = static_cast<VkAccessFlags2>(barrierInfo.dstAccess),
-            .oldLayout = static_cast<VkImageLayout>(imageResource.currentLayout),
-            .newLayout = static_cast<VkImageLayout>(barrierInfo.dstLayout),
-            .image = vkImage,
-            .subresourceRange = resourceRange
+            .srcStageMask = resource.currentPipelineStage,
+            .srcAccessMask = resource.currentAccessFlags,
+            .dstStageMask = dstStage,
+            .dstAccessMask = dstAccess,
+            .oldLayout = resource.currentLayout,
+            .newLayout = dstLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = resource.image,
+            .subresourceRange = range
         };
 
-        imageResource.currentLayout = static_cast<VkImageLayout>(barrierInfo.dstLayout);
-        imageResource.currentAccessFlags = static_cast<VkAccessFlags2>(barrierInfo.dstAccess);
-        imageResource.currentPipelineStage = static_cast<VkPipelineStageFlags2>(barrierInfo.dstStage);
-    
+        // both halves carry the same layouts, the transition itself only happens once
+        if (resource.ownerQueueFamily != VK_QUEUE_FAMILY_IGNORED && resource.ownerQueueFamily != _queueFamily) {
+            imageBarrier.srcQueueFamilyIndex = resource.ownerQueueFamily;
+            imageBarrier.dstQueueFamilyIndex = _queueFamily;
+
+            VkImageMemoryBarrier2 release = imageBarrier;
+            release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+            release.dstAccessMask = VK_ACCESS_2_NONE;
+            if (resource.ownerQueueFamily != VK_QUEUE_FAMILY_EXTERNAL)
+                _imageReleases.push_back(std::pair(&resource, release));
+
+            imageBarrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+            imageBarrier.srcAccessMask = VK_ACCESS_2_NONE;
+        }
+
+        MarkUsed(resource);
+        resource.currentLayout = dstLayout;
+        resource.currentAccessFlags = dstAccess;
+        resource.currentPipelineStage = dstStage;
+
         _imageBarriers.push_back(imageBarrier);
     }
 
-    void CommandList::BufferMemoryBarrier(BufferId buffer, const BufferMemoryBarrierInfo& barrierInfo) {
-        impl->BufferMemoryBarrier(buffer, barrierInfo); }
-    void ImplCommandList::BufferMemoryBarrier(BufferId buffer, const BufferMemoryBarrierInfo& barrierInfo)
+    void CommandList::ReleaseBufferToExternal(BufferId buffer) { impl->ReleaseBufferToExternal(buffer); }
+    void ImplCommandList::ReleaseBufferToExternal(BufferId buffer)
     {
-        BufferResource& bufferResource = _resources->buffers.At(buffer);
+        BufferResource& resource = _resources->buffers.At(buffer);
 
-        VkBufferMemoryBarrier2 bufferBarrier = {
+        // a queue of another family in this process has to hand it over first, in a barrier batch of its own
+        AcquireBuffer(resource, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+        FlushBarriers();
+
+        _bufferBarriers.push_back({
             .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
             .pNext = nullptr,
-            .srcStageMask = bufferResource.currentPipelineStage,
-            .srcAccessMask = bufferResource.currentAccessFlags,
-            .dstStageMask = static_cast<VkPipelineStageFlags2>(barrierInfo.dstStage),
-            .dstAccessMask = static_cast<VkAccessFlags2>(barrierInfo.dstAccess),
-            .buffer = bufferResource.buffer,
-            .offset = 0,
-            .size = bufferResource.createInfo.size
-        };
+            .srcStageMask = resource.currentPipelineStage,
+            .srcAccessMask = resource.currentAccessFlags,
+            .dstStageMask = VK_PIPELINE_STAGE_2_NONE,
+            .dstAccessMask = VK_ACCESS_2_NONE,
+            .srcQueueFamilyIndex = _queueFamily,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL,
+            .buffer = resource.buffer,
+            .offset = resource.offset,
+            .size = resource.size
+        });
+
+        // the next use acquires it back
+        resource.ownerQueueFamily = VK_QUEUE_FAMILY_EXTERNAL;
+        resource.currentPipelineStage = VK_PIPELINE_STAGE_2_NONE;
+        resource.currentAccessFlags = VK_ACCESS_2_NONE;
+    }
+
+    void CommandList::ReleaseImageToExternal(ImageId image, ImageLayout layout) { impl->ReleaseImageToExternal(image, layout); }
+    void ImplCommandList::ReleaseImageToExternal(ImageId image, ImageLayout layout)
+    {
+        ImageResource& resource = _resources->images.At(image);
 
-        bufferResource.currentPipelineStage = static_cast<VkPipelineStageFlags2>(barrierInfo.dstStage);
-        bufferResource.currentAccessFlags = static_cast<VkAccessFlags2>(barrierInfo.dstAccess);
+        AcquireImage(resource, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE);
+        FlushBarriers();
 
-        _bufferBarriers.push_back(bufferBarrier);
+        _imageBarriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .pNext = nullptr,
+            .srcStageMask = resource.currentPipelineStage,
+            .srcAccessMask = resource.currentAccessFlags,
+            .dstStageMask = VK_PIPELINE_STAGE_2_NONE,
+            .dstAccessMask = VK_ACCESS_2_NONE,
+            .oldLayout = resource.currentLayout,
+            .newLayout = static_cast<VkImageLayout>(layout),
+            .srcQueueFamilyIndex = _queueFamily,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL,
+            .image = resource.image,
+            .subresourceRange = {
+                .aspectMask = resource.aspect,
+                .baseMipLevel = 0,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .baseArrayLayer = 0,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS
+            }
+        });
+
+        // acquiring it back expects the other process to release it in the same layout
+        resource.ownerQueueFamily = VK_QUEUE_FAMILY_EXTERNAL;
+        resource.currentLayout = static_cast<VkImageLayout>(layout);
+        resource.currentPipelineStage = VK_PIPELINE_STAGE_2_NONE;
+        resource.currentAccessFlags = VK_ACCESS_2_NONE;
+    }
+
+    void ImplCommandList::AcquireBuffer(BufferResource& resource, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+    {
+        if (resource.ownerQueueFamily != VK_QUEUE_FAMILY_IGNORED && resource.ownerQueueFamily != _queueFamily) {
+            PushBufferBarrier(resource, dstStage, dstAccess);
+            return;
+        }
+
+        if (!resource.concurrent)
+            MarkUsed(resource);
+    }
+
+    void ImplCommandList::AcquireImage(ImageResource& resource, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+    {
+        if (resource.ownerQueueFamily != VK_QUEUE_FAMILY_IGNORED && resource.ownerQueueFamily != _queueFamily) {
+            VkImageSubresourceRange wholeImage = {
+                .aspectMask = resource.aspect,
+                .baseMipLevel = 0,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .baseArrayLayer = 0,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS
+            };
+            PushImageBarrier(resource, wholeImage, dstStage, dstAccess, resource.currentLayout);
+            return;
+        }
+
+        MarkUsed(resource);
+    }
+
+    void ImplCommandList::ClaimBuffer(BufferResource& resource, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+    {
+        if (resource.concurrent)
+            return;
+
+        if (resource.ownerQueueFamily == VK_QUEUE_FAMILY_IGNORED || resource.ownerQueueFamily == _queueFamily) {
+            MarkUsed(resource);
+            return;
+        }
+
+        // no barrier can go inside rendering, the acquire runs in its own command buffer ahead of this list instead
+        PushBufferBarrier(resource, dstStage, dstAccess);
+        _preAcquireBarriers.push_back(_bufferBarriers.back());
+        _bufferBarriers.pop_back();
+    }
+
+    void ImplCommandList::MarkUsed(BufferResource& resource)
+    {
+        resource.ownerQueueFamily = _queueFamily;
+        // commands on the same buffer tend to come in runs
+        if (_usedBuffers.empty() || _usedBuffers.back() != &resource)
+            _usedBuffers.push_back(&resource);
+    }
+
+    void ImplCommandList::MarkUsed(ImageResource& resource)
+    {
+        resource.ownerQueueFamily = _queueFamily;
+        if (_usedImages.empty() || _usedImages.back() != &resource)
+            _usedImages.push_back(&resource);
     }
 
     void CommandList::FlushBarriers() { impl->FlushBarriers(); }
@@ -223,14 +402,7 @@ namespace WilloRHI
         _currentPipeline = VK_PIPELINE_BIND_POINT_COMPUTE;
         _currentPipelineLayout = static_cast<VkPipelineLayout>(pipeline.GetPipelineLayout());
         _currentStageFlags = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-        vkCmdBindDescriptorSets(
-            _vkCommandBuffer,
-            VK_PIPELINE_BIND_POINT_COMPUTE,
-            static_cast<VkPipelineLayout>(pipeline.GetPipelineLayout()),
-            0, 1,
-            &static_cast<GlobalDescriptors*>(_device.GetResourceDescriptors())->descriptorSet,
-            0, nullptr
-        );
+        BindGlobalDescriptors(VK_PIPELINE_BIND_POINT_COMPUTE, static_cast<VkPipelineLayout>(pipeline.GetPipelineLayout()));
         vkCmdBindPipeline(_vkCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, static_cast<VkPipeline>(pipeline.GetPipelineHandle()));
     }
 
@@ -241,30 +413,53 @@ namespace WilloRHI
         _currentPipeline = VK_PIPELINE_BIND_POINT_GRAPHICS;
         _currentPipelineLayout = static_cast<VkPipelineLayout>(pipeline.GetPipelineLayout());
         _currentStageFlags = static_cast<VkPipelineStageFlags>(pipeline.GetStageFlags());
-        vkCmdBindDescriptorSets(
-            _vkCommandBuffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            static_cast<VkPipelineLayout>(pipeline.GetPipelineLayout()),
-            0, 1,
-            &static_cast<GlobalDescriptors*>(_device.GetResourceDescriptors())->descriptorSet,
-            0, nullptr
-        );
+        BindGlobalDescriptors(VK_PIPELINE_BIND_POINT_GRAPHICS, static_cast<VkPipelineLayout>(pipeline.GetPipelineLayout()));
         vkCmdBindPipeline(_vkCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, static_cast<VkPipeline>(pipeline.GetPipelineHandle()));
     }
 
+    void ImplCommandList::BindGlobalDescriptors(VkPipelineBindPoint bindPoint, VkPipelineLayout layout)
+    {
+        GlobalDescriptors* descriptors = static_cast<GlobalDescriptors*>(_device.GetResourceDescriptors());
+
+        if (descriptors->useDescriptorBuffer) {
+            // descriptor buffer bindings are command buffer state, bound on the first pipeline so lists on
+            // transfer-only queues, which may not bind them, never do
+            if (!_descriptorBuffersBound) {
+                VkDescriptorBufferBindingInfoEXT bindingInfo = {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT,
+                    .pNext = nullptr,
+                    .address = descriptors->descriptorBufferAddress,
+                    .usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT
+                };
+                descriptors->pfnCmdBindDescriptorBuffers(_vkCommandBuffer, 1, &bindingInfo);
+                _descriptorBuffersBound = true;
+            }
+
+            constexpr uint32_t bufferIndex = 0;
+            constexpr VkDeviceSize offset = 0;
+            descriptors->pfnCmdSetDescriptorBufferOffsets(_vkCommandBuffer, bindPoint, layout, 0, 1, &bufferIndex, &offset);
+            return;
+        }
+
+        vkCmdBindDescriptorSets(_vkCommandBuffer, bindPoint, layout, 0, 1, &descriptors->descriptorSet, 0, nullptr);
+    }
+
     void CommandList::BindVertexBuffer(BufferId buffer, uint32_t binding) {
         impl->BindVertexBuffer(buffer, binding); }
     void ImplCommandList::BindVertexBuffer(BufferId buffer, uint32_t binding)
     {
-        constexpr VkDeviceSize offset = 0;
-        vkCmdBindVertexBuffers(_vkCommandBuffer, binding, 1, &_resources->buffers.At(buffer).buffer, &offset);
+        BufferResource& bufferResource = _resources->buffers.At(buffer);
+        ClaimBuffer(bufferResource, VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT);
+        vkCmdBindVertexBuffers(_vkCommandBuffer, binding, 1, &bufferResource.buffer, &bufferResource.offset);
     }
 
     void CommandList::BindIndexBuffer(BufferId buffer, uint64_t bufferOffset, IndexType indexType) {
         impl->BindIndexBuffer(buffer, bufferOffset, indexType); }
     void ImplCommandList::BindIndexBuffer(BufferId buffer, uint64_t bufferOffset, IndexType indexType)
     {
-        vkCmdBindIndexBuffer(_vkCommandBuffer, _resources->buffers.At(buffer).buffer, bufferOffset, static_cast<VkIndexType>(indexType));
+        BufferResource& bufferResource = _resources->buffers.At(buffer);
+        ClaimBuffer(bufferResource, VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT);
+        vkCmdBindIndexBuffer(_vkCommandBuffer, bufferResource.buffer, bufferResource.offset + bufferOffset, static_cast<VkIndexType>(indexType));
     }
 
     void CommandList::SetViewport(Viewport viewport) {
@@ -320,6 +515,7 @@ namespace WilloRHI
         impl->ClearImage(image, clearColour, subresourceRange); }
     void ImplCommandList::ClearImage(ImageId image, ClearColour clearColour, const ImageSubresourceRange& subresourceRange)
     {
+        AcquireImage(_resources->images.At(image), VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
         FlushBarriers();
         VkClearColorValue vkClear = { {clearColour.r, clearColour.g, clearColour.b, clearColour.a} };
 
@@ -346,14 +542,20 @@ namespace WilloRHI
         impl->DrawIndirect(argBuffer, offset, drawCount); }
     void ImplCommandList::DrawIndirect(BufferId argBuffer, uint64_t offset, uint32_t drawCount)
     {
-        vkCmdDrawIndirect(_vkCommandBuffer, _resources->buffers.At(argBuffer).buffer, offset, drawCount, sizeof(DrawIndirectCommand));
+        BufferResource& argResource = _resources->buffers.At(argBuffer);
+        ClaimBuffer(argResource, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        vkCmdDrawIndirect(_vkCommandBuffer, argResource.buffer, argResource.offset + offset, drawCount, sizeof(DrawIndirectCommand));
     }
 
     void CommandList::DrawIndirectCount(BufferId argBuffer, uint64_t offset, BufferId countBuffer, uint64_t countBufferOffset, uint32_t maxDrawCount) {
         impl->DrawIndirectCount(argBuffer, offset, countBuffer, countBufferOffset, maxDrawCount); }
     void ImplCommandList::DrawIndirectCount(BufferId argBuffer, uint64_t offset, BufferId countBuffer, uint64_t countBufferOffset, uint32_t maxDrawCount)
     {
-        vkCmdDrawIndirectCount(_vkCommandBuffer, _resources->buffers.At(argBuffer).buffer, offset, _resources->buffers.At(countBuffer).buffer, countBufferOffset, maxDrawCount, sizeof(DrawIndirectCommand));
+        BufferResource& argResource = _resources->buffers.At(argBuffer);
+        BufferResource& countResource = _resources->buffers.At(countBuffer);
+        ClaimBuffer(argResource, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        ClaimBuffer(countResource, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        vkCmdDrawIndirectCount(_vkCommandBuffer, argResource.buffer, argResource.offset + offset, countResource.buffer, countResource.offset + countBufferOffset, maxDrawCount, sizeof(DrawIndirectCommand));
     }
 
     void CommandList::DrawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, uint32_t vertexOffset, uint32_t firstInstance) {
@@ -367,23 +569,31 @@ namespace WilloRHI
         impl->DrawIndexedIndirect(argBuffer, offset, drawCount); }
     void ImplCommandList::DrawIndexedIndirect(BufferId argBuffer, uint64_t offset, uint32_t drawCount)
     {
-        vkCmdDrawIndexedIndirect(_vkCommandBuffer, _resources->buffers.At(argBuffer).buffer, offset, drawCount, sizeof(DrawIndexedIndirectCommand));
+        BufferResource& argResource = _resources->buffers.At(argBuffer);
+        ClaimBuffer(argResource, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        vkCmdDrawIndexedIndirect(_vkCommandBuffer, argResource.buffer, argResource.offset + offset, drawCount, sizeof(DrawIndexedIndirectCommand));
     }
 
     void CommandList::DrawIndexedIndirectCount(BufferId argBuffer, uint64_t offset, BufferId countBuffer, uint64_t countBufferOffset, uint32_t maxDrawCount) {
         impl->DrawIndexedIndirectCount(argBuffer, offset, countBuffer, countBufferOffset, maxDrawCount); }
     void ImplCommandList::DrawIndexedIndirectCount(BufferId argBuffer, uint64_t offset, BufferId countBuffer, uint64_t countBufferOffset, uint32_t maxDrawCount)
     {
-        vkCmdDrawIndexedIndirectCount(_vkCommandBuffer, _resources->buffers.At(argBuffer).buffer, offset, _resources->buffers.At(countBuffer).buffer, countBufferOffset, maxDrawCount, sizeof(DrawIndexedIndirectCommand));
+        BufferResource& argResource = _resources->buffers.At(argBuffer);
+        BufferResource& countResource = _resources->buffers.At(countBuffer);
+        ClaimBuffer(argResource, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        ClaimBuffer(countResource, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+        vkCmdDrawIndexedIndirectCount(_vkCommandBuffer, argResource.buffer, argResource.offset + offset, countResource.buffer, countResource.offset + countBufferOffset, maxDrawCount, sizeof(DrawIndexedIndirectCommand));
     }
 
     void CommandList::CopyImage(ImageId srcImage, ImageId dstImage, uint32_t numRegions, ImageCopyRegion* regions) {
         impl->CopyImage(srcImage, dstImage, numRegions, regions); }
     void ImplCommandList::CopyImage(ImageId srcImage, ImageId dstImage, uint32_t numRegions, ImageCopyRegion* regions) 
     {
-        FlushBarriers();
         ImageResource& srcResource = _resources->images.At(srcImage);
         ImageResource& dstResource = _resources->images.At(dstImage);
+        AcquireImage(srcResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        AcquireImage(dstResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        FlushBarriers();
 
         // TODO: test performance std::vector.resize vs. alloc on heap
         //VkImageCopy* vkRegions = new VkImageCopy[numRegions];
@@ -420,9 +630,11 @@ namespace WilloRHI
         impl->BlitImage(srcImage, dstImage, filter); }
     void ImplCommandList::BlitImage(ImageId srcImage, ImageId dstImage, Filter filter)
     {
-        FlushBarriers();
         ImageResource& srcResource = _resources->images.At(srcImage);
         ImageResource& dstResource = _resources->images.At(dstImage);
+        AcquireImage(srcResource, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        AcquireImage(dstResource, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        FlushBarriers();
 
         VkImageBlit2 blitRegion = {
             .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2,
@@ -440,11 +652,13 @@ namespace WilloRHI
                 .layerCount = 1
             }
         };
-        blitRegion.srcOffsets[1].x = srcResource.createInfo.size.width;
-        blitRegion.srcOffsets[1].y = srcResource.createInfo.size.height;
+        const Extent3D& srcSize = _resources->images.Metadata(srcImage).createInfo.size;
+        const Extent3D& dstSize = _resources->images.Metadata(dstImage).createInfo.size;
+        blitRegion.srcOffsets[1].x = srcSize.width;
+        blitRegion.srcOffsets[1].y = srcSize.height;
         blitRegion.srcOffsets[1].z = 1;
-        blitRegion.dstOffsets[1].x = dstResource.createInfo.size.width;
-        blitRegion.dstOffsets[1].y = dstResource.createInfo.size.height;
+        blitRegion.dstOffsets[1].x = dstSize.width;
+        blitRegion.dstOffsets[1].y = dstSize.height;
         blitRegion.dstOffsets[1].z = 1;
 
         VkBlitImageInfo2 blitInfo = {
@@ -466,25 +680,27 @@ namespace WilloRHI
         impl->CopyBufferToImage(srcBuffer, dstImage, numRegions, regions); }
     void ImplCommandList::CopyBufferToImage(BufferId srcBuffer, ImageId dstImage, uint32_t numRegions, BufferImageCopyRegion* regions) 
     {
-        FlushBarriers();
         BufferResource& srcResource = _resources->buffers.At(srcBuffer);
         ImageResource& dstResource = _resources->images.At(dstImage);
+        AcquireBuffer(srcResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        AcquireImage(dstResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        FlushBarriers();
 
         std::vector<VkBufferImageCopy> vkRegions;
         vkRegions.resize(numRegions);
 
         for (uint32_t i = 0; i < numRegions; i++) {
             vkRegions[i] = {
-                .bufferOffset = regions[i].bufferOffset,
+                .bufferOffset = srcResource.offset + regions[i].bufferOffset,
                 .bufferRowLength = regions[i].rowLength,
                 .bufferImageHeight = regions[i].imageHeight,
                 .imageSubresource = {
                     .aspectMask = dstResource.aspect,
-                    .mipLevel = regions[i].dstSubresource.level,
-                    .baseArrayLayer = regions[i].dstSubresource.baseLayer,
-                    .layerCount = regions[i].dstSubresource.numLayers
+                    .mipLevel = regions[i].imageSubresource.level,
+                    .baseArrayLayer = regions[i].imageSubresource.baseLayer,
+                    .layerCount = regions[i].imageSubresource.numLayers
                 },
-                .imageOffset = {regions[i].dstOffset.x, regions[i].dstOffset.y, regions[i].dstOffset.z},
+                .imageOffset = {regions[i].imageOffset.x, regions[i].imageOffset.y, regions[i].imageOffset.z},
                 .imageExtent = {regions[i].extent.width, regions[i].extent.height, regions[i].extent.depth}
             };
         }
@@ -494,24 +710,62 @@ namespace WilloRHI
             numRegions, vkRegions.data());
     }
 
+    void CommandList::CopyImageToBuffer(ImageId srcImage, BufferId dstBuffer, uint32_t numRegions, BufferImageCopyRegion* regions) {
+        impl->CopyImageToBuffer(srcImage, dstBuffer, numRegions, regions); }
+    void ImplCommandList::CopyImageToBuffer(ImageId srcImage, BufferId dstBuffer, uint32_t numRegions, BufferImageCopyRegion* regions)
+    {
+        ImageResource& srcResource = _resources->images.At(srcImage);
+        BufferResource& dstResource = _resources->buffers.At(dstBuffer);
+        AcquireImage(srcResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        AcquireBuffer(dstResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        FlushBarriers();
+
+        std::vector<VkBufferImageCopy> vkRegions;
+        vkRegions.resize(numRegions);
+
+        for (uint32_t i = 0; i < numRegions; i++) {
+            vkRegions[i] = {
+                .bufferOffset = dstResource.offset + regions[i].bufferOffset,
+                .bufferRowLength = regions[i].rowLength,
+                .bufferImageHeight = regions[i].imageHeight,
+                .imageSubresource = {
+                    .aspectMask = srcResource.aspect,
+                    .mipLevel = regions[i].imageSubresource.level,
+                    .baseArrayLayer = regions[i].imageSubresource.baseLayer,
+                    .layerCount = regions[i].imageSubresource.numLayers
+                },
+                .imageOffset = {regions[i].imageOffset.x, regions[i].imageOffset.y, regions[i].imageOffset.z},
+                .imageExtent = {regions[i].extent.width, regions[i].extent.height, regions[i].extent.depth}
+            };
+        }
+
+        vkCmdCopyImageToBuffer(_vkCommandBuffer,
+            srcResource.image, srcResource.currentLayout, dstResource.buffer,
+            numRegions, vkRegions.data());
+    }
+
     void CommandList::CopyBuffer(BufferId srcBuffer, BufferId dstBuffer, uint32_t numRegions, BufferCopyRegion* regions) {
         impl->CopyBuffer(srcBuffer, dstBuffer, numRegions, regions); }
     void ImplCommandList::CopyBuffer(BufferId srcBuffer, BufferId dstBuffer, uint32_t numRegions, BufferCopyRegion* regions)
     {
-        FlushBarriers();
         BufferResource& srcResource = _resources->buffers.At(srcBuffer);
         BufferResource& dstResource = _resources->buffers.At(dstBuffer);
+        AcquireBuffer(srcResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        AcquireBuffer(dstResource, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        FlushBarriers();
 
         std::vector<VkBufferCopy> vkRegions;
         vkRegions.resize(numRegions);
 
         for (uint32_t i = 0; i < numRegions; i++) {
             vkRegions[i] = {
-                .srcOffset = regions[i].srcOffset,
-                .dstOffset = regions[i].dstOffset,
+                .srcOffset = srcResource.offset + regions[i].srcOffset,
+                .dstOffset = dstResource.offset + regions[i].dstOffset,
                 .size = regions[i].size
             };
         }
+
+        vkCmdCopyBuffer(_vkCommandBuffer, srcResource.buffer, dstResource.buffer, numRegions, vkRegions.data());
     }
 
     void CommandList::DestroyBuffer(BufferId buffer) { impl->DestroyBuffer(buffer); }
@@ -549,10 +803,11 @@ namespace WilloRHI
         return &_deletionQueues;
     }
 
-    CommandList::CommandList(Device device, std::thread::id threadId, void* nativeHandle) {
+    CommandList::CommandList(Device device, std::thread::id threadId, void* nativeHandle, uint32_t queueFamily) {
         impl = std::make_shared<ImplCommandList>();
         impl->_device = device;
         impl->_threadId = threadId;
+        impl->_queueFamily = queueFamily;
         impl->_vkCommandBuffer = (VkCommandBuffer)nativeHandle;
         impl->Init();
     }
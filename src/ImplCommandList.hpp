@@ -16,6 +16,7 @@ namespace WilloRHI
 
         VkCommandBuffer _vkCommandBuffer = VK_NULL_HANDLE;
         std::thread::id _threadId;
+        uint32_t _queueFamily = 0;
 
         DeletionQueues _deletionQueues;
         DeviceResources* _resources = nullptr;
@@ -23,11 +24,23 @@ namespace WilloRHI
         VkPipelineBindPoint _currentPipeline = {};
         VkPipelineLayout _currentPipelineLayout = VK_NULL_HANDLE;
         VkPipelineStageFlags _currentStageFlags = VK_PIPELINE_STAGE_FLAG_BITS_MAX_ENUM;
+        bool _descriptorBuffersBound = false;
 
         std::vector<VkMemoryBarrier2> _globalBarriers;
         std::vector<VkBufferMemoryBarrier2> _bufferBarriers;
         std::vector<VkImageMemoryBarrier2> _imageBarriers;
 
+        // release halves of ownership transfers into this list's queue family
+        // submitted on the queue that last used each resource ahead of this list, see ImplQueue::Submit
+        std::vector<std::pair<BufferResource*, VkBufferMemoryBarrier2>> _bufferReleases;
+        std::vector<std::pair<ImageResource*, VkImageMemoryBarrier2>> _imageReleases;
+        // acquire halves that couldn't be recorded into the list itself, run in a command buffer ahead of it
+        std::vector<VkBufferMemoryBarrier2> _preAcquireBarriers;
+
+        // exclusive resources this list used, their owner becomes the submitting queue
+        std::vector<BufferResource*> _usedBuffers;
+        std::vector<ImageResource*> _usedImages;
+
         void Init();
 
         void Begin();
@@ -45,9 +58,28 @@ namespace WilloRHI
 
         void FlushBarriers();
 
+        void ReleaseBufferToExternal(BufferId buffer);
+        void ReleaseImageToExternal(ImageId image, ImageLayout layout);
+
+        // queue a barrier, turning it into an ownership acquire if another queue family last used the resource
+        void PushBufferBarrier(BufferResource& resource, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+        void PushImageBarrier(ImageResource& resource, const VkImageSubresourceRange& range,
+            VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess, VkImageLayout dstLayout);
+
+        // commands that touch a resource without a user barrier, transfers ownership if needed
+        // only valid outside of rendering
+        void AcquireBuffer(BufferResource& resource, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+        void AcquireImage(ImageResource& resource, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+        // the same for commands recorded inside rendering, the acquire is deferred to Queue::Submit
+        void ClaimBuffer(BufferResource& resource, VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+
+        void MarkUsed(BufferResource& resource);
+        void MarkUsed(ImageResource& resource);
+
         // pipelines
         void BindComputePipeline(ComputePipeline pipeline);
         void BindGraphicsPipeline(GraphicsPipeline pipeline);
+        void BindGlobalDescriptors(VkPipelineBindPoint bindPoint, VkPipelineLayout layout);
 
         void BindVertexBuffer(BufferId buffer, uint32_t binding);
         void BindIndexBuffer(BufferId buffer, uint64_t bufferOffset, IndexType indexType);
@@ -73,6 +105,7 @@ namespace WilloRHI
         void CopyImage(ImageId srcImage, ImageId dstImage, uint32_t numRegions, ImageCopyRegion* regions);
         void BlitImage(ImageId srcImage, ImageId dstImage, Filter filter);
         void CopyBufferToImage(BufferId srcBuffer, ImageId dstImage, uint32_t numRegions, BufferImageCopyRegion* regions);
+        void CopyImageToBuffer(ImageId srcImage, BufferId dstBuffer, uint32_t numRegions, BufferImageCopyRegion* regions);
         void CopyBuffer(BufferId srcBuffer, BufferId dstBuffer, uint32_t numRegions, BufferCopyRegion* regions);
 
         void DestroyBuffer(BufferId buffer);
@@ -0,0 +1,117 @@
+#include "ImplDescriptors.hpp"
+
+#include "WilloRHI/WilloRHI_Shared.h"
+
+#include <algorithm>
+
+namespace WilloRHI
+{
+    static bool IsWriteLive(const DescriptorWrite& write, const DeviceResources& resources)
+    {
+        switch (write.binding)
+        {
+            case WilloRHI_STORAGE_BUFFER_BINDING:
+                return resources.buffers.IsValid(write.id);
+            case WilloRHI_STORAGE_IMAGE_BINDING:
+            case WilloRHI_SAMPLED_IMAGE_BINDING:
+                return resources.imageViews.IsValid(write.id);
+            case WilloRHI_SAMPLER_BINDING:
+                return resources.samplers.IsValid(write.id);
+            default:
+                return true;
+        }
+    }
+
+    void DescriptorWriteQueue::Push(const DescriptorWrite& write)
+    {
+        DescriptorWrite stamped = write;
+        stamped.sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+        pending.enqueue(stamped);
+    }
+
+    bool DescriptorWriteQueue::Flush(VkDevice device, VkDescriptorSet descriptorSet, const DeviceResources& resources, bool wait)
+    {
+        std::unique_lock<std::mutex> lock(flushMutex, std::defer_lock);
+        if (wait)
+            lock.lock();
+        else if (!lock.try_lock())
+            return false;
+
+        writes.clear();
+
+        DescriptorWrite dequeued[64];
+        size_t count = 0;
+        while ((count = pending.try_dequeue_bulk(dequeued, 64)) != 0)
+            writes.insert(writes.end(), dequeued, dequeued + count);
+
+        if (writes.empty())
+            return true;
+
+        // writes whose slot has been recycled go first, so they can't shadow the live write that replaced them
+        std::erase_if(writes, [&](const DescriptorWrite& write) { return !IsWriteLive(write, resources); });
+
+        // the queue doesn't order across producers, the sequence stamp decides which write to an element is newest
+        std::sort(writes.begin(), writes.end(), [](const DescriptorWrite& a, const DescriptorWrite& b) {
+            if (a.binding != b.binding)
+                return a.binding < b.binding;
+            if (ResourceIndex(a.id) != ResourceIndex(b.id))
+                return ResourceIndex(a.id) < ResourceIndex(b.id);
+            return a.sequence < b.sequence;
+        });
+
+        // keep only the newest write to each element
+        size_t liveCount = 0;
+        for (size_t i = 0; i < writes.size(); i++) {
+            bool overwritten = i + 1 < writes.size()
+                && writes[i + 1].binding == writes[i].binding
+                && ResourceIndex(writes[i + 1].id) == ResourceIndex(writes[i].id);
+
+            if (!overwritten)
+                writes[liveCount++] = writes[i];
+        }
+        writes.resize(liveCount);
+
+        vkWrites.clear();
+        imageInfos.clear();
+        bufferInfos.clear();
+        // reserved up front, the coalesced writes point into these
+        imageInfos.reserve(writes.size());
+        bufferInfos.reserve(writes.size());
+
+        for (const DescriptorWrite& write : writes) {
+            uint32_t index = ResourceIndex(write.id);
+            bool isBuffer = write.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+            bool extendsPrevious = !vkWrites.empty()
+                && vkWrites.back().dstBinding == write.binding
+                && vkWrites.back().dstArrayElement + vkWrites.back().descriptorCount == index;
+
+            if (extendsPrevious) {
+                vkWrites.back().descriptorCount += 1;
+            } else {
+                vkWrites.push_back({
+                    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                    .pNext = nullptr,
+                    .dstSet = descriptorSet,
+                    .dstBinding = write.binding,
+                    .dstArrayElement = index,
+                    .descriptorCount = 1,
+                    .descriptorType = write.type,
+                    .pImageInfo = isBuffer ? nullptr : imageInfos.data() + imageInfos.size(),
+                    .pBufferInfo = isBuffer ? bufferInfos.data() + bufferInfos.size() : nullptr,
+                    .pTexelBufferView = nullptr
+                });
+            }
+
+            if (isBuffer)
+                bufferInfos.push_back(write.bufferInfo);
+            else
+                imageInfos.push_back(write.imageInfo);
+        }
+
+        if (!vkWrites.empty())
+            vkUpdateDescriptorSets(device, (uint32_t)vkWrites.size(), vkWrites.data(), 0, nullptr);
+
+        return true;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ImplResources.hpp"
+
+#include <vulkan/vulkan.h>
+#include <concurrentqueue.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace WilloRHI
+{
+    // a single pending write into the global descriptor set
+    // the full id is kept so writes for a slot that has since been recycled can be dropped
+    struct DescriptorWrite {
+        uint32_t binding = 0;
+        uint32_t id = INVALID_RESOURCE_ID;
+        VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+        VkDescriptorImageInfo imageInfo = {};
+        VkDescriptorBufferInfo bufferInfo = {};
+        // stamped by Push, orders writes to the same element across producer threads
+        uint64_t sequence = 0;
+    };
+
+    // resource creation pushes writes from any thread, only one thread flushes at a time
+    // a flush coalesces everything pending into contiguous array ranges and issues one vkUpdateDescriptorSets
+    struct DescriptorWriteQueue {
+        moodycamel::ConcurrentQueue<DescriptorWrite> pending;
+        std::atomic<uint64_t> nextSequence = 0;
+        std::mutex flushMutex;
+
+        // scratch storage reused between flushes, only touched with flushMutex held
+        std::vector<DescriptorWrite> writes;
+        std::vector<VkWriteDescriptorSet> vkWrites;
+        std::vector<VkDescriptorImageInfo> imageInfos;
+        std::vector<VkDescriptorBufferInfo> bufferInfos;
+
+        void Push(const DescriptorWrite& write);
+
+        // returns false without flushing if another thread is already flushing and wait is false
+        bool Flush(VkDevice device, VkDescriptorSet descriptorSet, const DeviceResources& resources, bool wait);
+    };
+}
@@ -1,4 +1,5 @@
 #include "ImplDevice.hpp"
+#include "ImplQueue.hpp"
 
 #include "WilloRHI/WilloRHI_Shared.h"
 
@@ -7,6 +8,9 @@
 #include <VkBootstrap.h>
 #include <vulkan/vk_enum_string_helper.h>
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
 #include <functional>
 
 namespace WilloRHI
@@ -43,6 +47,8 @@ namespace WilloRHI
             .descriptorBindingSampledImageUpdateAfterBind = true,
             .descriptorBindingStorageImageUpdateAfterBind = true,
             .descriptorBindingStorageBufferUpdateAfterBind = true,
+            .descriptorBindingUpdateUnusedWhilePending = true,
+            .descriptorBindingPartiallyBound = true,
             .runtimeDescriptorArray = true,
             .timelineSemaphore = true,
             .bufferDeviceAddress = true,
@@ -57,7 +63,85 @@ namespace WilloRHI
             .select()
             .value();
 
+        // descriptor buffers replace the update-after-bind set for the bindless table when available
+        VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
+            .pNext = nullptr
+        };
+
+        bool useDescriptorBuffer = false;
+        if (createInfo.useDescriptorBuffer && physicalDevice.enable_extension_if_present(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+            VkPhysicalDeviceFeatures2 supportedFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &descriptorBufferFeatures
+            };
+            vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device, &supportedFeatures);
+
+            useDescriptorBuffer = descriptorBufferFeatures.descriptorBuffer;
+            descriptorBufferFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
+                .pNext = nullptr,
+                .descriptorBuffer = useDescriptorBuffer
+            };
+        }
+
+        // lets memory pools tell the driver what to keep resident under pressure
+        VkPhysicalDeviceMemoryPriorityFeaturesEXT memoryPriorityFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PRIORITY_FEATURES_EXT,
+            .pNext = nullptr
+        };
+
+        bool useMemoryPriority = false;
+        if (physicalDevice.enable_extension_if_present(VK_EXT_MEMORY_PRIORITY_EXTENSION_NAME)) {
+            VkPhysicalDeviceFeatures2 supportedFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &memoryPriorityFeatures
+            };
+            vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device, &supportedFeatures);
+
+            useMemoryPriority = memoryPriorityFeatures.memoryPriority;
+            memoryPriorityFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PRIORITY_FEATURES_EXT,
+                .pNext = nullptr,
+                .memoryPriority = useMemoryPriority
+            };
+        }
+
+        // buffers straight over host memory, like memory-mapped files, with no copy at all
+        bool useExternalMemoryHost = physicalDevice.enable_extension_if_present(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+        // memory and timelines shared with other processes as opaque fds
+        bool useExternalMemoryFd = physicalDevice.enable_extension_if_present(VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME);
+        physicalDevice.enable_extension_if_present(VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME);
+
+        // lets loader threads fill textures without command buffers or queue traffic
+        VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT,
+            .pNext = nullptr
+        };
+
+        bool useHostImageCopy = false;
+        if (physicalDevice.enable_extension_if_present(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME)) {
+            VkPhysicalDeviceFeatures2 supportedFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &hostImageCopyFeatures
+            };
+            vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device, &supportedFeatures);
+
+            useHostImageCopy = hostImageCopyFeatures.hostImageCopy;
+            hostImageCopyFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT,
+                .pNext = nullptr,
+                .hostImageCopy = useHostImageCopy
+            };
+        }
+
         vkb::DeviceBuilder deviceBuilder{physicalDevice};
+        if (useDescriptorBuffer)
+            deviceBuilder.add_pNext(&descriptorBufferFeatures);
+        if (useMemoryPriority)
+            deviceBuilder.add_pNext(&memoryPriorityFeatures);
+        if (useHostImageCopy)
+            deviceBuilder.add_pNext(&hostImageCopyFeatures);
         vkb::Device vkbDevice = deviceBuilder.build().value();
 
         _vkbDevice = vkbDevice;
@@ -69,13 +153,56 @@ namespace WilloRHI
         allocatorInfo.device = _vkDevice;
         allocatorInfo.instance = _vkInstance;
         allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+        if (useMemoryPriority)
+            allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_PRIORITY_BIT;
         
         vmaCreateAllocator(&allocatorInfo, &_allocator);
+        SelectUploadStrategy();
 
         _vkQueueIndices[0] = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
         _vkQueueIndices[1] = vkbDevice.get_queue_index(vkb::QueueType::compute).value();
         _vkQueueIndices[2] = vkbDevice.get_queue_index(vkb::QueueType::transfer).value();
 
+        for (uint32_t queueFamily : _vkQueueIndices) {
+            if (std::find(_sharedQueueFamilies.begin(), _sharedQueueFamilies.end(), queueFamily) == _sharedQueueFamilies.end())
+                _sharedQueueFamilies.push_back(queueFamily);
+        }
+
+        if (useDescriptorBuffer)
+            LoadDescriptorBufferFunctions();
+
+        if (useExternalMemoryHost) {
+            VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+                .pNext = nullptr
+            };
+
+            VkPhysicalDeviceProperties2 properties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                .pNext = &hostProperties
+            };
+            vkGetPhysicalDeviceProperties2(_vkPhysicalDevice, &properties);
+
+            _externalMemory.hostPointerAlignment = hostProperties.minImportedHostPointerAlignment;
+            _externalMemory.pfnGetMemoryHostPointerProperties = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+                vkGetDeviceProcAddr(_vkDevice, "vkGetMemoryHostPointerPropertiesEXT"));
+        }
+
+        if (useHostImageCopy)
+            LoadHostImageCopyFunctions();
+
+        if (useExternalMemoryFd)
+            _externalMemory.pfnGetMemoryFd = reinterpret_cast<PFN_vkGetMemoryFdKHR>(vkGetDeviceProcAddr(_vkDevice, "vkGetMemoryFdKHR"));
+
+        _addressTable.deviceLocal = createInfo.deviceLocalAddressTable;
+
+        VkPhysicalDeviceProperties deviceProperties = {};
+        vkGetPhysicalDeviceProperties(_vkPhysicalDevice, &deviceProperties);
+
+        // suballocated buffers are bound as storage buffers at their offset
+        _smallBuffers.threshold = createInfo.smallBufferThreshold;
+        _smallBuffers.blockSize = std::max(createInfo.smallBufferBlockSize, createInfo.smallBufferThreshold);
+        _smallBuffers.alignment = std::max<VkDeviceSize>(deviceProperties.limits.minStorageBufferOffsetAlignment, 16);
         SetupDescriptors(createInfo.resourceCounts);
 
         LogMessage("Initialised Device", false);
@@ -84,6 +211,63 @@ namespace WilloRHI
             LogMessage("Validation layers are enabled", false);
     }
 
+    void ImplDevice::LoadHostImageCopyFunctions()
+    {
+        // first call for the counts, second for the layouts themselves
+        VkPhysicalDeviceHostImageCopyPropertiesEXT copyProperties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT,
+            .pNext = nullptr
+        };
+
+        VkPhysicalDeviceProperties2 properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &copyProperties
+        };
+        vkGetPhysicalDeviceProperties2(_vkPhysicalDevice, &properties);
+
+        _hostImageCopy.srcLayouts.resize(copyProperties.copySrcLayoutCount);
+        _hostImageCopy.dstLayouts.resize(copyProperties.copyDstLayoutCount);
+        copyProperties.pCopySrcLayouts = _hostImageCopy.srcLayouts.data();
+        copyProperties.pCopyDstLayouts = _hostImageCopy.dstLayouts.data();
+        vkGetPhysicalDeviceProperties2(_vkPhysicalDevice, &properties);
+
+        if (std::find(_hostImageCopy.dstLayouts.begin(), _hostImageCopy.dstLayouts.end(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) != _hostImageCopy.dstLayouts.end())
+            _hostImageCopy.copyLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+        _hostImageCopy.pfnCopyMemoryToImage = reinterpret_cast<PFN_vkCopyMemoryToImageEXT>(
+            vkGetDeviceProcAddr(_vkDevice, "vkCopyMemoryToImageEXT"));
+        _hostImageCopy.pfnTransitionImageLayout = reinterpret_cast<PFN_vkTransitionImageLayoutEXT>(
+            vkGetDeviceProcAddr(_vkDevice, "vkTransitionImageLayoutEXT"));
+    }
+
+    void ImplDevice::LoadDescriptorBufferFunctions()
+    {
+        _globalDescriptors.descriptorBufferProperties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT,
+            .pNext = nullptr
+        };
+
+        VkPhysicalDeviceProperties2 properties = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &_globalDescriptors.descriptorBufferProperties
+        };
+        vkGetPhysicalDeviceProperties2(_vkPhysicalDevice, &properties);
+
+        _globalDescriptors.pfnGetDescriptorSetLayoutSize = reinterpret_cast<PFN_vkGetDescriptorSetLayoutSizeEXT>(
+            vkGetDeviceProcAddr(_vkDevice, "vkGetDescriptorSetLayoutSizeEXT"));
+        _globalDescriptors.pfnGetDescriptorSetLayoutBindingOffset = reinterpret_cast<PFN_vkGetDescriptorSetLayoutBindingOffsetEXT>(
+            vkGetDeviceProcAddr(_vkDevice, "vkGetDescriptorSetLayoutBindingOffsetEXT"));
+        _globalDescriptors.pfnGetDescriptor = reinterpret_cast<PFN_vkGetDescriptorEXT>(
+            vkGetDeviceProcAddr(_vkDevice, "vkGetDescriptorEXT"));
+        _globalDescriptors.pfnCmdBindDescriptorBuffers = reinterpret_cast<PFN_vkCmdBindDescriptorBuffersEXT>(
+            vkGetDeviceProcAddr(_vkDevice, "vkCmdBindDescriptorBuffersEXT"));
+        _globalDescriptors.pfnCmdSetDescriptorBufferOffsets = reinterpret_cast<PFN_vkCmdSetDescriptorBufferOffsetsEXT>(
+            vkGetDeviceProcAddr(_vkDevice, "vkCmdSetDescriptorBufferOffsetsEXT"));
+
+        _globalDescriptors.useDescriptorBuffer = true;
+        LogMessage("Using VK_EXT_descriptor_buffer for resource descriptors", false);
+    }
+
     Device Device::CreateDevice(const DeviceCreateInfo& createInfo)
     {
         Device newDevice;
@@ -98,10 +282,42 @@ namespace WilloRHI
 
     void ImplDevice::Cleanup()
     {
+        vkDeviceWaitIdle(_vkDevice);
+
+        {
+            std::lock_guard<std::mutex> lock(_defragmentation.mutex);
+            // the device is idle, so a pass still copying or retiring can finish on the spot
+            if (_defragmentation.copiesPending || _defragmentation.retiring) {
+                CommitDefragmentationMoves(true);
+                EndDefragmentationPass();
+            }
+            if (_defragmentation.context != VK_NULL_HANDLE)
+                EndDefragmentation();
+        }
+
+        ReleaseRetiredResources(true);
+
         vkDestroyDescriptorSetLayout(_vkDevice, _globalDescriptors.setLayout, nullptr);
         vkDestroyDescriptorPool(_vkDevice, _globalDescriptors.pool, nullptr);
+        vmaDestroyBuffer(_allocator, _globalDescriptors.descriptorBuffer, _globalDescriptors.descriptorBufferAllocation);
+
+        for (auto& pool : _smallBuffers.pools) {
+            for (std::unique_ptr<SmallBufferBlock>& block : pool.second.blocks)
+                DestroySmallBufferBlock(*block);
+        }
+        _smallBuffers.pools.clear();
+
+        for (MemoryPoolEntry& entry : _memoryPools) {
+            if (entry.pool != VK_NULL_HANDLE)
+                vmaDestroyPool(_allocator, entry.pool);
+        }
+        _memoryPools.clear();
 
-        vmaDestroyBuffer(_allocator, _addressBuffer.buffer, _addressBuffer.allocation);
+        vmaDestroyBuffer(_allocator, _addressBuffer.buffer, _addressBufferMetadata.allocation);
+        vmaDestroyBuffer(_allocator, _addressTable.stagingBuffer, _addressTable.stagingAllocation);
+        for (auto& pool : _addressTable.commandPools)
+            vkDestroyCommandPool(_vkDevice, pool.second, nullptr);
+        vkDestroySemaphore(_vkDevice, _addressTable.timeline, nullptr);
 
         vmaDestroyAllocator(_allocator);
         vkDestroyDevice(_vkDevice, nullptr);
@@ -111,12 +327,25 @@ namespace WilloRHI
         vkDestroyInstance(_vkInstance, nullptr);
     }
 
-    void ImplDevice::SetupDescriptors(const ResourceCountInfo& countInfo)
+    void ImplDevice::SetupDescriptors(const ResourceCountInfo& requestedCounts)
     {
-        _resources.buffers = ResourceMap<BufferResource>(countInfo.bufferCount);
-        _resources.images = ResourceMap<ImageResource>(countInfo.imageCount);
-        _resources.imageViews = ResourceMap<ImageViewResource>(countInfo.imageCount);
-        _resources.samplers = ResourceMap<SamplerResource>(countInfo.samplerCount);
+        // ids only have room for so many slots
+        ResourceCountInfo countInfo = {
+            .bufferCount = std::min(requestedCounts.bufferCount, MAX_RESOURCE_COUNT),
+            .imageCount = std::min(requestedCounts.imageCount, MAX_RESOURCE_COUNT),
+            .samplerCount = std::min(requestedCounts.samplerCount, MAX_RESOURCE_COUNT)
+        };
+
+        if (countInfo.bufferCount != requestedCounts.bufferCount ||
+            countInfo.imageCount != requestedCounts.imageCount ||
+            countInfo.samplerCount != requestedCounts.samplerCount) {
+            LogMessage("Requested resource counts exceed MAX_RESOURCE_COUNT, clamping to " + std::to_string(MAX_RESOURCE_COUNT));
+        }
+
+        _resources.buffers.Init(countInfo.bufferCount, "buffer", _loggingCallback);
+        _resources.images.Init(countInfo.imageCount, "image", _loggingCallback);
+        _resources.imageViews.Init(countInfo.imageCount, "image view", _loggingCallback);
+        _resources.samplers.Init(countInfo.samplerCount, "sampler", _loggingCallback);
 
         std::vector<VkDescriptorSetLayoutBinding> bindings = {
             VkDescriptorSetLayoutBinding {
@@ -156,46 +385,58 @@ namespace WilloRHI
             }
         };
 
-        std::vector<VkDescriptorPoolSize> poolSizes;
-        for (int i = 0; i < bindings.size(); i++) {
-            poolSizes.push_back(VkDescriptorPoolSize{
-                .type = bindings.at(i).descriptorType,
-                .descriptorCount = bindings.at(i).descriptorCount
-            });
+        if (_globalDescriptors.useDescriptorBuffer) {
+            CreateGlobalSetLayout(bindings, true);
+
+            VkDeviceSize layoutSize = 0;
+            _globalDescriptors.pfnGetDescriptorSetLayoutSize(_vkDevice, _globalDescriptors.setLayout, &layoutSize);
+
+            const VkPhysicalDeviceDescriptorBufferPropertiesEXT& props = _globalDescriptors.descriptorBufferProperties;
+            if (layoutSize > props.maxResourceDescriptorBufferRange || layoutSize > props.maxSamplerDescriptorBufferRange) {
+                LogMessage("Descriptor buffer of " + std::to_string(layoutSize) + " bytes exceeds device limits, falling back to descriptor set", false);
+                vkDestroyDescriptorSetLayout(_vkDevice, _globalDescriptors.setLayout, nullptr);
+                _globalDescriptors.useDescriptorBuffer = false;
+            } else if (!CreateDescriptorBuffer(layoutSize)) {
+                vkDestroyDescriptorSetLayout(_vkDevice, _globalDescriptors.setLayout, nullptr);
+                _globalDescriptors.useDescriptorBuffer = false;
+            }
         }
 
-        VkDescriptorPoolCreateInfo poolInfo = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-            .pNext = nullptr,
-            .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
-            .maxSets = 1,
-            .poolSizeCount = (uint32_t)poolSizes.size(),
-            .pPoolSizes = poolSizes.data()
-        };
+        if (!_globalDescriptors.useDescriptorBuffer) {
+            std::vector<VkDescriptorPoolSize> poolSizes;
+            for (int i = 0; i < bindings.size(); i++) {
+                poolSizes.push_back(VkDescriptorPoolSize{
+                    .type = bindings.at(i).descriptorType,
+                    .descriptorCount = bindings.at(i).descriptorCount
+                });
+            }
 
-        ErrorCheck(vkCreateDescriptorPool(_vkDevice, &poolInfo, nullptr, &_globalDescriptors.pool));
+            VkDescriptorPoolCreateInfo poolInfo = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+                .maxSets = 1,
+                .poolSizeCount = (uint32_t)poolSizes.size(),
+                .pPoolSizes = poolSizes.data()
+            };
 
-        VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-            .pNext = nullptr,
-            .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
-            .bindingCount = (uint32_t)bindings.size(),
-            .pBindings = bindings.data()
-        };
+            ErrorCheck(vkCreateDescriptorPool(_vkDevice, &poolInfo, nullptr, &_globalDescriptors.pool));
 
-        ErrorCheck(vkCreateDescriptorSetLayout(_vkDevice, &setLayoutInfo, nullptr, &_globalDescriptors.setLayout));
+            CreateGlobalSetLayout(bindings, false);
 
-        VkDescriptorSetAllocateInfo allocInfo = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .pNext = nullptr,
-            .descriptorPool = _globalDescriptors.pool,
-            .descriptorSetCount = 1,
-            .pSetLayouts = &_globalDescriptors.setLayout
-        };
+            VkDescriptorSetAllocateInfo allocInfo = {
+                .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                .pNext = nullptr,
+                .descriptorPool = _globalDescriptors.pool,
+                .descriptorSetCount = 1,
+                .pSetLayouts = &_globalDescriptors.setLayout
+            };
 
-        ErrorCheck(vkAllocateDescriptorSets(_vkDevice, &allocInfo, &_globalDescriptors.descriptorSet));
+            ErrorCheck(vkAllocateDescriptorSets(_vkDevice, &allocInfo, &_globalDescriptors.descriptorSet));
+        }
 
-        LogMessage("Allocated resource descriptor set with the following counts:\n - "
+        LogMessage(std::string(_globalDescriptors.useDescriptorBuffer ? "Allocated resource descriptor buffer" : "Allocated resource descriptor set")
+            + " with the following counts:\n - "
             + std::to_string(countInfo.bufferCount) + " Buffers\n - "
             + std::to_string(countInfo.imageCount) + " Images\n - "
             + std::to_string(countInfo.samplerCount) + " Samplers", false);
@@ -203,8 +444,10 @@ namespace WilloRHI
         // create the BDA address buffer
 
         _addressBuffer = {};
+        _addressBufferMetadata = {};
         
         VkBufferUsageFlags usageFlags = 
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
             VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
             VK_BUFFER_USAGE_TRANSFER_DST_BIT |
             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
@@ -215,15 +458,17 @@ namespace WilloRHI
             .flags = 0,
             .size = (sizeof(uint64_t) * countInfo.bufferCount),
             .usage = usageFlags,
-            .sharingMode = VK_SHARING_MODE_CONCURRENT,
-            .queueFamilyIndexCount = 3,
-            .pQueueFamilyIndices = _vkQueueIndices
+            .sharingMode = _sharedQueueFamilies.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = (uint32_t)_sharedQueueFamilies.size(),
+            .pQueueFamilyIndices = _sharedQueueFamilies.data()
         };
 
-        VmaAllocationCreateFlags allocFlags = 
-            VMA_ALLOCATION_CREATE_MAPPED_BIT | 
-            VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | 
-            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+        // device-local tables are written through a staging shadow instead of being mapped
+        VmaAllocationCreateFlags allocFlags = _addressTable.deviceLocal
+            ? VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT
+            : VMA_ALLOCATION_CREATE_MAPPED_BIT | 
+              VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT | 
+              VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
 
         VmaAllocationCreateInfo bufferAllocInfo = {
             .flags = allocFlags,
@@ -238,408 +483,2485 @@ namespace WilloRHI
 
         VmaAllocationInfo newAllocInfo = {};
 
-        vmaCreateBuffer(_allocator, &bufferInfo, &bufferAllocInfo, &_addressBuffer.buffer, &_addressBuffer.allocation, &newAllocInfo);
+        vmaCreateBuffer(_allocator, &bufferInfo, &bufferAllocInfo, &_addressBuffer.buffer, &_addressBufferMetadata.allocation, &newAllocInfo);
 
-        _addressBuffer.isMapped = true;
-        _addressBuffer.mappedAddress = newAllocInfo.pMappedData;
-        _addressBufferPtr = (uint64_t*)_addressBuffer.mappedAddress;
+        if (_addressTable.deviceLocal) {
+            SetupAddressTableUploads(countInfo.bufferCount);
+        } else {
+            _addressBufferMetadata.isMapped = true;
+            _addressBufferMetadata.mappedAddress = newAllocInfo.pMappedData;
+            _addressBufferPtr = (uint64_t*)_addressBufferMetadata.mappedAddress;
+        }
 
-        VkDescriptorBufferInfo bufferDescriptorInfo = {
-            .buffer = _addressBuffer.buffer,
-            .offset = 0,
-            .range = (sizeof(uint64_t) * countInfo.bufferCount)
-        };
+        WriteDescriptor({
+            .binding = WilloRHI_DEVICE_ADDRESS_BUFFER_BINDING,
+            .id = 0,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .bufferInfo = {
+                .buffer = _addressBuffer.buffer,
+                .offset = 0,
+                .range = (sizeof(uint64_t) * countInfo.bufferCount)
+            }
+        });
+        FlushDescriptorWrites(true);
+
+        LogMessage("Created " + std::string(_addressTable.deviceLocal ? "device-local" : "host-visible")
+            + " buffer-address buffer for address count of " + std::to_string(countInfo.bufferCount), false);
+    }
 
-        VkWriteDescriptorSet descriptorWriteDesc = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    void ImplDevice::SetupAddressTableUploads(uint32_t numEntries)
+    {
+        VkBufferCreateInfo stagingInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
             .pNext = nullptr,
-            .dstSet = _globalDescriptors.descriptorSet,
-            .dstBinding = WilloRHI_DEVICE_ADDRESS_BUFFER_BINDING,
-            .dstArrayElement = 0,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = nullptr,
-            .pBufferInfo = &bufferDescriptorInfo,
-            .pTexelBufferView = nullptr
+            .flags = 0,
+            .size = (sizeof(uint64_t) * numEntries),
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            .sharingMode = _sharedQueueFamilies.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = (uint32_t)_sharedQueueFamilies.size(),
+            .pQueueFamilyIndices = _sharedQueueFamilies.data()
         };
 
-        vkUpdateDescriptorSets(_vkDevice, 1, &descriptorWriteDesc, 0, nullptr);
+        VmaAllocationCreateInfo stagingAllocInfo = {
+            .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+            .requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            .preferredFlags = {},
+            .memoryTypeBits = std::numeric_limits<uint32_t>::max(),
+            .pool = nullptr,
+            .pUserData = nullptr,
+            .priority = 0.5f
+        };
 
-        LogMessage("Created buffer-address buffer for address count of " + std::to_string(countInfo.bufferCount), false);
-    }
+        VmaAllocationInfo stagingAllocation = {};
 
-    void ImplDevice::SetupDefaultResources()
-    {
-        // default "error" texture, view, empty buffer, default sampler, etc
+        ErrorCheck(vmaCreateBuffer(_allocator, &stagingInfo, &stagingAllocInfo,
+            &_addressTable.stagingBuffer, &_addressTable.stagingAllocation, &stagingAllocation));
 
-        LogMessage("Loaded default resources", false);
-    }
+        _addressBufferPtr = (uint64_t*)stagingAllocation.pMappedData;
 
-    void* Device::GetDeviceNativeHandle() const { return impl->GetDeviceNativeHandle(); }
-    void* ImplDevice::GetDeviceNativeHandle() const {
-        return static_cast<void*>(_vkDevice);
-    }
+        uint32_t numChunks = (numEntries + AddressTableUploads::CHUNK_SIZE - 1) / AddressTableUploads::CHUNK_SIZE;
+        _addressTable.numEntries = numEntries;
+        _addressTable.numDirtyWords = (numChunks + 63) / 64;
+        _addressTable.dirtyChunks = std::make_unique<std::atomic<uint64_t>[]>(_addressTable.numDirtyWords);
 
-    void* Device::GetPhysicalDeviceNativeHandle() const { return impl->GetPhysicalDeviceNativeHandle(); }
-    void* ImplDevice::GetPhysicalDeviceNativeHandle() const {
-        return static_cast<void*>(_vkPhysicalDevice);
-    }
+        VkSemaphoreTypeCreateInfo timelineInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext = nullptr,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        };
 
-    void* Device::GetInstanceNativeHandle() const { return impl->GetInstanceNativeHandle(); }
-    void* ImplDevice::GetInstanceNativeHandle() const {
-        return static_cast<void*>(_vkInstance);
+        VkSemaphoreCreateInfo semaphoreInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &timelineInfo,
+            .flags = 0
+        };
+
+        ErrorCheck(vkCreateSemaphore(_vkDevice, &semaphoreInfo, nullptr, &_addressTable.timeline));
     }
 
-    void Device::WaitIdle() const { impl->WaitIdle(); }
-    void ImplDevice::WaitIdle() const
+    void ImplDevice::WriteBufferAddress(BufferId buffer, VkDeviceAddress address)
     {
-        vkDeviceWaitIdle(_vkDevice);
+        uint32_t index = ResourceIndex(buffer);
+        _addressBufferPtr[index] = address;
+
+        if (!_addressTable.deviceLocal)
+            return;
+
+        // marked after the write, so an upload that clears the bit always sees this entry
+        uint32_t chunk = index / AddressTableUploads::CHUNK_SIZE;
+        _addressTable.dirtyChunks[chunk >> 6].fetch_or(1ull << (chunk & 63), std::memory_order_release);
     }
 
-    BufferId Device::CreateBuffer(const BufferCreateInfo& createInfo) {
-        return impl->CreateBuffer(createInfo); }
-    BufferId ImplDevice::CreateBuffer(const BufferCreateInfo& createInfo)
+    bool ImplDevice::UploadAddressTable(VkQueue queue, uint32_t queueFamily, VkSemaphore& waitSemaphore, uint64_t& waitValue)
     {
-        BufferResource newBuffer = {};
+        if (!_addressTable.deviceLocal)
+            return false;
+
+        std::lock_guard<std::mutex> lock(_addressTable.mutex);
+
+        std::vector<VkBufferCopy> regions;
+        for (uint32_t word = 0; word < _addressTable.numDirtyWords; word++) {
+            uint64_t bits = _addressTable.dirtyChunks[word].exchange(0, std::memory_order_acquire);
+            while (bits != 0) {
+                uint32_t chunk = word * 64 + std::countr_zero(bits);
+                bits &= bits - 1;
+
+                VkDeviceSize offset = (VkDeviceSize)chunk * AddressTableUploads::CHUNK_SIZE * sizeof(uint64_t);
+                VkDeviceSize size = std::min<VkDeviceSize>(AddressTableUploads::CHUNK_SIZE,
+                    _addressTable.numEntries - chunk * AddressTableUploads::CHUNK_SIZE) * sizeof(uint64_t);
+
+                // merge neighbouring chunks into one region
+                if (!regions.empty() && regions.back().srcOffset + regions.back().size == offset)
+                    regions.back().size += size;
+                else
+                    regions.push_back({ .srcOffset = offset, .dstOffset = offset, .size = size });
+            }
+        }
 
-        uint32_t bufferSlot = _resources.buffers.Allocate();
+        if (!regions.empty()) {
+            uint64_t completedValue = 0;
+            ErrorCheck(vkGetSemaphoreCounterValue(_vkDevice, _addressTable.timeline, &completedValue));
 
-        // create and allocate for buffer
+            while (!_addressTable.pendingCommandBuffers.empty()
+                && _addressTable.pendingCommandBuffers.front().timelineValue <= completedValue) {
+                AddressTableUploads::PendingCommandBuffer& pending = _addressTable.pendingCommandBuffers.front();
+                vkResetCommandBuffer(pending.commandBuffer, 0);
+                _addressTable.freeCommandBuffers[pending.queueFamily].push_back(pending.commandBuffer);
+                _addressTable.pendingCommandBuffers.pop_front();
+            }
 
-        VkBufferCreateInfo vkBufferInfo = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-            .pNext = nullptr,
-            .flags = 0,
-            .size = createInfo.size,
-            .usage = BUFFER_USAGE_FLAGS,
-            .sharingMode = VK_SHARING_MODE_CONCURRENT,
-            .queueFamilyIndexCount = 3,
-            .pQueueFamilyIndices = _vkQueueIndices
-        };
+            if (_addressTable.commandPools.find(queueFamily) == _addressTable.commandPools.end()) {
+                VkCommandPoolCreateInfo poolInfo = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .pNext = nullptr,
+                    .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                    .queueFamilyIndex = queueFamily
+                };
+
+                VkCommandPool newPool = VK_NULL_HANDLE;
+                ErrorCheck(vkCreateCommandPool(_vkDevice, &poolInfo, nullptr, &newPool));
+                _addressTable.commandPools.insert({ queueFamily, newPool });
+            }
 
-        VmaAllocationCreateFlags allocFlags = static_cast<VmaAllocationCreateFlags>(createInfo.allocationFlags);
-        if (createInfo.allocationFlags & AllocationUsageFlag::HOST_ACCESS_SEQUENTIAL_WRITE ||
-            createInfo.allocationFlags & AllocationUsageFlag::HOST_ACCESS_RANDOM) {
-                allocFlags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
-                newBuffer.isMapped = true;
+            std::vector<VkCommandBuffer>& freeList = _addressTable.freeCommandBuffers[queueFamily];
+            VkCommandBuffer cmd = VK_NULL_HANDLE;
+            if (freeList.empty()) {
+                VkCommandBufferAllocateInfo allocInfo = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                    .pNext = nullptr,
+                    .commandPool = _addressTable.commandPools.at(queueFamily),
+                    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                    .commandBufferCount = 1
+                };
+                ErrorCheck(vkAllocateCommandBuffers(_vkDevice, &allocInfo, &cmd));
+            } else {
+                cmd = freeList.back();
+                freeList.pop_back();
             }
 
-        VmaAllocationCreateInfo allocationCreateInfo = {
-            .flags = allocFlags,
-            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .requiredFlags = {},
-            .preferredFlags = {},
-            .memoryTypeBits = std::numeric_limits<uint32_t>::max(),
-            .pool = nullptr,
-            .pUserData = nullptr,
-            .priority = 0.5f
-        };
+            VkCommandBufferBeginInfo beginInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                .pNext = nullptr,
+                .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+                .pInheritanceInfo = nullptr
+            };
 
-        VmaAllocationInfo newAllocation = {};
+            vkBeginCommandBuffer(cmd, &beginInfo);
+            vkCmdCopyBuffer(cmd, _addressTable.stagingBuffer, _addressBuffer.buffer, (uint32_t)regions.size(), regions.data());
+            vkEndCommandBuffer(cmd);
 
-        ErrorCheck(vmaCreateBuffer(_allocator, &vkBufferInfo, &allocationCreateInfo,
-            &newBuffer.buffer, &newBuffer.allocation, &newAllocation));
+            _addressTable.timelineValue += 1;
 
-        newBuffer.mappedAddress = newAllocation.pMappedData;
-        newBuffer.createInfo = createInfo;
+            // the timeline signal and wait carry the memory dependency to the waiting submission
+            VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+                .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                .pNext = nullptr,
+                .waitSemaphoreValueCount = 0,
+                .pWaitSemaphoreValues = nullptr,
+                .signalSemaphoreValueCount = 1,
+                .pSignalSemaphoreValues = &_addressTable.timelineValue
+            };
 
-        VkBufferDeviceAddressInfo addressInfo = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-            .pNext = nullptr,
-            .buffer = newBuffer.buffer
-        };
+            VkSubmitInfo submitInfo = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .pNext = &timelineSubmitInfo,
+                .waitSemaphoreCount = 0,
+                .pWaitSemaphores = nullptr,
+                .pWaitDstStageMask = nullptr,
+                .commandBufferCount = 1,
+                .pCommandBuffers = &cmd,
+                .signalSemaphoreCount = 1,
+                .pSignalSemaphores = &_addressTable.timeline
+            };
 
-        newBuffer.deviceAddress = vkGetBufferDeviceAddress(_vkDevice, &addressInfo);
-        // write address to address buffer pointer
-        _addressBufferPtr[bufferSlot] = newBuffer.deviceAddress;
+            ErrorCheck(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+            _addressTable.pendingCommandBuffers.push_back({
+                .timelineValue = _addressTable.timelineValue,
+                .queueFamily = queueFamily,
+                .commandBuffer = cmd
+            });
+        }
 
-        // write buffer descriptor to same slot as id
+        if (_addressTable.timelineValue == 0)
+            return false;
 
-        VkDescriptorBufferInfo bufferDescriptorInfo = {
-            .buffer = newBuffer.buffer,
-            .offset = 0,
-            .range = createInfo.size
-        };
+        // waiting on an already reached value is free, and covers uploads made from other queues
+        waitSemaphore = _addressTable.timeline;
+        waitValue = _addressTable.timelineValue;
+        return true;
+    }
 
-        VkWriteDescriptorSet descriptorWriteDesc = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    void ImplDevice::CreateGlobalSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, bool descriptorBuffer)
+    {
+        // descriptor writes are flushed in batches while the set may be bound by pending work
+        // descriptor buffers have no update-after-bind semantics, writes there are plain memory writes
+        VkDescriptorBindingFlags bindlessFlags = descriptorBuffer
+            ? VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+            : VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+              VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+              VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+        std::vector<VkDescriptorBindingFlags> bindingFlags(bindings.size(), bindlessFlags);
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
             .pNext = nullptr,
-            .dstSet = _globalDescriptors.descriptorSet,
-            .dstBinding = WilloRHI_STORAGE_BUFFER_BINDING,
-            .dstArrayElement = (uint32_t)bufferSlot,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-            .pImageInfo = nullptr,
-            .pBufferInfo = &bufferDescriptorInfo,
-            .pTexelBufferView = nullptr
+            .bindingCount = (uint32_t)bindingFlags.size(),
+            .pBindingFlags = bindingFlags.data()
         };
 
-        vkUpdateDescriptorSets(_vkDevice, 1, &descriptorWriteDesc, 0, nullptr);
-
-        _resources.buffers.At(bufferSlot) = newBuffer;
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .pNext = &bindingFlagsInfo,
+            .flags = descriptorBuffer
+                ? (VkDescriptorSetLayoutCreateFlags)VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT
+                : (VkDescriptorSetLayoutCreateFlags)VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+            .bindingCount = (uint32_t)bindings.size(),
+            .pBindings = bindings.data()
+        };
 
-        return bufferSlot;
+        ErrorCheck(vkCreateDescriptorSetLayout(_vkDevice, &setLayoutInfo, nullptr, &_globalDescriptors.setLayout));
     }
 
-    ImageId Device::CreateImage(const ImageCreateInfo& createInfo) {
-        return impl->CreateImage(createInfo); }
-    ImageId ImplDevice::CreateImage(const ImageCreateInfo& createInfo)
+    bool ImplDevice::CreateDescriptorBuffer(VkDeviceSize size)
     {
-        ImageResource newImage = {};
-
-        uint32_t imageSlot = _resources.images.Allocate();
+        // the buffer is read by every shader, so it has to sit in host-visible vram rather than spill to system memory
+        // a small bar is shared with everything else mapped, so only take a quarter of what's left in it
+        const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+        vmaGetMemoryProperties(_allocator, &memoryProperties);
+
+        VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+        vmaGetHeapBudgets(_allocator, budgets);
+
+        constexpr VkMemoryPropertyFlags requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+            | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        VkDeviceSize largestAvailable = 0;
+        uint32_t memoryTypeBits = 0;
+        for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+            const VkMemoryType& memoryType = memoryProperties->memoryTypes[i];
+            if ((memoryType.propertyFlags & requiredFlags) != requiredFlags)
+                continue;
+
+            const VmaBudget& budget = budgets[memoryType.heapIndex];
+            VkDeviceSize available = budget.budget > budget.usage ? budget.budget - budget.usage : 0;
+            largestAvailable = std::max(largestAvailable, available);
+            memoryTypeBits |= 1u << i;
+        }
 
-        VkImageType imageTypeDims[3] = {VK_IMAGE_TYPE_1D, VK_IMAGE_TYPE_2D, VK_IMAGE_TYPE_3D};
-        VkImageType imageType = imageTypeDims[createInfo.dimensions - 1];
+        if (size > largestAvailable / 4) {
+            LogMessage("Descriptor buffer of " + std::to_string(size) + " bytes doesn't fit in host-visible device memory ("
+                + std::to_string(largestAvailable) + " bytes available), falling back to descriptor set", false);
+            return false;
+        }
 
-        VkImageCreateInfo vkImageInfo = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
             .pNext = nullptr,
-            .flags = static_cast<VkImageCreateFlags>(createInfo.createFlags),
-            .imageType = imageType,
-            .format = static_cast<VkFormat>(createInfo.format),
-            .extent = VkExtent3D{createInfo.size.width, createInfo.size.height, createInfo.size.depth},
-            .mipLevels = createInfo.numLevels,
-            .arrayLayers = createInfo.numLayers,
-            .samples = VK_SAMPLE_COUNT_1_BIT,
-            .tiling = static_cast<VkImageTiling>(createInfo.tiling),
-            .usage = static_cast<VkImageUsageFlags>(createInfo.usageFlags),
-            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+            .flags = 0,
+            .size = size,
+            .usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT |
+                VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            .sharingMode = _sharedQueueFamilies.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = (uint32_t)_sharedQueueFamilies.size(),
+            .pQueueFamilyIndices = _sharedQueueFamilies.data()
         };
 
-        VmaAllocationCreateFlags allocFlags = static_cast<VmaAllocationCreateFlags>(createInfo.allocationFlags);
-        if (createInfo.allocationFlags & AllocationUsageFlag::HOST_ACCESS_SEQUENTIAL_WRITE ||
-            createInfo.allocationFlags & AllocationUsageFlag::HOST_ACCESS_RANDOM) {
-                allocFlags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
-                newImage.isMapped = true;
-            }
-
-        VmaAllocationCreateInfo allocationCreateInfo = {
-            .flags = allocFlags,
+        // coherent so descriptors written on the host are visible to the next submission without a flush
+        VmaAllocationCreateInfo allocInfo = {
+            .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
             .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
-            .requiredFlags = {},
+            .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
             .preferredFlags = {},
-            .memoryTypeBits = std::numeric_limits<uint32_t>::max(),
+            .memoryTypeBits = memoryTypeBits,
             .pool = nullptr,
             .pUserData = nullptr,
-            .priority = 0.5f
+            .priority = 1.0f
         };
 
-        VmaAllocationInfo newAllocation = {};
+        VmaAllocationInfo newAllocInfo = {};
 
-        ErrorCheck(vmaCreateImage(_allocator, &vkImageInfo, &allocationCreateInfo,
-            &newImage.image, &newImage.allocation, &newAllocation));
+        VkResult result = vmaCreateBuffer(_allocator, &bufferInfo, &allocInfo,
+            &_globalDescriptors.descriptorBuffer, &_globalDescriptors.descriptorBufferAllocation, &newAllocInfo);
+        if (result != VK_SUCCESS || newAllocInfo.pMappedData == nullptr) {
+            LogMessage("Failed to allocate a descriptor buffer of " + std::to_string(size) + " bytes, falling back to descriptor set", false);
+            if (result == VK_SUCCESS)
+                vmaDestroyBuffer(_allocator, _globalDescriptors.descriptorBuffer, _globalDescriptors.descriptorBufferAllocation);
+            _globalDescriptors.descriptorBuffer = VK_NULL_HANDLE;
+            _globalDescriptors.descriptorBufferAllocation = VK_NULL_HANDLE;
+            return false;
+        }
 
-        newImage.mappedAddress = newAllocation.pMappedData;
-        newImage.createInfo = createInfo;
-        newImage.aspect = AspectFromFormat(createInfo.format);
+        _globalDescriptors.descriptorBufferPtr = static_cast<uint8_t*>(newAllocInfo.pMappedData);
 
-        _resources.images.At(imageSlot) = newImage;
+        VkBufferDeviceAddressInfo addressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .pNext = nullptr,
+            .buffer = _globalDescriptors.descriptorBuffer
+        };
 
-        // no descriptor writes here! that's up to image views
+        _globalDescriptors.descriptorBufferAddress = vkGetBufferDeviceAddress(_vkDevice, &addressInfo);
 
-        return imageSlot;
+        for (uint32_t i = 0; i < GLOBAL_DESCRIPTOR_BINDING_COUNT; i++) {
+            _globalDescriptors.pfnGetDescriptorSetLayoutBindingOffset(_vkDevice, _globalDescriptors.setLayout, i,
+                &_globalDescriptors.bindingOffsets[i]);
+        }
+
+        return true;
     }
 
-    ImageViewId Device::CreateImageView(const ImageViewCreateInfo& createInfo) {
-        return impl->CreateImageView(createInfo); }
-    ImageViewId ImplDevice::CreateImageView(const ImageViewCreateInfo& createInfo)
+    void ImplDevice::WriteDescriptor(const DescriptorWrite& write)
     {
-        ImageResource& imageRsrc = _resources.images.At(createInfo.image);
-        uint32_t viewSlot = _resources.imageViews.Allocate();
-        ImageViewResource newImageView = {};
-        newImageView.createInfo = createInfo;
+        if (!_globalDescriptors.useDescriptorBuffer) {
+            _descriptorWrites.Push(write);
+            return;
+        }
 
-        VkImageViewCreateInfo vkImageViewInfo = {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        // every slot is owned by its id, so descriptors go straight into the mapped buffer
+        const VkPhysicalDeviceDescriptorBufferPropertiesEXT& props = _globalDescriptors.descriptorBufferProperties;
+
+        VkDescriptorAddressInfoEXT addressInfo = {};
+        VkDescriptorGetInfoEXT getInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT,
             .pNext = nullptr,
-            .flags = 0,
-            .image = imageRsrc.image,
-            .viewType = static_cast<VkImageViewType>(createInfo.viewType),
-            .format = static_cast<VkFormat>(createInfo.format),
-            .components = {
-                .r = VK_COMPONENT_SWIZZLE_IDENTITY,
-                .g = VK_COMPONENT_SWIZZLE_IDENTITY,
-                .b = VK_COMPONENT_SWIZZLE_IDENTITY,
-                .a = VK_COMPONENT_SWIZZLE_IDENTITY
-            },
-            .subresourceRange = {
-                .aspectMask = AspectFromFormat(createInfo.format),
-                .baseMipLevel = createInfo.subresource.baseLevel,
-                .levelCount = createInfo.subresource.numLevels,
-                .baseArrayLayer = createInfo.subresource.baseLayer,
-                .layerCount = createInfo.subresource.numLayers
-            }
+            .type = write.type,
+            .data = {}
         };
+        size_t descriptorSize = 0;
+
+        switch (write.type)
+        {
+            case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: {
+                VkBufferDeviceAddressInfo bufferAddressInfo = {
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                    .pNext = nullptr,
+                    .buffer = write.bufferInfo.buffer
+                };
+                addressInfo = {
+                    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT,
+                    .pNext = nullptr,
+                    .address = vkGetBufferDeviceAddress(_vkDevice, &bufferAddressInfo) + write.bufferInfo.offset,
+                    .range = write.bufferInfo.range,
+                    .format = VK_FORMAT_UNDEFINED
+                };
+                getInfo.data.pStorageBuffer = &addressInfo;
+                descriptorSize = props.storageBufferDescriptorSize;
+                break;
+            }
+            case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+                getInfo.data.pStorageImage = &write.imageInfo;
+                descriptorSize = props.storageImageDescriptorSize;
+                break;
+            case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+                getInfo.data.pSampledImage = &write.imageInfo;
+                descriptorSize = props.sampledImageDescriptorSize;
+                break;
+            case VK_DESCRIPTOR_TYPE_SAMPLER:
+                getInfo.data.pSampler = &write.imageInfo.sampler;
+                descriptorSize = props.samplerDescriptorSize;
+                break;
+            default:
+                LogMessage("Unsupported descriptor type for descriptor buffer write");
+                return;
+        }
 
-        ErrorCheck(vkCreateImageView(_vkDevice, &vkImageViewInfo, nullptr, &newImageView.imageView));
+        uint8_t* dst = _globalDescriptors.descriptorBufferPtr
+            + _globalDescriptors.bindingOffsets[write.binding]
+            + (size_t)ResourceIndex(write.id) * descriptorSize;
 
-        _resources.imageViews.At(viewSlot) = newImageView;
+        _globalDescriptors.pfnGetDescriptor(_vkDevice, &getInfo, descriptorSize, dst);
+    }
 
-        std::vector<VkWriteDescriptorSet> descWrites;
-        descWrites.reserve(2);
+    void ImplDevice::SetupDefaultResources()
+    {
+        // default "error" texture, view, empty buffer, default sampler, etc
 
-        if (imageRsrc.createInfo.usageFlags & ImageUsageFlag::STORAGE) {
-            LogMessage("Create storage view", false);
-            VkDescriptorImageInfo storageImageDescriptor = {
-                .sampler = VK_NULL_HANDLE,
-                .imageView = newImageView.imageView,
-                .imageLayout = VK_IMAGE_LAYOUT_GENERAL
-            };
+        LogMessage("Loaded default resources", false);
+    }
+
+    void* Device::GetDeviceNativeHandle() const { return impl->GetDeviceNativeHandle(); }
+    void* ImplDevice::GetDeviceNativeHandle() const {
+        return static_cast<void*>(_vkDevice);
+    }
+
+    void* Device::GetPhysicalDeviceNativeHandle() const { return impl->GetPhysicalDeviceNativeHandle(); }
+    void* ImplDevice::GetPhysicalDeviceNativeHandle() const {
+        return static_cast<void*>(_vkPhysicalDevice);
+    }
+
+    void* Device::GetInstanceNativeHandle() const { return impl->GetInstanceNativeHandle(); }
+    void* ImplDevice::GetInstanceNativeHandle() const {
+        return static_cast<void*>(_vkInstance);
+    }
+
+    void Device::WaitIdle() const { impl->WaitIdle(); }
+    void ImplDevice::WaitIdle() const
+    {
+        vkDeviceWaitIdle(_vkDevice);
+    }
+
+    UploadStrategy Device::GetUploadStrategy() const { return impl->GetUploadStrategy(); }
+    UploadStrategy ImplDevice::GetUploadStrategy() const {
+        return _uploadStrategy;
+    }
+
+    void ImplDevice::SelectUploadStrategy()
+    {
+        const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+        vmaGetMemoryProperties(_allocator, &memoryProperties);
+
+        VkDeviceSize largestDeviceHeap = 0;
+        for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+            if (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                largestDeviceHeap = std::max(largestDeviceHeap, memoryProperties->memoryHeaps[i].size);
+        }
+
+        // a host-visible window onto only part of vram, like the classic 256MB bar, isn't worth putting uploads in
+        constexpr VkMemoryPropertyFlags directFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+            const VkMemoryType& memoryType = memoryProperties->memoryTypes[i];
+            if ((memoryType.propertyFlags & directFlags) == directFlags
+                && memoryProperties->memoryHeaps[memoryType.heapIndex].size >= largestDeviceHeap) {
+                _uploadStrategy = UploadStrategy::DIRECT_WRITE;
+                break;
+            }
+        }
+
+        LogMessage(_uploadStrategy == UploadStrategy::DIRECT_WRITE
+            ? "Upload strategy: direct writes to host-visible device memory"
+            : "Upload strategy: staging copies", false);
+    }
+
+    VmaAllocationCreateFlags ImplDevice::ToVmaAllocationFlags(AllocationUsageFlags allocationFlags) const
+    {
+        VmaAllocationCreateFlags allocFlags = static_cast<VmaAllocationCreateFlags>(allocationFlags & ~AllocationUsageFlags(AllocationUsageFlag::UPLOAD));
+        if ((allocationFlags & AllocationUsageFlag::UPLOAD) && _uploadStrategy == UploadStrategy::DIRECT_WRITE)
+            allocFlags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+        if (allocFlags & (VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT))
+            allocFlags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        return allocFlags;
+    }
+
+    VkMemoryPropertyFlags ImplDevice::RequiredMemoryFlags(AllocationUsageFlags allocationFlags) const
+    {
+        // sequential write alone would let vma pick plain host memory
+        if ((allocationFlags & AllocationUsageFlag::UPLOAD) && _uploadStrategy == UploadStrategy::DIRECT_WRITE)
+            return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        return 0;
+    }
+
+    BufferId Device::CreateBuffer(const BufferCreateInfo& createInfo) {
+        return impl->CreateBuffer(createInfo, -1); }
+    BufferId Device::ImportBufferFd(int fd, const BufferCreateInfo& createInfo) {
+        return impl->CreateBuffer(createInfo, fd); }
+    BufferId ImplDevice::CreateBuffer(const BufferCreateInfo& createInfo, int importFd)
+    {
+        BufferResource newBuffer = {};
+        BufferMetadata newMetadata = {};
+
+        uint32_t bufferSlot = _resources.buffers.Allocate();
+        if (bufferSlot == INVALID_RESOURCE_ID) {
+            LogMessage("Out of buffer slots, increase ResourceCountInfo::bufferCount");
+            return INVALID_RESOURCE_ID;
+        }
+
+        newMetadata.createInfo = createInfo;
+
+        // small buffers are carved out of a shared backing buffer, everything else gets its own
+        bool isExternal = createInfo.exportable || importFd >= 0;
+        bool isSmall = _smallBuffers.threshold != 0 && createInfo.size <= _smallBuffers.threshold
+            && !(createInfo.allocationFlags & AllocationUsageFlag::DEDICATED_MEMORY)
+            && createInfo.memoryPool == INVALID_RESOURCE_ID && !isExternal;
+        if (isExternal) {
+            if (!CreateExternalBuffer(createInfo, importFd, newBuffer, newMetadata)) {
+                _resources.buffers.Free(bufferSlot);
+                return INVALID_RESOURCE_ID;
+            }
+        } else if (!isSmall || !SubAllocateBuffer(createInfo, newBuffer, newMetadata)) {
+            VkBufferCreateInfo vkBufferInfo = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .size = createInfo.size,
+                .usage = BufferUsageFromFlags(createInfo.usageFlags),
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr
+            };
+
+            VmaAllocationCreateFlags allocFlags = ToVmaAllocationFlags(createInfo.allocationFlags);
+            newMetadata.isMapped = allocFlags & VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+            // pools with a fixed block size can't hand out dedicated allocations
+            VmaPool pool = GetMemoryPool(createInfo.memoryPool);
+            if (pool != VK_NULL_HANDLE)
+                allocFlags &= ~VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+            VmaAllocationCreateInfo allocationCreateInfo = {
+                .flags = allocFlags,
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+                .requiredFlags = RequiredMemoryFlags(createInfo.allocationFlags),
+                .preferredFlags = {},
+                .memoryTypeBits = std::numeric_limits<uint32_t>::max(),
+                .pool = pool,
+                .pUserData = AllocationTag(AllocationOwner::BUFFER, bufferSlot),
+                .priority = 0.5f
+            };
+
+            VmaAllocationInfo newAllocation = {};
+
+            ErrorCheck(vmaCreateBuffer(_allocator, &vkBufferInfo, &allocationCreateInfo,
+                &newBuffer.buffer, &newMetadata.allocation, &newAllocation));
+
+            newMetadata.mappedAddress = newAllocation.pMappedData;
+
+            VkBufferDeviceAddressInfo addressInfo = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                .pNext = nullptr,
+                .buffer = newBuffer.buffer
+            };
+
+            newMetadata.deviceAddress = vkGetBufferDeviceAddress(_vkDevice, &addressInfo);
+        }
+
+        // write address to address buffer pointer
+        WriteBufferAddress(bufferSlot, newMetadata.deviceAddress);
+
+        _resources.buffers.At(bufferSlot) = newBuffer;
+        _resources.buffers.Metadata(bufferSlot) = newMetadata;
+
+        // write buffer descriptor to same slot as id, applied at the next flush
+        // buffers without storage usage are still reachable through their address
+        if (!(createInfo.usageFlags & BufferUsageFlag::STORAGE))
+            return bufferSlot;
+
+        WriteDescriptor({
+            .binding = WilloRHI_STORAGE_BUFFER_BINDING,
+            .id = bufferSlot,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .bufferInfo = {
+                .buffer = newBuffer.buffer,
+                .offset = newBuffer.offset,
+                .range = createInfo.size
+            }
+        });
+
+        return bufferSlot;
+    }
+
+    BufferId Device::ImportHostBuffer(void* pointer, uint64_t size, BufferUsageFlags usageFlags) {
+        return impl->ImportHostBuffer(pointer, size, usageFlags); }
+    BufferId ImplDevice::ImportHostBuffer(void* pointer, uint64_t size, BufferUsageFlags usageFlags)
+    {
+        if (_externalMemory.pfnGetMemoryHostPointerProperties == nullptr) {
+            LogMessage("Importing host memory needs VK_EXT_external_memory_host");
+            return INVALID_RESOURCE_ID;
+        }
+
+        if (pointer == nullptr || size == 0) {
+            LogMessage("Imported host memory can't be empty");
+            return INVALID_RESOURCE_ID;
+        }
+
+        // the import has to start and end on the alignment, the buffer is then bound at the pointer's offset into it
+        // that's the page size in practice, so the widened range stays inside the pages already mapped
+        VkDeviceSize alignment = _externalMemory.hostPointerAlignment;
+        uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+        uintptr_t importStart = address / alignment * alignment;
+        uintptr_t importEnd = (address + size + alignment - 1) / alignment * alignment;
+        VkDeviceSize importSize = importEnd - importStart;
+        VkDeviceSize offset = address - importStart;
+
+        VkMemoryHostPointerPropertiesEXT pointerProperties = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+            .pNext = nullptr
+        };
+
+        VkResult result = _externalMemory.pfnGetMemoryHostPointerProperties(_vkDevice, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+            reinterpret_cast<void*>(importStart), &pointerProperties);
+        if (result != VK_SUCCESS || pointerProperties.memoryTypeBits == 0) {
+            LogMessage("Host memory at " + std::to_string(address) + " can't be imported");
+            return INVALID_RESOURCE_ID;
+        }
+
+        VkExternalMemoryBufferCreateInfo externalInfo = {
+            .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT
+        };
+
+        VkBufferCreateInfo vkBufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext = &externalInfo,
+            .flags = 0,
+            .size = importSize,
+            .usage = BufferUsageFromFlags(usageFlags),
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr
+        };
+
+        VkBuffer vkBuffer = VK_NULL_HANDLE;
+        if (vkCreateBuffer(_vkDevice, &vkBufferInfo, nullptr, &vkBuffer) != VK_SUCCESS) {
+            LogMessage("Failed to create a buffer for imported host memory");
+            return INVALID_RESOURCE_ID;
+        }
+
+        VkMemoryRequirements requirements = {};
+        vkGetBufferMemoryRequirements(_vkDevice, vkBuffer, &requirements);
+
+        uint32_t memoryTypeBits = requirements.memoryTypeBits & pointerProperties.memoryTypeBits;
+        if (memoryTypeBits == 0 || requirements.size > importSize) {
+            LogMessage("No memory type can back a buffer over imported host memory");
+            vkDestroyBuffer(_vkDevice, vkBuffer, nullptr);
+            return INVALID_RESOURCE_ID;
+        }
+
+        VkImportMemoryHostPointerInfoEXT importInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+            .pNext = nullptr,
+            .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+            .pHostPointer = reinterpret_cast<void*>(importStart)
+        };
+
+        VkMemoryAllocateFlagsInfo allocateFlags = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+            .pNext = &importInfo,
+            .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+            .deviceMask = 0
+        };
+
+        VkMemoryAllocateInfo allocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = &allocateFlags,
+            .allocationSize = importSize,
+            .memoryTypeIndex = static_cast<uint32_t>(std::countr_zero(memoryTypeBits))
+        };
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        result = vkAllocateMemory(_vkDevice, &allocateInfo, nullptr, &memory);
+        if (result != VK_SUCCESS) {
+            LogMessage("Failed to import host memory: " + std::string(string_VkResult(result)));
+            vkDestroyBuffer(_vkDevice, vkBuffer, nullptr);
+            return INVALID_RESOURCE_ID;
+        }
+
+        ErrorCheck(vkBindBufferMemory(_vkDevice, vkBuffer, memory, 0));
+
+        uint32_t bufferSlot = _resources.buffers.Allocate();
+        if (bufferSlot == INVALID_RESOURCE_ID) {
+            LogMessage("Out of buffer slots, increase ResourceCountInfo::bufferCount");
+            vkDestroyBuffer(_vkDevice, vkBuffer, nullptr);
+            vkFreeMemory(_vkDevice, memory, nullptr);
+            return INVALID_RESOURCE_ID;
+        }
+
+        VkBufferDeviceAddressInfo addressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .pNext = nullptr,
+            .buffer = vkBuffer
+        };
+
+        BufferResource newBuffer = {
+            .buffer = vkBuffer,
+            .offset = offset,
+            .size = size
+        };
+
+        // mapped by definition, which also keeps defragmentation away from it
+        BufferMetadata newMetadata = {
+            .deviceAddress = vkGetBufferDeviceAddress(_vkDevice, &addressInfo) + offset,
+            .mappedAddress = pointer,
+            .isMapped = true,
+            .createInfo = {
+                .size = size,
+                .usageFlags = usageFlags
+            },
+            .externalMemory = memory
+        };
+
+        WriteBufferAddress(bufferSlot, newMetadata.deviceAddress);
+
+        _resources.buffers.At(bufferSlot) = newBuffer;
+        _resources.buffers.Metadata(bufferSlot) = newMetadata;
+
+        if (!(usageFlags & BufferUsageFlag::STORAGE))
+            return bufferSlot;
+
+        // the descriptor is bound at the pointer's offset, which only works out if it's suitably aligned
+        if (offset % _smallBuffers.alignment != 0) {
+            LogMessage("Imported buffer " + std::to_string(bufferSlot) + " isn't aligned for a storage descriptor, only its address is usable", false);
+            return bufferSlot;
+        }
+
+        WriteDescriptor({
+            .binding = WilloRHI_STORAGE_BUFFER_BINDING,
+            .id = bufferSlot,
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .bufferInfo = {
+                .buffer = vkBuffer,
+                .offset = offset,
+                .range = size
+            }
+        });
+
+        return bufferSlot;
+    }
+
+    // shared with defragmentation, which recreates moved images from their create info
+    static VkImageCreateInfo ToVkImageCreateInfo(const ImageCreateInfo& createInfo)
+    {
+        VkImageType imageTypeDims[3] = {VK_IMAGE_TYPE_1D, VK_IMAGE_TYPE_2D, VK_IMAGE_TYPE_3D};
+        VkImageType imageType = imageTypeDims[createInfo.dimensions - 1];
+
+        return VkImageCreateInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = static_cast<VkImageCreateFlags>(createInfo.createFlags),
+            .imageType = imageType,
+            .format = static_cast<VkFormat>(createInfo.format),
+            .extent = VkExtent3D{createInfo.size.width, createInfo.size.height, createInfo.size.depth},
+            .mipLevels = createInfo.numLevels,
+            .arrayLayers = createInfo.numLayers,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .tiling = static_cast<VkImageTiling>(createInfo.tiling),
+            .usage = static_cast<VkImageUsageFlags>(createInfo.usageFlags),
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+        };
+    }
+
+    ImageId Device::CreateImage(const ImageCreateInfo& createInfo) {
+        return impl->CreateImage(createInfo, -1); }
+    ImageId Device::ImportImageFd(int fd, const ImageCreateInfo& createInfo) {
+        return impl->CreateImage(createInfo, fd); }
+    ImageId ImplDevice::CreateImage(const ImageCreateInfo& createInfo, int importFd)
+    {
+        ImageResource newImage = {};
+        ImageMetadata newMetadata = {};
+
+        uint32_t imageSlot = _resources.images.Allocate();
+        if (imageSlot == INVALID_RESOURCE_ID) {
+            LogMessage("Out of image slots, increase ResourceCountInfo::imageCount");
+            return INVALID_RESOURCE_ID;
+        }
+
+        ImageCreateInfo imageInfo = createInfo;
+        if ((imageInfo.usageFlags & ImageUsageFlag::HOST_TRANSFER) && _hostImageCopy.pfnCopyMemoryToImage == nullptr) {
+            LogMessage("HOST_TRANSFER image usage needs VK_EXT_host_image_copy, WriteImage won't work on image " + std::to_string(imageSlot), false);
+            imageInfo.usageFlags = imageInfo.usageFlags & ~ImageUsageFlags(ImageUsageFlag::HOST_TRANSFER);
+        }
+
+        // the extension being there doesn't mean every format supports it
+        if (imageInfo.usageFlags & ImageUsageFlag::HOST_TRANSFER) {
+            VkFormatProperties3 formatProperties3 = {
+                .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3,
+                .pNext = nullptr
+            };
+            VkFormatProperties2 formatProperties = {
+                .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+                .pNext = &formatProperties3
+            };
+            vkGetPhysicalDeviceFormatProperties2(_vkPhysicalDevice, static_cast<VkFormat>(imageInfo.format), &formatProperties);
+
+            VkFormatFeatureFlags2 features = imageInfo.tiling == ImageTiling::LINEAR
+                ? formatProperties3.linearTilingFeatures : formatProperties3.optimalTilingFeatures;
+            if (!(features & VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT)) {
+                LogMessage("HOST_TRANSFER image usage isn't supported for the format of image " + std::to_string(imageSlot)
+                    + ", WriteImage won't work on it", false);
+                imageInfo.usageFlags = imageInfo.usageFlags & ~ImageUsageFlags(ImageUsageFlag::HOST_TRANSFER);
+            }
+        }
+
+        if (imageInfo.exportable || importFd >= 0) {
+            if (!CreateExternalImage(imageInfo, importFd, newImage, newMetadata)) {
+                _resources.images.Free(imageSlot);
+                return INVALID_RESOURCE_ID;
+            }
+        } else {
+            VkImageCreateInfo vkImageInfo = ToVkImageCreateInfo(imageInfo);
+
+            VmaAllocationCreateFlags allocFlags = ToVmaAllocationFlags(createInfo.allocationFlags);
+            newMetadata.isMapped = allocFlags & VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+            uint32_t poolMemoryType = 0;
+            VmaPool pool = GetMemoryPool(createInfo.memoryPool, &poolMemoryType);
+            if (pool != VK_NULL_HANDLE) {
+                allocFlags &= ~VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+                // the pool's memory type was picked for the image described at its creation, not this one
+                VkDeviceImageMemoryRequirements requirementsInfo = {
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS,
+                    .pNext = nullptr,
+                    .pCreateInfo = &vkImageInfo,
+                    .planeAspect = VK_IMAGE_ASPECT_COLOR_BIT
+                };
+
+                VkMemoryRequirements2 requirements = {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2,
+                    .pNext = nullptr,
+                    .memoryRequirements = {}
+                };
+
+                vkGetDeviceImageMemoryRequirements(_vkDevice, &requirementsInfo, &requirements);
+                if ((requirements.memoryRequirements.memoryTypeBits & (1u << poolMemoryType)) == 0) {
+                    LogMessage("Image can't be placed in memory pool " + std::to_string(createInfo.memoryPool)
+                        + ", create the pool with this image's format and usage");
+                    _resources.images.Free(imageSlot);
+                    return INVALID_RESOURCE_ID;
+                }
+            }
+
+            VmaAllocationCreateInfo allocationCreateInfo = {
+                .flags = allocFlags,
+                .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+                .requiredFlags = RequiredMemoryFlags(createInfo.allocationFlags),
+                .preferredFlags = {},
+                .memoryTypeBits = std::numeric_limits<uint32_t>::max(),
+                .pool = pool,
+                .pUserData = AllocationTag(AllocationOwner::IMAGE, imageSlot),
+                .priority = 0.5f
+            };
+
+            VmaAllocationInfo newAllocation = {};
+
+            ErrorCheck(vmaCreateImage(_allocator, &vkImageInfo, &allocationCreateInfo,
+                &newImage.image, &newMetadata.allocation, &newAllocation));
+
+            newMetadata.mappedAddress = newAllocation.pMappedData;
+        }
+
+        newMetadata.createInfo = imageInfo;
+        newImage.aspect = AspectFromFormat(createInfo.format);
+
+        _resources.images.At(imageSlot) = newImage;
+        _resources.images.Metadata(imageSlot) = newMetadata;
+
+        // no descriptor writes here! that's up to image views
+
+        return imageSlot;
+    }
+
+    VkDeviceMemory ImplDevice::AllocateExternalMemory(const VkMemoryRequirements& requirements, VkBuffer buffer, VkImage image, int importFd)
+    {
+        if (_externalMemory.pfnGetMemoryFd == nullptr) {
+            LogMessage("Sharing memory between processes needs VK_KHR_external_memory_fd");
+            return VK_NULL_HANDLE;
+        }
+
+        // both sides pick the same way, an opaque fd only imports into the memory type it was exported from
+        const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+        vmaGetMemoryProperties(_allocator, &memoryProperties);
+
+        uint32_t memoryType = UINT32_MAX;
+        for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+            if (!(requirements.memoryTypeBits & (1u << i)))
+                continue;
+            if (memoryType == UINT32_MAX)
+                memoryType = i;
+            if (memoryProperties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+                memoryType = i;
+                break;
+            }
+        }
+
+        VkExportMemoryAllocateInfo exportInfo = {
+            .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+            .pNext = nullptr,
+            .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT
+        };
+
+        VkImportMemoryFdInfoKHR importInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+            .pNext = nullptr,
+            .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+            .fd = importFd
+        };
+
+        // dedicated, which some drivers require of external images anyway
+        VkMemoryDedicatedAllocateInfo dedicatedInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+            .pNext = importFd >= 0 ? static_cast<void*>(&importInfo) : static_cast<void*>(&exportInfo),
+            .image = image,
+            .buffer = buffer
+        };
+
+        VkMemoryAllocateFlagsInfo allocateFlags = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+            .pNext = &dedicatedInfo,
+            .flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+            .deviceMask = 0
+        };
+
+        VkMemoryAllocateInfo allocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext = buffer != VK_NULL_HANDLE ? static_cast<void*>(&allocateFlags) : static_cast<void*>(&dedicatedInfo),
+            .allocationSize = requirements.size,
+            .memoryTypeIndex = memoryType
+        };
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkResult result = vkAllocateMemory(_vkDevice, &allocateInfo, nullptr, &memory);
+        if (result != VK_SUCCESS) {
+            LogMessage(std::string(importFd >= 0 ? "Failed to import memory: " : "Failed to allocate exportable memory: ") + string_VkResult(result));
+            return VK_NULL_HANDLE;
+        }
+
+        return memory;
+    }
+
+    bool ImplDevice::CreateExternalBuffer(const BufferCreateInfo& createInfo, int importFd, BufferResource& resource, BufferMetadata& metadata)
+    {
+        VkExternalMemoryBufferCreateInfo externalInfo = {
+            .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT
+        };
+
+        VkBufferCreateInfo vkBufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext = &externalInfo,
+            .flags = 0,
+            .size = createInfo.size,
+            .usage = BufferUsageFromFlags(createInfo.usageFlags),
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr
+        };
+
+        ErrorCheck(vkCreateBuffer(_vkDevice, &vkBufferInfo, nullptr, &resource.buffer));
+
+        VkMemoryRequirements requirements = {};
+        vkGetBufferMemoryRequirements(_vkDevice, resource.buffer, &requirements);
+
+        metadata.externalMemory = AllocateExternalMemory(requirements, resource.buffer, VK_NULL_HANDLE, importFd);
+        if (metadata.externalMemory == VK_NULL_HANDLE) {
+            vkDestroyBuffer(_vkDevice, resource.buffer, nullptr);
+            return false;
+        }
+
+        ErrorCheck(vkBindBufferMemory(_vkDevice, resource.buffer, metadata.externalMemory, 0));
+
+        // the first use acquires it from the other process, which may have written it already
+        resource.ownerQueueFamily = VK_QUEUE_FAMILY_EXTERNAL;
+
+        VkBufferDeviceAddressInfo addressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .pNext = nullptr,
+            .buffer = resource.buffer
+        };
+
+        metadata.deviceAddress = vkGetBufferDeviceAddress(_vkDevice, &addressInfo);
+        return true;
+    }
+
+    bool ImplDevice::CreateExternalImage(const ImageCreateInfo& createInfo, int importFd, ImageResource& resource, ImageMetadata& metadata)
+    {
+        VkExternalMemoryImageCreateInfo externalInfo = {
+            .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+            .pNext = nullptr,
+            .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT
+        };
+
+        VkImageCreateInfo vkImageInfo = ToVkImageCreateInfo(createInfo);
+        vkImageInfo.pNext = &externalInfo;
+
+        ErrorCheck(vkCreateImage(_vkDevice, &vkImageInfo, nullptr, &resource.image));
+
+        VkMemoryRequirements requirements = {};
+        vkGetImageMemoryRequirements(_vkDevice, resource.image, &requirements);
+
+        metadata.externalMemory = AllocateExternalMemory(requirements, VK_NULL_HANDLE, resource.image, importFd);
+        if (metadata.externalMemory == VK_NULL_HANDLE) {
+            vkDestroyImage(_vkDevice, resource.image, nullptr);
+            return false;
+        }
+
+        ErrorCheck(vkBindImageMemory(_vkDevice, resource.image, metadata.externalMemory, 0));
+
+        resource.ownerQueueFamily = VK_QUEUE_FAMILY_EXTERNAL;
+        return true;
+    }
+
+    int Device::ExportBufferFd(BufferId buffer) { return impl->ExportBufferFd(buffer); }
+    int ImplDevice::ExportBufferFd(BufferId buffer) {
+        const BufferMetadata& metadata = _resources.buffers.Metadata(buffer);
+        if (!metadata.createInfo.exportable) {
+            LogMessage("Buffer " + std::to_string(buffer) + " wasn't created exportable");
+            return -1;
+        }
+        return ExportMemoryFd(metadata.externalMemory);
+    }
+
+    int Device::ExportImageFd(ImageId image) { return impl->ExportImageFd(image); }
+    int ImplDevice::ExportImageFd(ImageId image) {
+        const ImageMetadata& metadata = _resources.images.Metadata(image);
+        if (!metadata.createInfo.exportable) {
+            LogMessage("Image " + std::to_string(image) + " wasn't created exportable");
+            return -1;
+        }
+        return ExportMemoryFd(metadata.externalMemory);
+    }
+
+    int ImplDevice::ExportMemoryFd(VkDeviceMemory memory)
+    {
+        VkMemoryGetFdInfoKHR getFdInfo = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
+            .pNext = nullptr,
+            .memory = memory,
+            .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT
+        };
+
+        // each call makes a new fd, the memory stays alive in the other process until it closes its import
+        int fd = -1;
+        ErrorCheck(_externalMemory.pfnGetMemoryFd(_vkDevice, &getFdInfo, &fd));
+        return fd;
+    }
+
+    ImageViewId Device::CreateImageView(const ImageViewCreateInfo& createInfo) {
+        return impl->CreateImageView(createInfo); }
+    ImageViewId ImplDevice::CreateImageView(const ImageViewCreateInfo& createInfo)
+    {
+        ImageResource& imageRsrc = _resources.images.At(createInfo.image);
+        ImageMetadata& imageMetadata = _resources.images.Metadata(createInfo.image);
+
+        std::lock_guard<std::mutex> lock(_imageViewMutex);
+
+        for (ImageViewCacheEntry& entry : imageMetadata.views) {
+            if (entry.createInfo == createInfo) {
+                _resources.imageViews.Metadata(entry.imageView).refCount += 1;
+                return entry.imageView;
+            }
+        }
+
+        uint32_t viewSlot = _resources.imageViews.Allocate();
+        if (viewSlot == INVALID_RESOURCE_ID) {
+            LogMessage("Out of image view slots, increase ResourceCountInfo::imageCount");
+            return INVALID_RESOURCE_ID;
+        }
+        ImageViewResource newImageView = {};
+        newImageView.imageView = CreateVkImageView(imageRsrc.image, createInfo);
+
+        _resources.imageViews.At(viewSlot) = newImageView;
+        _resources.imageViews.Metadata(viewSlot) = { .createInfo = createInfo, .refCount = 1, .retired = false };
+
+        WriteImageViewDescriptors(viewSlot, newImageView.imageView, imageMetadata.createInfo.usageFlags);
+
+        imageMetadata.views.push_back({ .createInfo = createInfo, .imageView = viewSlot });
+
+        return viewSlot;
+    }
+
+    VkImageView ImplDevice::CreateVkImageView(VkImage image, const ImageViewCreateInfo& createInfo)
+    {
+        VkImageViewCreateInfo vkImageViewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .image = image,
+            .viewType = static_cast<VkImageViewType>(createInfo.viewType),
+            .format = static_cast<VkFormat>(createInfo.format),
+            .components = {
+                .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+                .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+                .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+                .a = VK_COMPONENT_SWIZZLE_IDENTITY
+            },
+            .subresourceRange = {
+                .aspectMask = AspectFromFormat(createInfo.format),
+                .baseMipLevel = createInfo.subresource.baseLevel,
+                .levelCount = createInfo.subresource.numLevels,
+                .baseArrayLayer = createInfo.subresource.baseLayer,
+                .layerCount = createInfo.subresource.numLayers
+            }
+        };
+
+        VkImageView imageView = VK_NULL_HANDLE;
+        ErrorCheck(vkCreateImageView(_vkDevice, &vkImageViewInfo, nullptr, &imageView));
+        return imageView;
+    }
+
+    void ImplDevice::WriteImageViewDescriptors(ImageViewId imageView, VkImageView vkImageView, ImageUsageFlags usageFlags)
+    {
+        if (usageFlags & ImageUsageFlag::STORAGE) {
+            LogMessage("Create storage view", false);
+            WriteDescriptor({
+                .binding = WilloRHI_STORAGE_IMAGE_BINDING,
+                .id = imageView,
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .imageInfo = {
+                    .sampler = VK_NULL_HANDLE,
+                    .imageView = vkImageView,
+                    .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+                }
+            });
+        }
+
+        if (usageFlags & ImageUsageFlag::SAMPLED) {
+            LogMessage("Create sampling view", false);
+            WriteDescriptor({
+                .binding = WilloRHI_SAMPLED_IMAGE_BINDING,
+                .id = imageView,
+                .type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                .imageInfo = {
+                    .sampler = VK_NULL_HANDLE,
+                    .imageView = vkImageView,
+                    .imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL
+                }
+            });
+        }
+    }
+
+    SamplerId Device::CreateSampler(const SamplerCreateInfo& createInfo) {
+        return impl->CreateSampler(createInfo); }
+    SamplerId ImplDevice::CreateSampler(const SamplerCreateInfo& createInfo)
+    {
+        // held through creation so two threads asking for the same new sampler don't both create it
+        std::lock_guard<std::mutex> lock(_samplerCacheMutex);
+
+        auto cached = _samplerCache.find(createInfo);
+        if (cached != _samplerCache.end()) {
+            cached->second.refCount += 1;
+            return cached->second.sampler;
+        }
+
+        SamplerResource newSampler = {};
+        uint32_t samplerSlot = _resources.samplers.Allocate();
+        if (samplerSlot == INVALID_RESOURCE_ID) {
+            LogMessage("Out of sampler slots, increase ResourceCountInfo::samplerCount");
+            return INVALID_RESOURCE_ID;
+        }
+
+        VkSamplerReductionModeCreateInfo vkReductionMode = {
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO,
+            .pNext = nullptr,
+            .reductionMode = static_cast<VkSamplerReductionMode>(createInfo.reductionMode)
+        };
+
+        VkSamplerCreateInfo vkSamplerInfo = {
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .magFilter = static_cast<VkFilter>(createInfo.magFilter),
+            .minFilter = static_cast<VkFilter>(createInfo.minFilter),
+            .mipmapMode = static_cast<VkSamplerMipmapMode>(createInfo.mipFilter),
+            .addressModeU = static_cast<VkSamplerAddressMode>(createInfo.addressModeU),
+            .addressModeV = static_cast<VkSamplerAddressMode>(createInfo.addressModeV),
+            .addressModeW = static_cast<VkSamplerAddressMode>(createInfo.addressModeW),
+            .mipLodBias = createInfo.lodBias,
+            .anisotropyEnable = createInfo.anisotropyEnable,
+            .maxAnisotropy = createInfo.maxAnisotropy,
+            .compareEnable = createInfo.compareOpEnable,
+            .compareOp = static_cast<VkCompareOp>(createInfo.compareOp),
+            .minLod = createInfo.minLod,
+            .maxLod = createInfo.maxLod,
+            .borderColor = static_cast<VkBorderColor>(createInfo.borderColour),
+            .unnormalizedCoordinates = createInfo.unnormalizedCoordinates
+        };
+
+        ErrorCheck(vkCreateSampler(_vkDevice, &vkSamplerInfo, nullptr, &newSampler.sampler));
+
+        _resources.samplers.At(samplerSlot) = newSampler;
+        _resources.samplers.Metadata(samplerSlot).createInfo = createInfo;
+
+        WriteDescriptor({
+            .binding = WilloRHI_SAMPLER_BINDING,
+            .id = samplerSlot,
+            .type = VK_DESCRIPTOR_TYPE_SAMPLER,
+            .imageInfo = {
+                .sampler = newSampler.sampler,
+                .imageView = VK_NULL_HANDLE,
+                .imageLayout = VK_IMAGE_LAYOUT_UNDEFINED
+            }
+        });
+
+        _samplerCache.insert({ createInfo, SamplerCacheEntry{ .sampler = samplerSlot, .refCount = 1 } });
+
+        return samplerSlot;
+    }
+
+    void* Device::GetBufferPointer(BufferId buffer) { return impl->GetBufferPointer(buffer); }
+    void* ImplDevice::GetBufferPointer(BufferId buffer) {
+        if (!_resources.buffers.IsValid(buffer)) {
+            LogMessage("Stale or invalid buffer " + std::to_string(buffer));
+            return nullptr;
+        }
+
+        BufferMetadata& rsrc = _resources.buffers.Metadata(buffer);
+        if (!rsrc.isMapped) {
+            LogMessage("Buffer " + std::to_string(buffer) + " is not mapped");
+            return nullptr;
+        }
+        return rsrc.mappedAddress;
+    }
+
+    void* Device::GetImagePointer(ImageId image) { return impl->GetImagePointer(image); }
+    void* ImplDevice::GetImagePointer(ImageId image) {
+        if (!_resources.images.IsValid(image)) {
+            LogMessage("Stale or invalid image " + std::to_string(image));
+            return nullptr;
+        }
+
+        ImageMetadata& rsrc = _resources.images.Metadata(image);
+        if (!rsrc.isMapped) {
+            LogMessage("Image " + std::to_string(image) + " is not mapped");
+            return nullptr;
+        }
+        return rsrc.mappedAddress;
+    }
+
+    void Device::FlushMappedRanges(uint32_t numRanges, const MappedRange* ranges) {
+        impl->FlushMappedRanges(numRanges, ranges); }
+    void ImplDevice::FlushMappedRanges(uint32_t numRanges, const MappedRange* ranges) {
+        SyncMappedRanges(numRanges, ranges, true);
+    }
+
+    void Device::InvalidateMappedRanges(uint32_t numRanges, const MappedRange* ranges) {
+        impl->InvalidateMappedRanges(numRanges, ranges); }
+    void ImplDevice::InvalidateMappedRanges(uint32_t numRanges, const MappedRange* ranges) {
+        SyncMappedRanges(numRanges, ranges, false);
+    }
+
+    void ImplDevice::SyncMappedRanges(uint32_t numRanges, const MappedRange* ranges, bool flush)
+    {
+        std::vector<VmaAllocation> allocations;
+        std::vector<VkDeviceSize> offsets;
+        std::vector<VkDeviceSize> sizes;
+        allocations.reserve(numRanges);
+        offsets.reserve(numRanges);
+        sizes.reserve(numRanges);
+
+        for (uint32_t i = 0; i < numRanges; i++) {
+            const MappedRange& range = ranges[i];
+            if (!_resources.buffers.IsValid(range.buffer)) {
+                LogMessage("Stale or invalid buffer " + std::to_string(range.buffer));
+                continue;
+            }
+
+            const BufferMetadata& metadata = _resources.buffers.Metadata(range.buffer);
+            if (!metadata.isMapped) {
+                LogMessage("Buffer " + std::to_string(range.buffer) + " is not mapped");
+                continue;
+            }
+
+            VmaAllocation allocation = metadata.allocation;
+            VkDeviceSize offset = range.offset;
+            VkDeviceSize size = range.size == WHOLE_SIZE ? metadata.createInfo.size - range.offset : range.size;
+
+            // small buffers are ranges of their block's allocation, imported host memory isn't mapped through vulkan at all
+            if (metadata.smallBufferBlock != nullptr) {
+                allocation = metadata.smallBufferBlock->allocation;
+                offset += _resources.buffers.At(range.buffer).offset;
+            } else if (allocation == VK_NULL_HANDLE) {
+                continue;
+            }
+
+            allocations.push_back(allocation);
+            offsets.push_back(offset);
+            sizes.push_back(size);
+        }
+
+        if (allocations.empty())
+            return;
+
+        // vma skips coherent memory and rounds the rest out to nonCoherentAtomSize
+        if (flush)
+            ErrorCheck(vmaFlushAllocations(_allocator, (uint32_t)allocations.size(), allocations.data(), offsets.data(), sizes.data()));
+        else
+            ErrorCheck(vmaInvalidateAllocations(_allocator, (uint32_t)allocations.size(), allocations.data(), offsets.data(), sizes.data()));
+    }
+
+    bool Device::WriteImage(const ImageWriteInfo& writeInfo) { return impl->WriteImage(writeInfo); }
+    bool ImplDevice::WriteImage(const ImageWriteInfo& writeInfo)
+    {
+        if (_hostImageCopy.pfnCopyMemoryToImage == nullptr) {
+            LogMessage("Writing images from the host needs VK_EXT_host_image_copy");
+            return false;
+        }
+
+        if (!_resources.images.IsValid(writeInfo.image)) {
+            LogMessage("Write to stale or invalid image " + std::to_string(writeInfo.image));
+            return false;
+        }
+
+        ImageResource& rsrc = _resources.images.At(writeInfo.image);
+        const ImageCreateInfo& createInfo = _resources.images.Metadata(writeInfo.image).createInfo;
+        if (!(createInfo.usageFlags & ImageUsageFlag::HOST_TRANSFER)) {
+            LogMessage("Write to image " + std::to_string(writeInfo.image) + " without HOST_TRANSFER usage");
+            return false;
+        }
+
+        auto isIn = [](const std::vector<VkImageLayout>& layouts, VkImageLayout layout) {
+            return std::find(layouts.begin(), layouts.end(), layout) != layouts.end(); };
+
+        // a copy region covers exactly one aspect, depth/stencil formats have to say which
+        VkImageAspectFlags copyAspect = writeInfo.aspect ? static_cast<VkImageAspectFlags>(writeInfo.aspect) : rsrc.aspect;
+        if ((copyAspect & (copyAspect - 1)) != 0 || (copyAspect & ~rsrc.aspect) != 0) {
+            LogMessage("Write to image " + std::to_string(writeInfo.image) + " needs ImageWriteInfo::aspect set to one aspect of its format");
+            return false;
+        }
+
+        // layouts are tracked per image, so transitions cover all of it
+        VkImageSubresourceRange wholeImage = {
+            .aspectMask = rsrc.aspect,
+            .baseMipLevel = 0,
+            .levelCount = VK_REMAINING_MIP_LEVELS,
+            .baseArrayLayer = 0,
+            .layerCount = VK_REMAINING_ARRAY_LAYERS
+        };
+
+        VkImageLayout oldLayout = rsrc.currentLayout;
+        if (oldLayout != _hostImageCopy.copyLayout) {
+            if (oldLayout != VK_IMAGE_LAYOUT_UNDEFINED && !isIn(_hostImageCopy.srcLayouts, oldLayout)) {
+                LogMessage("Image " + std::to_string(writeInfo.image) + " is in a layout the host can't transition from");
+                return false;
+            }
+
+            VkHostImageLayoutTransitionInfoEXT transitionInfo = {
+                .sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+                .pNext = nullptr,
+                .image = rsrc.image,
+                .oldLayout = oldLayout,
+                .newLayout = _hostImageCopy.copyLayout,
+                .subresourceRange = wholeImage
+            };
+            ErrorCheck(_hostImageCopy.pfnTransitionImageLayout(_vkDevice, 1, &transitionInfo));
+        }
+
+        VkMemoryToImageCopyEXT region = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT,
+            .pNext = nullptr,
+            .pHostPointer = writeInfo.data,
+            .memoryRowLength = writeInfo.rowLength,
+            .memoryImageHeight = writeInfo.imageHeight,
+            .imageSubresource = {
+                .aspectMask = copyAspect,
+                .mipLevel = writeInfo.subresource.level,
+                .baseArrayLayer = writeInfo.subresource.baseLayer,
+                .layerCount = writeInfo.subresource.numLayers
+            },
+            .imageOffset = {writeInfo.offset.x, writeInfo.offset.y, writeInfo.offset.z},
+            .imageExtent = {writeInfo.extent.width, writeInfo.extent.height, writeInfo.extent.depth}
+        };
+
+        VkCopyMemoryToImageInfoEXT copyInfo = {
+            .sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT,
+            .pNext = nullptr,
+            .flags = 0,
+            .dstImage = rsrc.image,
+            .dstImageLayout = _hostImageCopy.copyLayout,
+            .regionCount = 1,
+            .pRegions = &region
+        };
+        ErrorCheck(_hostImageCopy.pfnCopyMemoryToImage(_vkDevice, &copyInfo));
+
+        // host transitions go from a copy source layout to a copy destination one, anything else is left to the next barrier
+        VkImageLayout finalLayout = static_cast<VkImageLayout>(writeInfo.finalLayout);
+        if (finalLayout != _hostImageCopy.copyLayout && isIn(_hostImageCopy.srcLayouts, _hostImageCopy.copyLayout)
+            && isIn(_hostImageCopy.dstLayouts, finalLayout)) {
+            VkHostImageLayoutTransitionInfoEXT transitionInfo = {
+                .sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+                .pNext = nullptr,
+                .image = rsrc.image,
+                .oldLayout = _hostImageCopy.copyLayout,
+                .newLayout = finalLayout,
+                .subresourceRange = wholeImage
+            };
+            ErrorCheck(_hostImageCopy.pfnTransitionImageLayout(_vkDevice, 1, &transitionInfo));
+            rsrc.currentLayout = finalLayout;
+        } else {
+            rsrc.currentLayout = _hostImageCopy.copyLayout;
+        }
+
+        // host writes are visible to anything submitted afterwards, and no queue owns the contents any more
+        rsrc.currentPipelineStage = VK_PIPELINE_STAGE_2_NONE;
+        rsrc.currentAccessFlags = VK_ACCESS_2_NONE;
+        rsrc.ownerQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+        {
+            std::lock_guard<std::mutex> ownershipLock(_ownershipMutex);
+            rsrc.owner = {};
+        }
+
+        return true;
+    }
+
+    void Device::DestroyBuffer(BufferId buffer) { impl->DestroyBuffer(buffer); }
+    void ImplDevice::DestroyBuffer(BufferId buffer) {
+        std::lock_guard<std::mutex> lock(_retirementMutex);
+        GetRetirementBatch().buffers.push_back(buffer);
+    }
+
+    void Device::DestroyImage(ImageId image) { impl->DestroyImage(image); }
+    void ImplDevice::DestroyImage(ImageId image) {
+        std::vector<ImageViewCacheEntry> views;
+        {
+            // views go with their image regardless of outstanding references
+            // later DestroyImageView calls on them see they're retired and do nothing
+            std::lock_guard<std::mutex> viewLock(_imageViewMutex);
+            views.swap(_resources.images.Metadata(image).views);
+            for (const ImageViewCacheEntry& entry : views)
+                _resources.imageViews.Metadata(entry.imageView).retired = true;
+        }
+
+        std::lock_guard<std::mutex> lock(_retirementMutex);
+        RetiredResources& batch = GetRetirementBatch();
+        for (const ImageViewCacheEntry& entry : views)
+            batch.imageViews.push_back(entry.imageView);
+        batch.images.push_back(image);
+    }
+
+    void Device::DestroyImageView(ImageViewId imageView) { impl->DestroyImageView(imageView); }
+    void ImplDevice::DestroyImageView(ImageViewId imageView) {
+        {
+            std::lock_guard<std::mutex> viewLock(_imageViewMutex);
+
+            // already freed, its slot may even belong to another view by now
+            if (!_resources.imageViews.IsValid(imageView))
+                return;
+
+            // the view's own reference count and retirement come first, they don't depend on the image
+            ImageViewMetadata& viewMetadata = _resources.imageViews.Metadata(imageView);
+            if (viewMetadata.retired)
+                return;
+
+            viewMetadata.refCount -= 1;
+            if (viewMetadata.refCount > 0)
+                return;
+            viewMetadata.retired = true;
+
+            // then its entry in the parent's cache, if the image is still around to have one
+            ImageId image = viewMetadata.createInfo.image;
+            if (_resources.images.IsValid(image)) {
+                std::vector<ImageViewCacheEntry>& views = _resources.images.Metadata(image).views;
+                std::erase_if(views, [imageView](const ImageViewCacheEntry& view) { return view.imageView == imageView; });
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(_retirementMutex);
+        GetRetirementBatch().imageViews.push_back(imageView);
+    }
+
+    void Device::DestroySampler(SamplerId sampler) { impl->DestroySampler(sampler); }
+    void ImplDevice::DestroySampler(SamplerId sampler) {
+        {
+            std::lock_guard<std::mutex> cacheLock(_samplerCacheMutex);
+
+            auto cached = _samplerCache.find(_resources.samplers.Metadata(sampler).createInfo);
+            if (cached != _samplerCache.end() && cached->second.sampler == sampler) {
+                cached->second.refCount -= 1;
+                if (cached->second.refCount > 0)
+                    return;
+                _samplerCache.erase(cached);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(_retirementMutex);
+        GetRetirementBatch().samplers.push_back(sampler);
+    }
+
+    MemoryPoolId Device::CreateMemoryPool(const MemoryPoolCreateInfo& createInfo) {
+        return impl->CreateMemoryPool(createInfo); }
+    MemoryPoolId ImplDevice::CreateMemoryPool(const MemoryPoolCreateInfo& createInfo)
+    {
+        VmaAllocationCreateFlags allocFlags = ToVmaAllocationFlags(createInfo.allocationFlags)
+            & ~VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+        VmaAllocationCreateInfo allocationCreateInfo = {
+            .flags = allocFlags,
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = RequiredMemoryFlags(createInfo.allocationFlags),
+            .preferredFlags = {},
+            .memoryTypeBits = std::numeric_limits<uint32_t>::max(),
+            .pool = nullptr,
+            .pUserData = nullptr,
+            .priority = createInfo.priority
+        };
+
+        // the memory type is found for a representative resource, vma needs one up front
+        uint32_t memoryTypeIndex = 0;
+        VkResult result = VK_SUCCESS;
+        if (createInfo.resourceType == MemoryPoolResourceType::IMAGE) {
+            VkImageCreateInfo imageInfo = ToVkImageCreateInfo({
+                .dimensions = 2,
+                .size = {256, 256, 1},
+                .numLevels = 1,
+                .numLayers = 1,
+                .format = createInfo.imageFormat,
+                .usageFlags = createInfo.imageUsage
+            });
+            result = vmaFindMemoryTypeIndexForImageInfo(_allocator, &imageInfo, &allocationCreateInfo, &memoryTypeIndex);
+        } else {
+            VkBufferCreateInfo bufferInfo = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = 0,
+                .size = 65536,
+                .usage = BufferUsageFromFlags(BufferUsageFlag::STORAGE | BufferUsageFlag::TRANSFER_SRC | BufferUsageFlag::TRANSFER_DST
+                    | BufferUsageFlag::VERTEX | BufferUsageFlag::INDEX | BufferUsageFlag::INDIRECT),
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                .queueFamilyIndexCount = 0,
+                .pQueueFamilyIndices = nullptr
+            };
+            result = vmaFindMemoryTypeIndexForBufferInfo(_allocator, &bufferInfo, &allocationCreateInfo, &memoryTypeIndex);
+        }
+
+        if (result != VK_SUCCESS) {
+            ErrorCheck(result);
+            return INVALID_RESOURCE_ID;
+        }
+
+        VmaPoolCreateInfo poolInfo = {
+            .memoryTypeIndex = memoryTypeIndex,
+            .flags = createInfo.linear ? VMA_POOL_CREATE_LINEAR_ALGORITHM_BIT : 0u,
+            .blockSize = createInfo.blockSize,
+            .minBlockCount = createInfo.minBlockCount,
+            .maxBlockCount = createInfo.maxBlockCount,
+            .priority = createInfo.priority,
+            .minAllocationAlignment = 0,
+            .pMemoryAllocateNext = nullptr
+        };
+
+        VmaPool pool = VK_NULL_HANDLE;
+        result = vmaCreatePool(_allocator, &poolInfo, &pool);
+        if (result != VK_SUCCESS) {
+            ErrorCheck(result);
+            return INVALID_RESOURCE_ID;
+        }
+
+        std::lock_guard<std::mutex> lock(_memoryPoolMutex);
+
+        uint32_t poolIndex = 0;
+        while (poolIndex < _memoryPools.size() && _memoryPools[poolIndex].pool != VK_NULL_HANDLE)
+            poolIndex++;
+
+        if (poolIndex == _memoryPools.size())
+            _memoryPools.push_back({});
+
+        MemoryPoolEntry& entry = _memoryPools[poolIndex];
+        entry.pool = pool;
+        entry.memoryTypeIndex = memoryTypeIndex;
+        entry.destroyed = false;
+
+        MemoryPoolId poolId = MakeResourceId(poolIndex, entry.generation);
+
+        LogMessage("Created " + std::string(createInfo.linear ? "linear " : "") + "memory pool " + std::to_string(poolId)
+            + " in memory type " + std::to_string(memoryTypeIndex), false);
+
+        return poolId;
+    }
+
+    void Device::DestroyMemoryPool(MemoryPoolId memoryPool) { impl->DestroyMemoryPool(memoryPool); }
+    void ImplDevice::DestroyMemoryPool(MemoryPoolId memoryPool) {
+        {
+            std::lock_guard<std::mutex> lock(_memoryPoolMutex);
+            MemoryPoolEntry* entry = FindMemoryPool(memoryPool);
+            if (entry == nullptr || entry->destroyed) {
+                LogMessage("Tried to destroy unknown memory pool " + std::to_string(memoryPool));
+                return;
+            }
+            entry->destroyed = true;
+        }
+
+        std::lock_guard<std::mutex> lock(_retirementMutex);
+        GetRetirementBatch().memoryPools.push_back(memoryPool);
+    }
+
+    MemoryPoolEntry* ImplDevice::FindMemoryPool(MemoryPoolId memoryPool)
+    {
+        uint32_t index = ResourceIndex(memoryPool);
+        if (memoryPool == INVALID_RESOURCE_ID || index >= _memoryPools.size())
+            return nullptr;
+
+        MemoryPoolEntry& entry = _memoryPools[index];
+        if (entry.pool == VK_NULL_HANDLE || entry.generation != ResourceGeneration(memoryPool))
+            return nullptr;
+
+        return &entry;
+    }
+
+    VmaPool ImplDevice::GetMemoryPool(MemoryPoolId memoryPool, uint32_t* memoryTypeIndex)
+    {
+        if (memoryPool == INVALID_RESOURCE_ID)
+            return VK_NULL_HANDLE;
+
+        std::lock_guard<std::mutex> lock(_memoryPoolMutex);
+        MemoryPoolEntry* entry = FindMemoryPool(memoryPool);
+        if (entry == nullptr || entry->destroyed) {
+            LogMessage("Unknown memory pool " + std::to_string(memoryPool) + ", allocating from the default pools");
+            return VK_NULL_HANDLE;
+        }
+
+        if (memoryTypeIndex != nullptr)
+            *memoryTypeIndex = entry->memoryTypeIndex;
+        return entry->pool;
+    }
+
+    bool Device::Defragment(Queue queue, const DefragmentationInfo& info) { return impl->Defragment(queue, info); }
+    bool ImplDevice::Defragment(Queue queue, const DefragmentationInfo& info)
+    {
+        std::lock_guard<std::mutex> lock(_defragmentation.mutex);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        if (_defragmentation.context == VK_NULL_HANDLE) {
+            VmaDefragmentationInfo defragmentationInfo = {
+                .flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT,
+                .pool = GetMemoryPool(info.memoryPool),
+                .maxBytesPerPass = info.maxBytesPerPass,
+                .maxAllocationsPerPass = info.maxAllocationsPerPass,
+                .pfnBreakCallback = nullptr,
+                .pBreakCallbackUserData = nullptr
+            };
+
+            VkResult result = vmaBeginDefragmentation(_allocator, &defragmentationInfo, &_defragmentation.context);
+            if (result != VK_SUCCESS) {
+                ErrorCheck(result);
+                return true;
+            }
+        }
+
+        // the previous pass moves on as its copies, and then everything still using the old handles, finish
+        // switching here rather than in a submit keeps it clear of command lists being recorded on other threads
+        if (_defragmentation.copiesPending) {
+            CommitDefragmentationMoves();
+            return false;
+        }
+
+        if (_defragmentation.retiring) {
+            if (_defragmentation.retireValues.empty()) {
+                _defragmentation.retireValues = SubmittedTimelineValues();
+                return false;
+            }
+            if (!TimelineValuesReached(_defragmentation.retireValues))
+                return false;
+            if (EndDefragmentationPass())
+                return true;
+        }
+
+        // VK_SUCCESS here means there is nothing left worth moving
+        VkResult result = vmaBeginDefragmentationPass(_allocator, _defragmentation.context, &_defragmentation.passInfo);
+        if (result != VK_INCOMPLETE) {
+            ErrorCheck(result);
+            EndDefragmentation();
+            return true;
+        }
+
+        uint32_t queueFamily = queue.impl->_vkQueueIndex;
+        uint32_t numMoved = 0;
+
+        for (uint32_t i = 0; i < _defragmentation.passInfo.moveCount; i++) {
+            VmaDefragmentationMove& move = _defragmentation.passInfo.pMoves[i];
+
+            // a pass with no moves at all counts as vma having nothing left to do, so always take the first
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            bool overBudget = numMoved > 0 && elapsed.count() > info.timeBudgetMs;
+
+            VmaAllocationInfo allocationInfo = {};
+            vmaGetAllocationInfo(_allocator, move.srcAllocation, &allocationInfo);
+
+            bool moved = false;
+            if (!overBudget) {
+                switch (AllocationTagOwner(allocationInfo.pUserData))
+                {
+                    case AllocationOwner::BUFFER:
+                        moved = PrepareBufferMove(AllocationTagId(allocationInfo.pUserData), move.dstTmpAllocation, queueFamily);
+                        break;
+                    case AllocationOwner::IMAGE:
+                        moved = PrepareImageMove(AllocationTagId(allocationInfo.pUserData), move.dstTmpAllocation, queueFamily);
+                        break;
+                    default:
+                        // internal buffers and small buffer blocks stay where they are
+                        break;
+                }
+            }
+
+            if (moved)
+                numMoved++;
+            else
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+        }
+
+        if (numMoved == 0)
+            return EndDefragmentationPass();
+
+        // the copies wait on everything already submitted to other queues, work on this one is ordered by the barriers
+        CommandSubmitInfo submitInfo = {};
+        {
+            std::lock_guard<std::mutex> queueLock(_queueMutex);
+            for (ImplQueue* other : _queues) {
+                uint64_t submitted = other->_timelineValue.load(std::memory_order_acquire);
+                if (other != queue.impl.get() && submitted != 0)
+                    submitInfo.waitTimelineSemaphores.push_back({ other->_submissionTimeline, submitted });
+            }
+        }
+
+        CommandList commandList = queue.GetCmdList();
+        commandList.Begin();
+        RecordDefragmentationCopies(static_cast<VkCommandBuffer>(commandList.GetNativeHandle()));
+        commandList.End();
+
+        submitInfo.commandLists.push_back(commandList);
+        queue.Submit(submitInfo);
+
+        // can include another thread's submission on the same queue, waiting a little longer is harmless
+        _defragmentation.copySemaphore = static_cast<VkSemaphore>(queue.impl->_submissionTimeline.GetNativeHandle());
+        _defragmentation.copyValue = queue.impl->_timelineValue.load(std::memory_order_acquire);
+        _defragmentation.copyQueueFamily = queueFamily;
+        _defragmentation.copiesPending = true;
+
+        LogMessage("Defragmentation pass moving " + std::to_string(numMoved) + " of "
+            + std::to_string(_defragmentation.passInfo.moveCount) + " allocations", false);
+
+        return false;
+    }
+
+    bool ImplDevice::PrepareBufferMove(BufferId buffer, VmaAllocation destination, uint32_t queueFamily)
+    {
+        if (!_resources.buffers.IsValid(buffer))
+            return false;
 
-            descWrites.push_back({
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .pNext = nullptr,
-                .dstSet = _globalDescriptors.descriptorSet,
-                .dstBinding = WilloRHI_STORAGE_IMAGE_BINDING,
-                .dstArrayElement = (uint32_t)viewSlot,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                .pImageInfo = &storageImageDescriptor,
-                .pBufferInfo = nullptr,
-                .pTexelBufferView = nullptr
-            });
+        BufferResource& rsrc = _resources.buffers.At(buffer);
+        BufferMetadata& metadata = _resources.buffers.Metadata(buffer);
+        const BufferCreateInfo& createInfo = metadata.createInfo;
+
+        // the app holds pointers into mapped memory, and the copy needs both transfer usages
+        BufferUsageFlags copyUsage = BufferUsageFlag::TRANSFER_SRC | BufferUsageFlag::TRANSFER_DST;
+        if (metadata.isMapped || metadata.smallBufferBlock != nullptr || (createInfo.usageFlags & copyUsage) != copyUsage)
+            return false;
+
+        // moving between queue families would need an ownership transfer first
+        if (!rsrc.concurrent && rsrc.ownerQueueFamily != VK_QUEUE_FAMILY_IGNORED && rsrc.ownerQueueFamily != queueFamily)
+            return false;
+
+        VkBufferCreateInfo vkBufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .size = createInfo.size,
+            .usage = BufferUsageFromFlags(createInfo.usageFlags),
+            .sharingMode = rsrc.concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = rsrc.concurrent ? (uint32_t)_sharedQueueFamilies.size() : 0,
+            .pQueueFamilyIndices = rsrc.concurrent ? _sharedQueueFamilies.data() : nullptr
+        };
+
+        VkBuffer newBuffer = VK_NULL_HANDLE;
+        if (vkCreateBuffer(_vkDevice, &vkBufferInfo, nullptr, &newBuffer) != VK_SUCCESS)
+            return false;
+
+        if (vmaBindBufferMemory(_allocator, destination, newBuffer) != VK_SUCCESS) {
+            vkDestroyBuffer(_vkDevice, newBuffer, nullptr);
+            return false;
         }
 
-        if (imageRsrc.createInfo.usageFlags & ImageUsageFlag::SAMPLED) {
-            LogMessage("Create sampling view", false);
-            VkDescriptorImageInfo sampledImageDescriptor = {
-                .sampler = VK_NULL_HANDLE,
-                .imageView = newImageView.imageView,
-                .imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL
-            };
+        // the resource keeps its old handle until CommitDefragmentationMoves, once the copy has finished
+        _defragmentation.bufferCopies.push_back({ .buffer = buffer, .src = rsrc.buffer, .dst = newBuffer, .size = createInfo.size });
+        return true;
+    }
 
-            descWrites.push_back({
-                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-                .pNext = nullptr,
-                .dstSet = _globalDescriptors.descriptorSet,
-                .dstBinding = WilloRHI_SAMPLED_IMAGE_BINDING,
-                .dstArrayElement = (uint32_t)viewSlot,
-                .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
-                .pImageInfo = &sampledImageDescriptor,
-                .pBufferInfo = nullptr,
-                .pTexelBufferView = nullptr
-            });
+    bool ImplDevice::PrepareImageMove(ImageId image, VmaAllocation destination, uint32_t queueFamily)
+    {
+        if (!_resources.images.IsValid(image))
+            return false;
+
+        ImageResource& rsrc = _resources.images.At(image);
+        ImageMetadata& metadata = _resources.images.Metadata(image);
+
+        ImageUsageFlags copyUsage = ImageUsageFlag::TRANSFER_SRC | ImageUsageFlag::TRANSFER_DST;
+        if (metadata.isMapped || (metadata.createInfo.usageFlags & copyUsage) != copyUsage)
+            return false;
+
+        if (rsrc.ownerQueueFamily != VK_QUEUE_FAMILY_IGNORED && rsrc.ownerQueueFamily != queueFamily)
+            return false;
+
+        VkImageCreateInfo vkImageInfo = ToVkImageCreateInfo(metadata.createInfo);
+
+        VkImage newImage = VK_NULL_HANDLE;
+        if (vkCreateImage(_vkDevice, &vkImageInfo, nullptr, &newImage) != VK_SUCCESS)
+            return false;
+
+        if (vmaBindImageMemory(_allocator, destination, newImage) != VK_SUCCESS) {
+            vkDestroyImage(_vkDevice, newImage, nullptr);
+            return false;
         }
 
-        vkUpdateDescriptorSets(_vkDevice, (uint32_t)descWrites.size(), descWrites.data(), 0, nullptr);
+        _defragmentation.imageCopies.push_back({
+            .image = image,
+            .src = rsrc.image,
+            .dst = newImage,
+            .layout = rsrc.currentLayout,
+            .aspect = rsrc.aspect,
+            .createInfo = metadata.createInfo
+        });
 
-        return viewSlot;
+        return true;
     }
 
-    SamplerId Device::CreateSampler(const SamplerCreateInfo& createInfo) {
-        return impl->CreateSampler(createInfo); }
-    SamplerId ImplDevice::CreateSampler(const SamplerCreateInfo& createInfo)
+    void ImplDevice::RecordDefragmentationCopies(VkCommandBuffer commandBuffer)
     {
-        SamplerResource newSampler = {};
-        uint32_t samplerSlot = _resources.samplers.Allocate();
-        newSampler.createInfo = createInfo;
+        std::vector<VkImageMemoryBarrier2> imageBarriers;
+
+        for (const Defragmentation::ImageCopy& copy : _defragmentation.imageCopies) {
+            if (copy.layout == VK_IMAGE_LAYOUT_UNDEFINED)
+                continue;
+
+            VkImageSubresourceRange wholeImage = {
+                .aspectMask = copy.aspect,
+                .baseMipLevel = 0,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .baseArrayLayer = 0,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS
+            };
 
-        VkSamplerReductionModeCreateInfo vkReductionMode = {
-            .sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO,
+            imageBarriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .pNext = nullptr,
+                .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT,
+                .oldLayout = copy.layout,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = copy.src,
+                .subresourceRange = wholeImage
+            });
+
+            imageBarriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .pNext = nullptr,
+                .srcStageMask = VK_PIPELINE_STAGE_2_NONE,
+                .srcAccessMask = VK_ACCESS_2_NONE,
+                .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                .dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = copy.dst,
+                .subresourceRange = wholeImage
+            });
+        }
+
+        VkMemoryBarrier2 memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
             .pNext = nullptr,
-            .reductionMode = static_cast<VkSamplerReductionMode>(createInfo.reductionMode)
+            .srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT
         };
 
-        VkSamplerCreateInfo vkSamplerInfo = {
-            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        VkDependencyInfo dependency = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
             .pNext = nullptr,
-            .flags = 0,
-            .magFilter = static_cast<VkFilter>(createInfo.magFilter),
-            .minFilter = static_cast<VkFilter>(createInfo.minFilter),
-            .mipmapMode = static_cast<VkSamplerMipmapMode>(createInfo.mipFilter),
-            .addressModeU = static_cast<VkSamplerAddressMode>(createInfo.addressModeU),
-            .addressModeV = static_cast<VkSamplerAddressMode>(createInfo.addressModeV),
-            .addressModeW = static_cast<VkSamplerAddressMode>(createInfo.addressModeW),
-            .mipLodBias = createInfo.lodBias,
-            .anisotropyEnable = createInfo.anisotropyEnable,
-            .maxAnisotropy = createInfo.maxAnisotropy,
-            .compareEnable = createInfo.compareOpEnable,
-            .compareOp = static_cast<VkCompareOp>(createInfo.compareOp),
-            .minLod = createInfo.minLod,
-            .maxLod = createInfo.maxLod,
-            .borderColor = static_cast<VkBorderColor>(createInfo.borderColour),
-            .unnormalizedCoordinates = createInfo.unnormalizedCoordinates
+            .dependencyFlags = 0,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &memoryBarrier,
+            .bufferMemoryBarrierCount = 0,
+            .pBufferMemoryBarriers = nullptr,
+            .imageMemoryBarrierCount = (uint32_t)imageBarriers.size(),
+            .pImageMemoryBarriers = imageBarriers.data()
         };
 
-        ErrorCheck(vkCreateSampler(_vkDevice, &vkSamplerInfo, nullptr, &newSampler.sampler));
+        vkCmdPipelineBarrier2(commandBuffer, &dependency);
 
-        _resources.samplers.At(samplerSlot) = newSampler;
+        for (const Defragmentation::BufferCopy& copy : _defragmentation.bufferCopies) {
+            VkBufferCopy region = { .srcOffset = 0, .dstOffset = 0, .size = copy.size };
+            vkCmdCopyBuffer(commandBuffer, copy.src, copy.dst, 1, &region);
+        }
 
-        VkDescriptorImageInfo samplerDescriptor = {
-            .sampler = newSampler.sampler,
-            .imageView = nullptr,
-            .imageLayout = VK_IMAGE_LAYOUT_UNDEFINED
-        };
+        std::vector<VkImageCopy> regions;
+        imageBarriers.clear();
+
+        for (const Defragmentation::ImageCopy& copy : _defragmentation.imageCopies) {
+            if (copy.layout == VK_IMAGE_LAYOUT_UNDEFINED)
+                continue;
+
+            regions.clear();
+            for (uint32_t level = 0; level < copy.createInfo.numLevels; level++) {
+                VkImageSubresourceLayers subresource = {
+                    .aspectMask = copy.aspect,
+                    .mipLevel = level,
+                    .baseArrayLayer = 0,
+                    .layerCount = copy.createInfo.numLayers
+                };
+
+                regions.push_back({
+                    .srcSubresource = subresource,
+                    .srcOffset = {0, 0, 0},
+                    .dstSubresource = subresource,
+                    .dstOffset = {0, 0, 0},
+                    .extent = {
+                        std::max(copy.createInfo.size.width >> level, 1u),
+                        std::max(copy.createInfo.size.height >> level, 1u),
+                        std::max(copy.createInfo.size.depth >> level, 1u)
+                    }
+                });
+            }
+
+            vkCmdCopyImage(commandBuffer,
+                copy.src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                copy.dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                (uint32_t)regions.size(), regions.data());
 
-        VkWriteDescriptorSet descriptorWrite = {
-            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            // both back to where the app left it, the old image stays in use until the moves are committed
+            imageBarriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .pNext = nullptr,
+                .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                .srcAccessMask = VK_ACCESS_2_NONE,
+                .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                .newLayout = copy.layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = copy.src,
+                .subresourceRange = {
+                    .aspectMask = copy.aspect,
+                    .baseMipLevel = 0,
+                    .levelCount = VK_REMAINING_MIP_LEVELS,
+                    .baseArrayLayer = 0,
+                    .layerCount = VK_REMAINING_ARRAY_LAYERS
+                }
+            });
+
+            imageBarriers.push_back({
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .pNext = nullptr,
+                .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+                .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .newLayout = copy.layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = copy.dst,
+                .subresourceRange = {
+                    .aspectMask = copy.aspect,
+                    .baseMipLevel = 0,
+                    .levelCount = VK_REMAINING_MIP_LEVELS,
+                    .baseArrayLayer = 0,
+                    .layerCount = VK_REMAINING_ARRAY_LAYERS
+                }
+            });
+        }
+
+        memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
             .pNext = nullptr,
-            .dstSet = _globalDescriptors.descriptorSet,
-            .dstBinding = WilloRHI_SAMPLER_BINDING,
-            .dstArrayElement = (uint32_t)samplerSlot,
-            .descriptorCount = 1,
-            .descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER,
-            .pImageInfo = &samplerDescriptor,
-            .pBufferInfo = nullptr,
-            .pTexelBufferView = nullptr
+            .srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+            .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT
         };
 
-        vkUpdateDescriptorSets(_vkDevice, 1, &descriptorWrite, 0, nullptr);
+        dependency.imageMemoryBarrierCount = (uint32_t)imageBarriers.size();
+        dependency.pImageMemoryBarriers = imageBarriers.data();
 
-        return samplerSlot;
+        vkCmdPipelineBarrier2(commandBuffer, &dependency);
     }
 
-    void* Device::GetBufferPointer(BufferId buffer) { return impl->GetBufferPointer(buffer); }
-    void* ImplDevice::GetBufferPointer(BufferId buffer) {
-        BufferResource& rsrc = _resources.buffers.At(buffer);
-        if (!rsrc.isMapped) {
-            LogMessage("Buffer " + std::to_string(buffer) + " is not mapped");
-            return nullptr;
+    void ImplDevice::CommitDefragmentationMoves(bool force)
+    {
+        if (!_defragmentation.copiesPending)
+            return;
+
+        // work submitted before the copies finished has kept using the old handles, switching any earlier would
+        // repoint descriptors and addresses under work the copies still wait on
+        if (!force && _defragmentation.copySemaphore != VK_NULL_HANDLE) {
+            uint64_t gpuValue = 0;
+            ErrorCheck(vkGetSemaphoreCounterValue(_vkDevice, _defragmentation.copySemaphore, &gpuValue));
+            if (gpuValue < _defragmentation.copyValue)
+                return;
         }
-        return rsrc.mappedAddress;
+
+        uint32_t queueFamily = _defragmentation.copyQueueFamily;
+
+        // resources destroyed during the pass are still in their slots, retirement is held back until it ends
+        // the copies have finished, so nothing is left for a later release to wait on
+        std::lock_guard<std::mutex> ownershipLock(_ownershipMutex);
+        for (const Defragmentation::BufferCopy& copy : _defragmentation.bufferCopies) {
+            BufferResource& rsrc = _resources.buffers.At(copy.buffer);
+            BufferMetadata& metadata = _resources.buffers.Metadata(copy.buffer);
+
+            rsrc.buffer = copy.dst;
+            if (!rsrc.concurrent)
+                rsrc.ownerQueueFamily = queueFamily;
+            rsrc.owner = {};
+            rsrc.currentPipelineStage = VK_PIPELINE_STAGE_2_NONE;
+            rsrc.currentAccessFlags = VK_ACCESS_2_NONE;
+
+            VkBufferDeviceAddressInfo addressInfo = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                .pNext = nullptr,
+                .buffer = copy.dst
+            };
+
+            metadata.deviceAddress = vkGetBufferDeviceAddress(_vkDevice, &addressInfo);
+            WriteBufferAddress(copy.buffer, metadata.deviceAddress);
+
+            if (metadata.createInfo.usageFlags & BufferUsageFlag::STORAGE) {
+                WriteDescriptor({
+                    .binding = WilloRHI_STORAGE_BUFFER_BINDING,
+                    .id = copy.buffer,
+                    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                    .bufferInfo = {
+                        .buffer = copy.dst,
+                        .offset = 0,
+                        .range = copy.size
+                    }
+                });
+            }
+        }
+
+        std::lock_guard<std::mutex> viewLock(_imageViewMutex);
+        for (const Defragmentation::ImageCopy& copy : _defragmentation.imageCopies) {
+            ImageResource& rsrc = _resources.images.At(copy.image);
+            ImageMetadata& metadata = _resources.images.Metadata(copy.image);
+
+            // the copy left the new image in the layout the old one had then, work since may have moved the old one on
+            rsrc.image = copy.dst;
+            rsrc.ownerQueueFamily = queueFamily;
+            rsrc.owner = {};
+            rsrc.currentLayout = copy.layout;
+            rsrc.currentPipelineStage = VK_PIPELINE_STAGE_2_NONE;
+            rsrc.currentAccessFlags = VK_ACCESS_2_NONE;
+
+            // views keep their ids too, only the handles behind them change
+            for (const ImageViewCacheEntry& entry : metadata.views) {
+                ImageViewResource& view = _resources.imageViews.At(entry.imageView);
+                _defragmentation.oldImageViews.push_back(view.imageView);
+                view.imageView = CreateVkImageView(copy.dst, entry.createInfo);
+                WriteImageViewDescriptors(entry.imageView, view.imageView, metadata.createInfo.usageFlags);
+            }
+        }
+
+        // lists recorded before the switch still name the old handles, the next call takes what has been
+        // submitted by then as the point after which nothing can use them
+        _defragmentation.retiring = true;
+        _defragmentation.retireValues.clear();
+        _defragmentation.copiesPending = false;
+
+        LogMessage("Defragmentation moved " + std::to_string(_defragmentation.bufferCopies.size()) + " buffers and "
+            + std::to_string(_defragmentation.imageCopies.size()) + " images to their new memory", false);
     }
 
-    void* Device::GetImagePointer(ImageId image) { return impl->GetImagePointer(image); }
-    void* ImplDevice::GetImagePointer(ImageId image) {
-        ImageResource& rsrc = _resources.images.At(image);
-        if (!rsrc.isMapped) {
-            LogMessage("Image " + std::to_string(image) + " is not mapped");
-            return nullptr;
+    bool ImplDevice::EndDefragmentationPass()
+    {
+        // expects _defragmentation.mutex to be held and the old handles to no longer be referenced by anything
+        for (VkImageView imageView : _defragmentation.oldImageViews)
+            vkDestroyImageView(_vkDevice, imageView, nullptr);
+        for (const Defragmentation::ImageCopy& copy : _defragmentation.imageCopies)
+            vkDestroyImage(_vkDevice, copy.src, nullptr);
+        for (const Defragmentation::BufferCopy& copy : _defragmentation.bufferCopies)
+            vkDestroyBuffer(_vkDevice, copy.src, nullptr);
+
+        _defragmentation.oldImageViews.clear();
+        _defragmentation.imageCopies.clear();
+        _defragmentation.bufferCopies.clear();
+        _defragmentation.retiring = false;
+        _defragmentation.retireValues.clear();
+
+        // the old handles are gone, so vma can release the memory they were bound to
+        VkResult result = vmaEndDefragmentationPass(_allocator, _defragmentation.context, &_defragmentation.passInfo);
+
+        if (result == VK_INCOMPLETE)
+            return false;
+
+        EndDefragmentation();
+        return true;
+    }
+
+    void ImplDevice::EndDefragmentation()
+    {
+        VmaDefragmentationStats stats = {};
+        vmaEndDefragmentation(_allocator, _defragmentation.context, &stats);
+        _defragmentation.context = VK_NULL_HANDLE;
+
+        LogMessage("Defragmentation moved " + std::to_string(stats.allocationsMoved) + " allocations ("
+            + std::to_string(stats.bytesMoved) + " bytes) and freed " + std::to_string(stats.deviceMemoryBlocksFreed)
+            + " memory blocks", false);
+    }
+
+    void ImplDevice::RegisterQueue(ImplQueue* queue)
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _queues.push_back(queue);
+    }
+
+    void ImplDevice::UnregisterQueue(ImplQueue* queue)
+    {
+        VkSemaphore semaphore = static_cast<VkSemaphore>(queue->_submissionTimeline.GetNativeHandle());
+
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            _queues.erase(std::remove(_queues.begin(), _queues.end(), queue), _queues.end());
+        }
+
+        // the queue has drained by now, so nothing retired needs to wait on its timeline anymore
+        {
+            std::lock_guard<std::mutex> lock(_defragmentation.mutex);
+            if (_defragmentation.copySemaphore == semaphore)
+                _defragmentation.copySemaphore = VK_NULL_HANDLE;
+            std::erase_if(_defragmentation.retireValues, [semaphore](const QueueTimelineValue& value) {
+                return value.semaphore == semaphore; });
+        }
+
+        std::lock_guard<std::mutex> lock(_retirementMutex);
+        for (RetiredResources& batch : _retiredResources) {
+            std::erase_if(batch.timelineValues, [semaphore](const QueueTimelineValue& value) {
+                return value.semaphore == semaphore; });
         }
-        return rsrc.mappedAddress;
     }
 
-    void Device::DestroyBuffer(BufferId buffer) { impl->DestroyBuffer(buffer); }
-    void ImplDevice::DestroyBuffer(BufferId buffer) {
+    bool ImplDevice::SubmitOwnershipRelease(const OwnershipRelease& release, VkSemaphore& waitSemaphore, uint64_t& waitValue)
+    {
+        // held throughout so neither queue can unregister mid-submit
+        std::lock_guard<std::mutex> lock(_queueMutex);
+
+        // a queue that has since been destroyed waited for its own work on the way out
+        ImplQueue* owner = nullptr;
+        if (release.owner.queue != nullptr && std::find(_queues.begin(), _queues.end(), release.owner.queue) != _queues.end())
+            owner = release.owner.queue;
+
+        ImplQueue* releaseQueue = nullptr;
+        if (owner != nullptr && owner->_vkQueueIndex == release.queueFamily)
+            releaseQueue = owner;
+        else {
+            auto it = std::find_if(_queues.begin(), _queues.end(), [&release](const ImplQueue* queue) {
+                return queue->_vkQueueIndex == release.queueFamily; });
+            if (it == _queues.end())
+                return false;
+            releaseQueue = *it;
+        }
+
+        // the last submitted use ran on another queue than the one releasing, order after it with its timeline
+        VkSemaphore ownerSemaphore = VK_NULL_HANDLE;
+        if (owner != nullptr && owner != releaseQueue) {
+            if (owner->_vkQueueIndex != release.queueFamily)
+                LogMessage("Resources were recorded as owned by queue family " + std::to_string(release.queueFamily)
+                    + " but last submitted on family " + std::to_string(owner->_vkQueueIndex) + ", submit lists in the order they were recorded");
+            ownerSemaphore = static_cast<VkSemaphore>(owner->_submissionTimeline.GetNativeHandle());
+        }
+
+        waitSemaphore = static_cast<VkSemaphore>(releaseQueue->_submissionTimeline.GetNativeHandle());
+        waitValue = releaseQueue->SubmitOwnershipRelease(release.bufferBarriers, release.imageBarriers, ownerSemaphore, release.owner.lastUse);
+        return true;
+    }
+
+    std::vector<QueueTimelineValue> ImplDevice::SubmittedTimelineValues()
+    {
+        std::vector<QueueTimelineValue> timelineValues;
+
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        timelineValues.reserve(_queues.size());
+        for (ImplQueue* queue : _queues) {
+            uint64_t submitted = queue->_timelineValue.load(std::memory_order_acquire);
+            if (submitted == 0)
+                continue;
+            timelineValues.push_back({
+                .semaphore = static_cast<VkSemaphore>(queue->_submissionTimeline.GetNativeHandle()),
+                .value = submitted
+            });
+        }
+
+        return timelineValues;
+    }
+
+    bool ImplDevice::TimelineValuesReached(const std::vector<QueueTimelineValue>& timelineValues)
+    {
+        for (const QueueTimelineValue& timelineValue : timelineValues) {
+            uint64_t gpuValue = 0;
+            ErrorCheck(vkGetSemaphoreCounterValue(_vkDevice, timelineValue.semaphore, &gpuValue));
+            if (gpuValue < timelineValue.value)
+                return false;
+        }
+
+        return true;
+    }
+
+    RetiredResources& ImplDevice::GetRetirementBatch()
+    {
+        // expects _retirementMutex to be held
+        std::vector<QueueTimelineValue> timelineValues = SubmittedTimelineValues();
+
+        // nothing has been submitted since the last destroy, keep batching into the same entry
+        if (!_retiredResources.empty() && _retiredResources.back().timelineValues == timelineValues)
+            return _retiredResources.back();
+
+        _retiredResources.push_back(RetiredResources{ .timelineValues = std::move(timelineValues) });
+        return _retiredResources.back();
+    }
+
+    void ImplDevice::ReleaseRetiredResources(bool force)
+    {
+        // anything retired while a defragmentation pass is active could be mid-move, it waits for the pass to end
+        std::lock_guard<std::mutex> defragmentationLock(_defragmentation.mutex);
+        if (!force && (_defragmentation.copiesPending || _defragmentation.retiring))
+            return;
+
+        std::vector<RetiredResources> completed;
+
+        {
+            std::lock_guard<std::mutex> lock(_retirementMutex);
+
+            // batches are in submission order, so stop at the first one still in flight
+            while (!_retiredResources.empty()) {
+                if (!force && !TimelineValuesReached(_retiredResources.front().timelineValues))
+                    break;
+
+                completed.push_back(std::move(_retiredResources.front()));
+                _retiredResources.pop_front();
+            }
+        }
+
+        // pending writes may still reference these, apply them before the handles go away
+        if (!completed.empty())
+            FlushDescriptorWrites(true);
+
+        for (const RetiredResources& batch : completed) {
+            for (ImageViewId imageView : batch.imageViews)
+                FreeImageView(imageView);
+            for (ImageId image : batch.images)
+                FreeImage(image);
+            for (BufferId buffer : batch.buffers)
+                FreeBuffer(buffer);
+            for (SamplerId sampler : batch.samplers)
+                FreeSampler(sampler);
+            // after buffers and images, whatever was allocated from them is gone by now
+            for (MemoryPoolId memoryPool : batch.memoryPools)
+                FreeMemoryPool(memoryPool);
+        }
+    }
+
+    bool ImplDevice::FlushDescriptorWrites(bool wait) {
+        return _descriptorWrites.Flush(_vkDevice, _globalDescriptors.descriptorSet, _resources, wait);
+    }
+
+    void ImplDevice::FreeBuffer(BufferId buffer) {
         BufferResource& rsrc = _resources.buffers.At(buffer);
-        vmaDestroyBuffer(_allocator, rsrc.buffer, rsrc.allocation);
+        BufferMetadata& metadata = _resources.buffers.Metadata(buffer);
+        if (metadata.smallBufferBlock != nullptr) {
+            FreeSmallBuffer(metadata);
+        } else if (metadata.externalMemory != VK_NULL_HANDLE) {
+            vkDestroyBuffer(_vkDevice, rsrc.buffer, nullptr);
+            vkFreeMemory(_vkDevice, metadata.externalMemory, nullptr);
+        } else {
+            vmaDestroyBuffer(_allocator, rsrc.buffer, metadata.allocation);
+            if (metadata.createInfo.memoryPool != INVALID_RESOURCE_ID)
+                FreeMemoryPool(metadata.createInfo.memoryPool);
+        }
         _resources.buffers.Free(buffer);
     }
 
-    void Device::DestroyImage(ImageId image) { impl->DestroyImage(image); }
-    void ImplDevice::DestroyImage(ImageId image) {
+    bool ImplDevice::SubAllocateBuffer(const BufferCreateInfo& createInfo, BufferResource& resource, BufferMetadata& metadata)
+    {
+        std::lock_guard<std::mutex> lock(_smallBuffers.mutex);
+
+        uint64_t poolKey = (uint64_t)static_cast<uint32_t>(createInfo.usageFlags) << 32 | static_cast<uint32_t>(createInfo.allocationFlags);
+        SmallBufferPool& pool = _smallBuffers.pools[poolKey];
+
+        VmaVirtualAllocationCreateInfo virtualInfo = {
+            .size = createInfo.size,
+            .alignment = _smallBuffers.alignment,
+            .flags = 0,
+            .pUserData = nullptr
+        };
+
+        VmaVirtualAllocation virtualAllocation = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        SmallBufferBlock* block = nullptr;
+
+        for (std::unique_ptr<SmallBufferBlock>& candidate : pool.blocks) {
+            if (vmaVirtualAllocate(candidate->virtualBlock, &virtualInfo, &virtualAllocation, &offset) == VK_SUCCESS) {
+                block = candidate.get();
+                break;
+            }
+        }
+
+        if (block == nullptr) {
+            block = CreateSmallBufferBlock(pool, createInfo.size, createInfo.usageFlags, createInfo.allocationFlags);
+            if (block == nullptr || vmaVirtualAllocate(block->virtualBlock, &virtualInfo, &virtualAllocation, &offset) != VK_SUCCESS)
+                return false;
+        }
+
+        block->liveCount += 1;
+
+        resource.buffer = block->buffer;
+        resource.offset = offset;
+        resource.size = createInfo.size;
+        // blocks are exclusive, barriers cover only this buffer's range so ownership moves per buffer
+        resource.concurrent = false;
+
+        metadata.smallBufferBlock = block;
+        metadata.virtualAllocation = virtualAllocation;
+        metadata.deviceAddress = block->deviceAddress + offset;
+        metadata.isMapped = block->mappedAddress != nullptr;
+        metadata.mappedAddress = block->mappedAddress != nullptr ? block->mappedAddress + offset : nullptr;
+        return true;
+    }
+
+    SmallBufferBlock* ImplDevice::CreateSmallBufferBlock(SmallBufferPool& pool, VkDeviceSize minSize, BufferUsageFlags usageFlags, AllocationUsageFlags allocationFlags)
+    {
+        // expects _smallBuffers.mutex to be held
+        // the first block of a kind holds a handful of buffers, each one after doubles until the cap
+        if (pool.nextBlockSize == 0)
+            pool.nextBlockSize = std::min(_smallBuffers.threshold * 16, _smallBuffers.blockSize);
+
+        std::unique_ptr<SmallBufferBlock> block = std::make_unique<SmallBufferBlock>();
+        block->size = std::max(pool.nextBlockSize, minSize);
+
+        VkBufferCreateInfo vkBufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pNext = nullptr,
+            .flags = 0,
+            .size = block->size,
+            .usage = BufferUsageFromFlags(usageFlags),
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = 0,
+            .pQueueFamilyIndices = nullptr
+        };
+
+        // dedicated memory makes no sense for a shared block
+        VmaAllocationCreateFlags allocFlags = ToVmaAllocationFlags(allocationFlags) & ~VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+
+        VmaAllocationCreateInfo allocationCreateInfo = {
+            .flags = allocFlags,
+            .usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+            .requiredFlags = RequiredMemoryFlags(allocationFlags),
+            .preferredFlags = {},
+            .memoryTypeBits = std::numeric_limits<uint32_t>::max(),
+            .pool = nullptr,
+            .pUserData = nullptr,
+            .priority = 0.5f
+        };
+
+        VmaAllocationInfo newAllocation = {};
+
+        VkResult result = vmaCreateBuffer(_allocator, &vkBufferInfo, &allocationCreateInfo,
+            &block->buffer, &block->allocation, &newAllocation);
+        if (result != VK_SUCCESS) {
+            ErrorCheck(result);
+            return nullptr;
+        }
+
+        block->mappedAddress = static_cast<uint8_t*>(newAllocation.pMappedData);
+
+        VkBufferDeviceAddressInfo addressInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .pNext = nullptr,
+            .buffer = block->buffer
+        };
+
+        block->deviceAddress = vkGetBufferDeviceAddress(_vkDevice, &addressInfo);
+
+        VmaVirtualBlockCreateInfo virtualBlockInfo = {
+            .size = block->size,
+            .flags = 0,
+            .pAllocationCallbacks = nullptr
+        };
+
+        ErrorCheck(vmaCreateVirtualBlock(&virtualBlockInfo, &block->virtualBlock));
+
+        LogMessage("Created small buffer block of " + std::to_string(block->size) + " bytes", false);
+        pool.nextBlockSize = std::min(pool.nextBlockSize * 2, _smallBuffers.blockSize);
+
+        pool.blocks.push_back(std::move(block));
+        return pool.blocks.back().get();
+    }
+
+    void ImplDevice::FreeSmallBuffer(BufferMetadata& metadata)
+    {
+        std::lock_guard<std::mutex> lock(_smallBuffers.mutex);
+
+        SmallBufferBlock* block = metadata.smallBufferBlock;
+        vmaVirtualFree(block->virtualBlock, metadata.virtualAllocation);
+        block->liveCount -= 1;
+
+        metadata.smallBufferBlock = nullptr;
+        metadata.virtualAllocation = VK_NULL_HANDLE;
+
+        if (block->liveCount > 0)
+            return;
+
+        // keep one block per pool around, release the rest as they empty out
+        for (auto& pool : _smallBuffers.pools) {
+            std::vector<std::unique_ptr<SmallBufferBlock>>& blocks = pool.second.blocks;
+            auto it = std::find_if(blocks.begin(), blocks.end(), [block](const std::unique_ptr<SmallBufferBlock>& owned) {
+                return owned.get() == block; });
+
+            if (it == blocks.end())
+                continue;
+
+            if (blocks.size() > 1) {
+                DestroySmallBufferBlock(*block);
+                blocks.erase(it);
+            }
+            return;
+        }
+    }
+
+    void ImplDevice::DestroySmallBufferBlock(SmallBufferBlock& block)
+    {
+        // anything still allocated here at shutdown was leaked by the client
+        vmaClearVirtualBlock(block.virtualBlock);
+        vmaDestroyVirtualBlock(block.virtualBlock);
+        vmaDestroyBuffer(_allocator, block.buffer, block.allocation);
+    }
+
+    void ImplDevice::FreeImage(ImageId image) {
         ImageResource& rsrc = _resources.images.At(image);
-        vmaDestroyImage(_allocator, rsrc.image, rsrc.allocation);
+        ImageMetadata& metadata = _resources.images.Metadata(image);
+        if (metadata.externalMemory != VK_NULL_HANDLE) {
+            vkDestroyImage(_vkDevice, rsrc.image, nullptr);
+            vkFreeMemory(_vkDevice, metadata.externalMemory, nullptr);
+        } else {
+            vmaDestroyImage(_allocator, rsrc.image, metadata.allocation);
+            if (metadata.createInfo.memoryPool != INVALID_RESOURCE_ID)
+                FreeMemoryPool(metadata.createInfo.memoryPool);
+        }
         _resources.images.Free(image);
     }
 
-    void Device::DestroyImageView(ImageViewId imageView) { impl->DestroyImageView(imageView); }
-    void ImplDevice::DestroyImageView(ImageViewId imageView) {
+    void ImplDevice::FreeImageView(ImageViewId imageView) {
         ImageViewResource& rsrc = _resources.imageViews.At(imageView);
         vkDestroyImageView(_vkDevice, rsrc.imageView, nullptr);
         _resources.imageViews.Free(imageView);
     }
 
-    void Device::DestroySampler(SamplerId sampler) { impl->DestroySampler(sampler); }
-    void ImplDevice::DestroySampler(SamplerId sampler) {
+    void ImplDevice::FreeSampler(SamplerId sampler) {
         SamplerResource& rsrc = _resources.samplers.At(sampler);
         vkDestroySampler(_vkDevice, rsrc.sampler, nullptr);
         _resources.samplers.Free(sampler);
     }
 
+    void ImplDevice::FreeMemoryPool(MemoryPoolId memoryPool) {
+        std::lock_guard<std::mutex> lock(_memoryPoolMutex);
+        MemoryPoolEntry* entry = FindMemoryPool(memoryPool);
+        if (entry == nullptr || !entry->destroyed)
+            return;
+
+        // resources still placed in it keep it alive, the last one to be freed comes back through here
+        VmaDetailedStatistics statistics = {};
+        vmaCalculatePoolStatistics(_allocator, entry->pool, &statistics);
+        if (statistics.statistics.allocationCount != 0) {
+            LogMessage("Memory pool " + std::to_string(memoryPool) + " destroyed with "
+                + std::to_string(statistics.statistics.allocationCount) + " live allocations, released once they are freed", false);
+            return;
+        }
+
+        vmaDestroyPool(_allocator, entry->pool);
+        entry->pool = VK_NULL_HANDLE;
+        entry->destroyed = false;
+        entry->generation = (entry->generation + 1) & RESOURCE_GENERATION_MASK;
+    }
+
     void Device::LogMessage(const std::string& message, bool error) {
         impl->LogMessage(message, error);
     }
@@ -668,30 +2990,15 @@ namespace WilloRHI
         }
     }
 
-    void Device::LockResources_Shared() { impl->LockResources_Shared(); }
-    void ImplDevice::LockResources_Shared() {
-        _resources.resourcesMutex.lock_shared();
-    }
-
-    void Device::UnlockResources_Shared() { impl->UnlockResources_Shared(); }
-    void ImplDevice::UnlockResources_Shared() {
-        _resources.resourcesMutex.unlock_shared();
-    }
-
-    void Device::LockResources() { impl->LockResources(); }
-    void ImplDevice::LockResources() {
-        _resources.resourcesMutex.lock();
-    }
-
-    void Device::UnlockResources() { impl->UnlockResources(); }
-    void ImplDevice::UnlockResources() {
-        _resources.resourcesMutex.unlock();
-    }
-
     void* Device::GetBufferNativeHandle(BufferId handle) const { return impl->GetBufferNativeHandle(handle); }
     void* ImplDevice::GetBufferNativeHandle(BufferId handle) const {
         return static_cast<void*>(_resources.buffers.At(handle).buffer);
     }
+
+    uint64_t Device::GetBufferNativeOffset(BufferId handle) const { return impl->GetBufferNativeOffset(handle); }
+    uint64_t ImplDevice::GetBufferNativeOffset(BufferId handle) const {
+        return _resources.buffers.At(handle).offset;
+    }
     
     void* Device::GetImageNativeHandle(ImageId handle) const { return impl->GetImageNativeHandle(handle); }
     void* ImplDevice::GetImageNativeHandle(ImageId handle) const {
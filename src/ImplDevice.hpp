@@ -2,16 +2,202 @@
 
 #include "WilloRHI/Device.hpp"
 #include "ImplResources.hpp"
+#include "ImplDescriptors.hpp"
 
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 #include <VkBootstrap.h>
 #include <concurrentqueue.h>
 
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 namespace WilloRHI
 {
     using NativeWindowHandle = void*;
+
+    struct ImplQueue;
+
+    struct QueueTimelineValue {
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t value = 0;
+
+        bool operator==(const QueueTimelineValue&) const = default;
+    };
+
+    // release halves of ownership transfers out of one queue family, for resources last used on one queue
+    struct OwnershipRelease {
+        uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED;
+        QueueOwnership owner = {};
+        std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+        std::vector<VkImageMemoryBarrier2> imageBarriers;
+    };
+
+    struct MemoryPoolEntry {
+        VmaPool pool = VK_NULL_HANDLE;
+        uint32_t memoryTypeIndex = 0;
+        // bumped when the pool is destroyed, so its id stops resolving before the slot is reused
+        uint32_t generation = 0;
+        // DestroyMemoryPool was called, nothing new goes in and it is destroyed once empty
+        bool destroyed = false;
+    };
+
+    // resources destroyed while a given set of queue submissions were outstanding
+    // nothing in here is released, and no slot reused, until every one of those has completed
+    struct RetiredResources {
+        std::vector<QueueTimelineValue> timelineValues;
+
+        std::vector<BufferId> buffers;
+        std::vector<ImageId> images;
+        std::vector<ImageViewId> imageViews;
+        std::vector<SamplerId> samplers;
+        std::vector<MemoryPoolId> memoryPools;
+    };
     
+    // shadow of the bindless address table when the table itself lives in device-local memory
+    // entries are written on the host and uploaded in 64-entry chunks on the next submit
+    struct AddressTableUploads {
+        static constexpr uint32_t CHUNK_SIZE = 64;
+
+        bool deviceLocal = false;
+
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        VmaAllocation stagingAllocation = VK_NULL_HANDLE;
+
+        // one bit per chunk
+        std::unique_ptr<std::atomic<uint64_t>[]> dirtyChunks;
+        uint32_t numDirtyWords = 0;
+        uint32_t numEntries = 0;
+
+        // uploads signal this, every queue submission waits on the latest value
+        VkSemaphore timeline = VK_NULL_HANDLE;
+        uint64_t timelineValue = 0;
+
+        struct PendingCommandBuffer {
+            uint64_t timelineValue = 0;
+            uint32_t queueFamily = 0;
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        };
+
+        std::unordered_map<uint32_t, VkCommandPool> commandPools;
+        std::unordered_map<uint32_t, std::vector<VkCommandBuffer>> freeCommandBuffers;
+        std::deque<PendingCommandBuffer> pendingCommandBuffers;
+
+        std::mutex mutex;
+    };
+
+    // a shared backing buffer that small buffers are carved out of
+    struct SmallBufferBlock {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        VmaVirtualBlock virtualBlock = VK_NULL_HANDLE;
+        VkDeviceAddress deviceAddress = 0;
+        uint8_t* mappedAddress = nullptr;
+        VkDeviceSize size = 0;
+        uint32_t liveCount = 0;
+    };
+
+    struct SmallBufferPool {
+        std::vector<std::unique_ptr<SmallBufferBlock>> blocks;
+        // size of the next block, grows with demand up to SmallBufferAllocator::blockSize
+        VkDeviceSize nextBlockSize = 0;
+    };
+
+    struct SmallBufferAllocator {
+        VkDeviceSize threshold = 0;
+        VkDeviceSize blockSize = 0;
+        VkDeviceSize alignment = 16;
+
+        // keyed by usage and allocation flags, buffers only share memory with buffers of the same kind
+        std::unordered_map<uint64_t, SmallBufferPool> pools;
+        std::mutex mutex;
+    };
+
+    // memory owned by resources directly instead of vma, each function is null when its extension isn't supported
+    struct ExternalMemory {
+        // VK_EXT_external_memory_host
+        VkDeviceSize hostPointerAlignment = 1;
+        PFN_vkGetMemoryHostPointerPropertiesEXT pfnGetMemoryHostPointerProperties = nullptr;
+
+        // VK_KHR_external_memory_fd
+        PFN_vkGetMemoryFdKHR pfnGetMemoryFd = nullptr;
+    };
+
+    // VK_EXT_host_image_copy, the functions are null when it isn't supported
+    struct HostImageCopy {
+        PFN_vkCopyMemoryToImageEXT pfnCopyMemoryToImage = nullptr;
+        PFN_vkTransitionImageLayoutEXT pfnTransitionImageLayout = nullptr;
+
+        // layouts host copies may read from and write to, host transitions only go to dst layouts
+        std::vector<VkImageLayout> srcLayouts;
+        std::vector<VkImageLayout> dstLayouts;
+        // what images are copied into, TRANSFER_DST when the driver allows, GENERAL otherwise
+        VkImageLayout copyLayout = VK_IMAGE_LAYOUT_GENERAL;
+    };
+
+    // allocations owned by a resource slot carry its id in their user data, so defragmentation knows what moved
+    enum class AllocationOwner : uint32_t {
+        NONE = 0,
+        BUFFER = 1,
+        IMAGE = 2
+    };
+
+    static_assert(sizeof(void*) >= sizeof(uint64_t), "allocation tags pack the owner and id into a pointer");
+
+    inline void* AllocationTag(AllocationOwner owner, uint32_t id) {
+        return reinterpret_cast<void*>(static_cast<uintptr_t>(owner) << 32 | id); }
+    inline AllocationOwner AllocationTagOwner(void* tag) {
+        return static_cast<AllocationOwner>(reinterpret_cast<uintptr_t>(tag) >> 32); }
+    inline uint32_t AllocationTagId(void* tag) {
+        return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(tag)); }
+
+    // a vma defragmentation in progress, a pass spans several Defragment calls and never waits on the host
+    // its copies are submitted first, moved resources switch to the new handles in the first call after they finish,
+    // and the old handles go once everything submitted before the call after that has finished too
+    struct Defragmentation {
+        VmaDefragmentationContext context = VK_NULL_HANDLE;
+        VmaDefragmentationPassMoveInfo passInfo = {};
+
+        // set while the pass's copies are in flight
+        bool copiesPending = false;
+        // signalled once the copies have finished, null once the queue they ran on is gone
+        VkSemaphore copySemaphore = VK_NULL_HANDLE;
+        uint64_t copyValue = 0;
+        uint32_t copyQueueFamily = 0;
+
+        // set once the moves are committed, the pass ends when every queue has reached these values
+        bool retiring = false;
+        std::vector<QueueTimelineValue> retireValues;
+
+        struct BufferCopy {
+            BufferId buffer = INVALID_RESOURCE_ID;
+            VkBuffer src = VK_NULL_HANDLE;
+            VkBuffer dst = VK_NULL_HANDLE;
+            VkDeviceSize size = 0;
+        };
+
+        struct ImageCopy {
+            ImageId image = INVALID_RESOURCE_ID;
+            VkImage src = VK_NULL_HANDLE;
+            VkImage dst = VK_NULL_HANDLE;
+            // undefined contents are not copied
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkImageAspectFlags aspect = VK_IMAGE_ASPECT_NONE;
+            ImageCreateInfo createInfo = {};
+        };
+
+        std::vector<BufferCopy> bufferCopies;
+        std::vector<ImageCopy> imageCopies;
+        std::vector<VkImageView> oldImageViews;
+
+        // ReleaseRetiredResources holds back while a pass is active, so no allocation is freed mid-move
+        std::mutex mutex;
+    };
+
     struct ImplDevice
     {
         // vars
@@ -24,15 +210,45 @@ namespace WilloRHI
         vkb::SystemInfo _sysInfo = vkb::SystemInfo::get_system_info().value();
 
         uint32_t _vkQueueIndices[3] = {0,0,0};
+        // deduplicated, for the few internal buffers every queue reads from
+        std::vector<uint32_t> _sharedQueueFamilies;
 
         DeviceResources _resources;
         GlobalDescriptors _globalDescriptors;
+        DescriptorWriteQueue _descriptorWrites;
         BufferResource _addressBuffer;
+        BufferMetadata _addressBufferMetadata;
         uint64_t* _addressBufferPtr = nullptr;
+        AddressTableUploads _addressTable;
+        SmallBufferAllocator _smallBuffers;
+        ExternalMemory _externalMemory;
+        HostImageCopy _hostImageCopy;
+
+        UploadStrategy _uploadStrategy = UploadStrategy::STAGING;
 
         RHILoggingFunc _loggingCallback = nullptr;
         bool _doLogInfo = false;
 
+        std::vector<ImplQueue*> _queues;
+        std::mutex _queueMutex;
+
+        // guards QueueOwnership on every resource, only taken around submits
+        std::mutex _ownershipMutex;
+
+        std::unordered_map<SamplerCreateInfo, SamplerCacheEntry, SamplerCreateInfoHash, SamplerCreateInfoEqual> _samplerCache;
+        std::mutex _samplerCacheMutex;
+
+        std::mutex _imageViewMutex;
+
+        Defragmentation _defragmentation;
+
+        // indexed by the index half of a MemoryPoolId, destroyed pools leave a null entry to be reused
+        std::vector<MemoryPoolEntry> _memoryPools;
+        std::mutex _memoryPoolMutex;
+
+        std::deque<RetiredResources> _retiredResources;
+        std::mutex _retirementMutex;
+
         // functionality
 
         void Init(const DeviceCreateInfo& createInfo);
@@ -41,6 +257,9 @@ namespace WilloRHI
         void Cleanup();
 
         void SetupDescriptors(const ResourceCountInfo& countInfo);
+        void CreateGlobalSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, bool descriptorBuffer);
+        bool CreateDescriptorBuffer(VkDeviceSize size);
+        void LoadDescriptorBufferFunctions();
         void SetupDefaultResources();
 
         void* GetDeviceNativeHandle() const;
@@ -49,32 +268,112 @@ namespace WilloRHI
 
         void WaitIdle() const;
 
+        UploadStrategy GetUploadStrategy() const;
+        void SelectUploadStrategy();
+        // UPLOAD is ours and never reaches vma, it turns into mapped device-local memory under DIRECT_WRITE
+        VmaAllocationCreateFlags ToVmaAllocationFlags(AllocationUsageFlags allocationFlags) const;
+        VkMemoryPropertyFlags RequiredMemoryFlags(AllocationUsageFlags allocationFlags) const;
+
         // resources
 
-        BufferId CreateBuffer(const BufferCreateInfo& createInfo);
-        ImageId CreateImage(const ImageCreateInfo& createInfo);
+        // importFd is -1 unless importing memory exported by another process
+        BufferId CreateBuffer(const BufferCreateInfo& createInfo, int importFd);
+        BufferId ImportHostBuffer(void* pointer, uint64_t size, BufferUsageFlags usageFlags);
+        ImageId CreateImage(const ImageCreateInfo& createInfo, int importFd);
         ImageViewId CreateImageView(const ImageViewCreateInfo& createInfo);
         SamplerId CreateSampler(const SamplerCreateInfo& createInfo);
 
+        MemoryPoolId CreateMemoryPool(const MemoryPoolCreateInfo& createInfo);
+        void DestroyMemoryPool(MemoryPoolId memoryPool);
+        // null for the default pools, logs and falls back to them for unknown or destroyed ids
+        VmaPool GetMemoryPool(MemoryPoolId memoryPool, uint32_t* memoryTypeIndex = nullptr);
+        // the live entry an id refers to or null, _memoryPoolMutex has to be held
+        MemoryPoolEntry* FindMemoryPool(MemoryPoolId memoryPool);
+
+        bool Defragment(Queue queue, const DefragmentationInfo& info);
+        // create a new handle bound to the move's destination for the copy, false to leave the resource in place
+        bool PrepareBufferMove(BufferId buffer, VmaAllocation destination, uint32_t queueFamily);
+        bool PrepareImageMove(ImageId image, VmaAllocation destination, uint32_t queueFamily);
+        void RecordDefragmentationCopies(VkCommandBuffer commandBuffer);
+        // point the moved resources, their addresses, descriptors and views at the new handles once the copies
+        // have finished, or regardless with force, expects _defragmentation.mutex to be held
+        void CommitDefragmentationMoves(bool force = false);
+        // returns true once defragmentation has finished
+        bool EndDefragmentationPass();
+        void EndDefragmentation();
+
+        // dedicated memory outside vma, exportable unless importFd is given
+        VkDeviceMemory AllocateExternalMemory(const VkMemoryRequirements& requirements, VkBuffer buffer, VkImage image, int importFd);
+        bool CreateExternalBuffer(const BufferCreateInfo& createInfo, int importFd, BufferResource& resource, BufferMetadata& metadata);
+        bool CreateExternalImage(const ImageCreateInfo& createInfo, int importFd, ImageResource& resource, ImageMetadata& metadata);
+        int ExportBufferFd(BufferId buffer);
+        int ExportImageFd(ImageId image);
+        int ExportMemoryFd(VkDeviceMemory memory);
+
+        VkImageView CreateVkImageView(VkImage image, const ImageViewCreateInfo& createInfo);
+        void WriteImageViewDescriptors(ImageViewId imageView, VkImageView vkImageView, ImageUsageFlags usageFlags);
+
         void* GetBufferPointer(BufferId buffer);
         void* GetImagePointer(ImageId image);
 
+        void FlushMappedRanges(uint32_t numRanges, const MappedRange* ranges);
+        void InvalidateMappedRanges(uint32_t numRanges, const MappedRange* ranges);
+        // every range in one vma call, flush or invalidate
+        void SyncMappedRanges(uint32_t numRanges, const MappedRange* ranges, bool flush);
+
+        bool WriteImage(const ImageWriteInfo& writeInfo);
+        void LoadHostImageCopyFunctions();
+
         void DestroyBuffer(BufferId buffer);
         void DestroyImage(ImageId image);
         void DestroyImageView(ImageViewId imageView);
         void DestroySampler(SamplerId sampler);
 
+        // queues register their submission timelines so destruction can wait on all of them
+        void RegisterQueue(ImplQueue* queue);
+        void UnregisterQueue(ImplQueue* queue);
+
+        // submits ownership releases on the queue that last used the resources, or another of the family
+        // that waits for that use to finish, returns false if no queue of that family exists
+        bool SubmitOwnershipRelease(const OwnershipRelease& release, VkSemaphore& waitSemaphore, uint64_t& waitValue);
+
+        // the last value submitted to each registered queue, _queueMutex is taken
+        std::vector<QueueTimelineValue> SubmittedTimelineValues();
+        bool TimelineValuesReached(const std::vector<QueueTimelineValue>& timelineValues);
+
+        RetiredResources& GetRetirementBatch();
+        void ReleaseRetiredResources(bool force = false);
+
+        void SetupAddressTableUploads(uint32_t numEntries);
+        void WriteBufferAddress(BufferId buffer, VkDeviceAddress address);
+        // records and submits a copy of any changed entries on the given queue
+        // returns true with the timeline value the caller's submission has to wait on, if any
+        bool UploadAddressTable(VkQueue queue, uint32_t queueFamily, VkSemaphore& waitSemaphore, uint64_t& waitValue);
+
+        // writes into the descriptor buffer directly, or queues for the next flush when using the descriptor set
+        void WriteDescriptor(const DescriptorWrite& write);
+        // applies pending descriptor writes, returns false if another thread was flushing and wait is false
+        bool FlushDescriptorWrites(bool wait);
+
+        bool SubAllocateBuffer(const BufferCreateInfo& createInfo, BufferResource& resource, BufferMetadata& metadata);
+        SmallBufferBlock* CreateSmallBufferBlock(SmallBufferPool& pool, VkDeviceSize minSize, BufferUsageFlags usageFlags, AllocationUsageFlags allocationFlags);
+        void FreeSmallBuffer(BufferMetadata& metadata);
+        void DestroySmallBufferBlock(SmallBufferBlock& block);
+
+        void FreeBuffer(BufferId buffer);
+        void FreeImage(ImageId image);
+        void FreeImageView(ImageViewId imageView);
+        void FreeSampler(SamplerId sampler);
+        // destroys a pool DestroyMemoryPool was called on once its last allocation is gone, otherwise a no-op
+        void FreeMemoryPool(MemoryPoolId memoryPool);
+
         // functionality
 
         void LogMessage(const std::string& message, bool error = true);
         void ErrorCheck(uint64_t errorCode);
 
-        void LockResources_Shared();
-        void UnlockResources_Shared();
-        void LockResources();
-        void UnlockResources();
-
         void* GetBufferNativeHandle(BufferId handle) const;
+        uint64_t GetBufferNativeOffset(BufferId handle) const;
         void* GetImageNativeHandle(ImageId handle) const;
         void* GetImageViewNativeHandle(ImageViewId handle) const;
         void* GetSamplerNativeHandle(SamplerId handle) const;
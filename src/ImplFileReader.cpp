@@ -0,0 +1,350 @@
+#include "ImplFileReader.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#if defined(WilloRHI_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <atomic>
+#include <cstring>
+#endif
+
+#include <algorithm>
+
+namespace WilloRHI
+{
+    // largest single read, bigger ones are split
+    static constexpr uint64_t MAX_READ_SIZE = 1ull << 30;
+
+    // reads until size bytes are in or the file ends, returns the bytes read or a negative errno
+    static int64_t ReadSync(FileReader& reader, void* destination, uint64_t size, uint64_t fileOffset)
+    {
+        uint8_t* bytes = static_cast<uint8_t*>(destination);
+        uint64_t total = 0;
+
+        while (total < size) {
+            uint64_t chunk = std::min(size - total, MAX_READ_SIZE);
+
+#if defined(_WIN32)
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(fileOffset + total);
+            overlapped.OffsetHigh = static_cast<DWORD>((fileOffset + total) >> 32);
+
+            DWORD numRead = 0;
+            if (!ReadFile(static_cast<HANDLE>(reader.file), bytes + total, static_cast<DWORD>(chunk), &numRead, &overlapped))
+                return GetLastError() == ERROR_HANDLE_EOF ? static_cast<int64_t>(total) : -static_cast<int64_t>(GetLastError());
+#else
+            ssize_t numRead = pread(reader.ReadFd(), bytes + total, chunk, static_cast<off_t>(fileOffset + total));
+            if (numRead < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -errno;
+            }
+#endif
+
+            if (numRead == 0)
+                break;
+            total += static_cast<uint64_t>(numRead);
+        }
+
+        return static_cast<int64_t>(total);
+    }
+
+    FileReader::~FileReader()
+    {
+        Close();
+    }
+
+    bool FileReader::Open(const std::string& path, uint32_t maxInFlight, bool unbuffered)
+    {
+        Close();
+        queueDepth = std::max(maxInFlight, 1u);
+        pendingReads.assign(queueDepth, {});
+        freePendingReads.clear();
+        for (uint32_t i = queueDepth; i > 0; i--)
+            freePendingReads.push_back(i - 1);
+
+#if defined(_WIN32)
+        // unbuffered windows reads also need sector aligned sizes, not worth it without overlapped io
+        (void)unbuffered;
+        HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+            return false;
+        file = handle;
+        alignment = 1;
+#else
+        fd = -1;
+        this->path = path;
+#if defined(O_DIRECT)
+        // covers the logical block size of anything short of exotic storage
+        if (unbuffered) {
+            fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+            alignment = 4096;
+        }
+#else
+        (void)unbuffered;
+#endif
+        if (fd < 0) {
+            fd = open(path.c_str(), O_RDONLY);
+            alignment = 1;
+        }
+        if (fd < 0)
+            return false;
+#endif
+
+#if defined(WilloRHI_IO_URING)
+        // seccomp filters and older kernels both make this fail, reads then happen synchronously
+        if (!SetupRing(queueDepth))
+            DestroyRing();
+#endif
+
+        return true;
+    }
+
+    void FileReader::Close()
+    {
+        // anything still in flight writes into memory the caller is about to reuse
+        // if the ring has failed, destroying it below cancels what's left instead
+        std::vector<FileReadCompletion> drained;
+        while (numInFlight > 0) {
+            if (Poll(drained, true) < 0)
+                break;
+        }
+        numInFlight = 0;
+        completed.clear();
+
+#if defined(WilloRHI_IO_URING)
+        DestroyRing();
+#endif
+
+#if defined(_WIN32)
+        if (file != nullptr)
+            CloseHandle(static_cast<HANDLE>(file));
+        file = nullptr;
+#else
+        if (fd >= 0)
+            close(fd);
+        if (bufferedFd >= 0)
+            close(bufferedFd);
+        fd = -1;
+        bufferedFd = -1;
+#endif
+    }
+
+#if !defined(_WIN32)
+    bool FileReader::ReopenBuffered()
+    {
+        if (bufferedFd >= 0)
+            return true;
+        if (alignment == 1)
+            return false;
+
+        bufferedFd = open(path.c_str(), O_RDONLY);
+        return bufferedFd >= 0;
+    }
+#endif
+
+    int64_t FileReader::RetryIfUnbuffered(const PendingRead& read, int64_t result)
+    {
+#if defined(_WIN32)
+        (void)read;
+        return result;
+#else
+        if (result != -EFAULT && result != -EINVAL)
+            return result;
+        if (!ReopenBuffered())
+            return result;
+
+        return ReadSync(*this, read.destination, read.size, read.fileOffset);
+#endif
+    }
+
+    bool FileReader::Read(void* destination, uint64_t size, uint64_t fileOffset, uint64_t userData)
+    {
+        if (numInFlight >= queueDepth)
+            return false;
+
+#if defined(WilloRHI_IO_URING)
+        if (ringFd >= 0 && size <= MAX_READ_SIZE) {
+            uint32_t pendingIndex = freePendingReads.back();
+            freePendingReads.pop_back();
+            pendingReads[pendingIndex] = { destination, size, fileOffset, userData };
+
+            QueueRead(pendingIndex);
+            numInFlight++;
+            return true;
+        }
+#endif
+
+        PendingRead read = { destination, size, fileOffset, userData };
+        completed.push_back({ userData, RetryIfUnbuffered(read, ReadSync(*this, destination, size, fileOffset)) });
+        numInFlight++;
+        return true;
+    }
+
+    int FileReader::Poll(std::vector<FileReadCompletion>& completions, bool wait)
+    {
+        if (!completed.empty()) {
+            numInFlight -= (uint32_t)completed.size();
+            completions.insert(completions.end(), completed.begin(), completed.end());
+            completed.clear();
+            wait = false;
+        }
+
+#if defined(WilloRHI_IO_URING)
+        if (ringFd < 0)
+            return 0;
+
+        while (true) {
+            bool waitHere = wait && numInFlight > 0;
+            if (numToSubmit > 0 || waitHere) {
+                long submitted = syscall(__NR_io_uring_enter, ringFd, numToSubmit, waitHere ? 1u : 0u,
+                    waitHere ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+                if (submitted > 0)
+                    numToSubmit -= std::min<uint32_t>(numToSubmit, (uint32_t)submitted);
+                // interrupted or briefly out of resources is worth another go, anything else won't get better
+                else if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                    return -errno;
+            }
+
+            unsigned head = *cqHead;
+            unsigned tail = std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire);
+
+            bool reaped = false;
+            for (; head != tail; head++) {
+                const io_uring_cqe& cqe = static_cast<io_uring_cqe*>(cqes)[head & *cqMask];
+                PendingRead& read = pendingReads[cqe.user_data];
+
+                // a short read isn't the end of the file, only one that reads nothing is
+                if (cqe.res > 0 && read.done + (uint64_t)cqe.res < read.size) {
+                    read.done += (uint64_t)cqe.res;
+                    QueueRead((uint32_t)cqe.user_data);
+                    continue;
+                }
+
+                int64_t result = cqe.res < 0 ? cqe.res : (int64_t)(read.done + (uint64_t)cqe.res);
+                completions.push_back({ read.userData, RetryIfUnbuffered(read, result) });
+                freePendingReads.push_back((uint32_t)cqe.user_data);
+                numInFlight--;
+                reaped = true;
+            }
+            std::atomic_ref<unsigned>(*cqHead).store(head, std::memory_order_release);
+
+            // interrupted waits and resubmitted short reads come back empty handed
+            if (reaped || !wait || numInFlight == 0)
+                return 0;
+        }
+#endif
+        return 0;
+    }
+
+#if defined(WilloRHI_IO_URING)
+    void FileReader::QueueRead(uint32_t pendingIndex)
+    {
+        const PendingRead& read = pendingReads[pendingIndex];
+
+        // only this thread produces, the kernel only reads the tail
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+
+        io_uring_sqe& sqe = static_cast<io_uring_sqe*>(sqes)[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = ReadFd();
+        sqe.off = read.fileOffset + read.done;
+        sqe.addr = reinterpret_cast<uint64_t>(static_cast<uint8_t*>(read.destination) + read.done);
+        sqe.len = static_cast<uint32_t>(read.size - read.done);
+        sqe.user_data = pendingIndex;
+
+        sqArray[index] = index;
+        std::atomic_ref<unsigned>(*sqTail).store(tail + 1, std::memory_order_release);
+
+        numToSubmit++;
+    }
+
+    bool FileReader::SetupRing(uint32_t entries)
+    {
+        io_uring_params params = {};
+        ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (ringFd < 0)
+            return false;
+
+        // IORING_OP_READ arrived with 5.6, same as this feature bit
+        if (!(params.features & IORING_FEAT_RW_CUR_POS))
+            return false;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap)
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            sqRing = nullptr;
+            return false;
+        }
+
+        if (singleMmap) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                cqRing = nullptr;
+                return false;
+            }
+        }
+
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            sqes = nullptr;
+            return false;
+        }
+
+        uint8_t* sq = static_cast<uint8_t*>(sqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        uint8_t* cq = static_cast<uint8_t*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = cq + params.cq_off.cqes;
+
+        // the cq is at least twice the sq, so completions never overflow with queueDepth in flight
+        queueDepth = std::min(queueDepth, params.sq_entries);
+        return true;
+    }
+
+    void FileReader::DestroyRing()
+    {
+        if (sqes != nullptr)
+            munmap(sqes, sqesSize);
+        if (cqRing != nullptr && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing != nullptr)
+            munmap(sqRing, sqRingSize);
+        if (ringFd >= 0)
+            close(ringFd);
+
+        sqes = nullptr;
+        cqRing = nullptr;
+        sqRing = nullptr;
+        ringFd = -1;
+        numToSubmit = 0;
+    }
+#endif
+}
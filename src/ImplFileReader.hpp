@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define WilloRHI_IO_URING 1
+#endif
+
+namespace WilloRHI
+{
+    struct FileReadCompletion {
+        uint64_t userData = 0;
+        // bytes read, or a negative errno
+        int64_t result = 0;
+    };
+
+    // asynchronous reads from one file straight into caller-owned memory
+    // io_uring on linux, synchronous reads wherever that isn't available
+    struct FileReader {
+        // destination address, size and file offset of every read must be a multiple of this
+        // 1 unless the file was opened unbuffered
+        uint64_t alignment = 1;
+        uint32_t queueDepth = 0;
+        uint32_t numInFlight = 0;
+
+        // unbuffered reads bypass the page cache, the file is reopened buffered if the filesystem doesn't support it
+        bool Open(const std::string& path, uint32_t maxInFlight, bool unbuffered);
+        void Close();
+        ~FileReader();
+
+        // false if queueDepth reads are already in flight
+        bool Read(void* destination, uint64_t size, uint64_t fileOffset, uint64_t userData);
+        // submits queued reads and collects completions, blocking for at least one if wait is true
+        // returns 0, or a negative errno if the ring itself failed, reads still in flight are then only cancelled by Close
+        int Poll(std::vector<FileReadCompletion>& completions, bool wait);
+
+#if defined(_WIN32)
+        void* file = nullptr;
+#else
+        int fd = -1;
+        // O_DIRECT into memory the kernel can't pin, like a mapped pci bar, only fails once a read is issued
+        // the failed read is redone through this and every later read uses it too
+        int bufferedFd = -1;
+        std::string path;
+
+        int ReadFd() const { return bufferedFd >= 0 ? bufferedFd : fd; }
+        bool ReopenBuffered();
+#endif
+        // where each read goes, so an unbuffered one can be redone
+        struct PendingRead {
+            void* destination = nullptr;
+            uint64_t size = 0;
+            uint64_t fileOffset = 0;
+            uint64_t userData = 0;
+            // short reads are resubmitted for the rest, this is what has landed so far
+            uint64_t done = 0;
+        };
+        std::vector<PendingRead> pendingReads;
+        std::vector<uint32_t> freePendingReads;
+
+        // the read's result, redone buffered if it failed the way unbuffered reads into unpinnable memory do
+        int64_t RetryIfUnbuffered(const PendingRead& read, int64_t result);
+
+        // completed synchronously when there's no io_uring
+        std::vector<FileReadCompletion> completed;
+
+#if defined(WilloRHI_IO_URING)
+        int ringFd = -1;
+
+        void* sqRing = nullptr;
+        size_t sqRingSize = 0;
+        void* cqRing = nullptr;
+        size_t cqRingSize = 0;
+        void* sqes = nullptr;
+        size_t sqesSize = 0;
+
+        unsigned* sqTail = nullptr;
+        unsigned* sqMask = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned* cqMask = nullptr;
+        void* cqes = nullptr;
+
+        uint32_t numToSubmit = 0;
+
+        // queues the part of the read that hasn't landed yet
+        void QueueRead(uint32_t pendingIndex);
+        bool SetupRing(uint32_t entries);
+        void DestroyRing();
+#endif
+    };
+}
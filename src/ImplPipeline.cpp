@@ -1,4 +1,5 @@
 #include "ImplPipeline.hpp"
+#include "ImplResources.hpp"
 
 namespace WilloRHI
 {
@@ -80,6 +81,14 @@ namespace WilloRHI
         return newManager;
     }
 
+    VkPipelineCreateFlags ImplPipelineManager::PipelineCreateFlags()
+    {
+        // pipelines have to opt in to reading from the descriptor buffer
+        if (static_cast<GlobalDescriptors*>(device.GetResourceDescriptors())->useDescriptorBuffer)
+            return VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+        return 0;
+    }
+
     void ImplPipelineManager::Init(Device device)
     {
         this->device = device;
@@ -183,7 +192,7 @@ namespace WilloRHI
         VkComputePipelineCreateInfo pipelineCreateInfo = {
             .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
             .pNext = nullptr,
-            .flags = 0,
+            .flags = PipelineCreateFlags(),
             .stage = stageCreateInfo,
             .layout = pipelineLayout,
             .basePipelineHandle = VK_NULL_HANDLE,
@@ -431,7 +440,7 @@ namespace WilloRHI
         VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
             .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
             .pNext = &vkRenderingInfo,
-            .flags = 0,
+            .flags = PipelineCreateFlags(),
             .stageCount = (uint32_t)vkStages.size(),
             .pStages = vkStages.data(),
             .pVertexInputState = &vkInputState,
@@ -72,6 +72,7 @@ namespace WilloRHI
         std::shared_mutex layoutMutex;
 
         void Init(Device device);
+        VkPipelineCreateFlags PipelineCreateFlags();
 
         ~ImplPipelineManager();
         void Cleanup();
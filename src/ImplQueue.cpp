@@ -1,8 +1,11 @@
 #include "ImplQueue.hpp"
+#include "ImplCommandList.hpp"
 #include "ImplResources.hpp"
 
 #include "WilloRHI/Sync.hpp"
 
+#include <algorithm>
+
 #include <VkBootstrap.h>
 
 // TODO: can remove once we get rid of VkBootstrap
@@ -55,6 +58,8 @@ namespace WilloRHI
 
         _submissionTimeline = WilloRHI::TimelineSemaphore::Create(_device, 0);
 
+        _device.impl->RegisterQueue(this);
+
         device.LogMessage("Created queue of type " + _queueStr, false);
     }
 
@@ -63,9 +68,16 @@ namespace WilloRHI
     }
 
     void ImplQueue::Cleanup() {
+        // anything retired against this queue's timeline has to see it finish before the timeline goes away
+        _submissionTimeline.WaitValue(_timelineValue.load(), UINT64_MAX);
+        _device.impl->UnregisterQueue(this);
+
         for (auto it : _commandPools) {
             vkDestroyCommandPool(_vkDevice, it.second, nullptr);
         }
+
+        if (_releaseCommandPool != VK_NULL_HANDLE)
+            vkDestroyCommandPool(_vkDevice, _releaseCommandPool, nullptr);
     }
 
     CommandList Queue::GetCmdList() { return impl->GetCmdList(); }
@@ -108,7 +120,7 @@ namespace WilloRHI
 
             _device.ErrorCheck(vkAllocateCommandBuffers(_vkDevice, &allocInfo, &tempHandle));
 
-            commandList = CommandList(_device, std::this_thread::get_id(), (void*)tempHandle);
+            commandList = CommandList(_device, std::this_thread::get_id(), (void*)tempHandle, _vkQueueIndex);
 
             _device.LogMessage("Allocated CommandList for thread " + std::to_string(std::hash<std::thread::id>()(threadId)), false);
         }
@@ -119,6 +131,9 @@ namespace WilloRHI
     void Queue::Submit(const CommandSubmitInfo& submitInfo) { impl->Submit(submitInfo); }
     void ImplQueue::Submit(const CommandSubmitInfo& submitInfo)
     {
+        // descriptors for anything created before this submission have to be in the set before it executes
+        _device.impl->FlushDescriptorWrites(true);
+
         int64_t commandListCount = submitInfo.commandLists.size();
         std::vector<VkCommandBuffer> cmdBuffers;
 
@@ -135,6 +150,55 @@ namespace WilloRHI
         std::vector<VkSemaphore> signalSemaphores;
         std::vector<uint64_t> signalValues;
 
+        // resources these lists acquired from another queue family are released first, on the queue whose
+        // submission last used them, so the release is ordered after that work by the queue itself
+        std::vector<OwnershipRelease> releases;
+        auto releaseFor = [&releases](uint32_t queueFamily, const QueueOwnership& owner) -> OwnershipRelease& {
+            for (OwnershipRelease& release : releases) {
+                if (release.queueFamily == queueFamily && release.owner.queue == owner.queue) {
+                    release.owner.lastUse = std::max(release.owner.lastUse, owner.lastUse);
+                    return release;
+                }
+            }
+            releases.push_back({ .queueFamily = queueFamily, .owner = owner });
+            return releases.back();
+        };
+
+        {
+            std::lock_guard<std::mutex> ownershipLock(_device.impl->_ownershipMutex);
+            for (int i = 0; i < commandListCount; i++) {
+                ImplCommandList* cmdList = submitInfo.commandLists[i].impl.get();
+                for (const auto& [resource, barrier] : cmdList->_bufferReleases)
+                    releaseFor(barrier.srcQueueFamilyIndex, resource->owner).bufferBarriers.push_back(barrier);
+                for (const auto& [resource, barrier] : cmdList->_imageReleases)
+                    releaseFor(barrier.srcQueueFamilyIndex, resource->owner).imageBarriers.push_back(barrier);
+                cmdList->_bufferReleases.clear();
+                cmdList->_imageReleases.clear();
+            }
+        }
+
+        // acquires for buffers first bound inside rendering, where the list itself couldn't record a barrier
+        std::vector<VkBufferMemoryBarrier2> preAcquires;
+        for (int i = 0; i < commandListCount; i++) {
+            ImplCommandList* cmdList = submitInfo.commandLists[i].impl.get();
+            preAcquires.insert(preAcquires.end(), cmdList->_preAcquireBarriers.begin(), cmdList->_preAcquireBarriers.end());
+            cmdList->_preAcquireBarriers.clear();
+        }
+
+        // done before taking this queue's lock, the releasing queue may be submitting to this one at the same time
+        for (const OwnershipRelease& release : releases) {
+            VkSemaphore releaseSemaphore = VK_NULL_HANDLE;
+            uint64_t releaseValue = 0;
+            if (!_device.impl->SubmitOwnershipRelease(release, releaseSemaphore, releaseValue)) {
+                _device.LogMessage("No queue of family " + std::to_string(release.queueFamily) + " to release resources from, their contents are undefined on " + _queueStr);
+                continue;
+            }
+
+            waitSemaphores.push_back(releaseSemaphore);
+            waitValues.push_back(releaseValue);
+            waitStageFlags.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        }
+
         for (int i = 0; i < submitInfo.waitTimelineSemaphores.size(); i++) {
             waitSemaphores.push_back((VkSemaphore)submitInfo.waitTimelineSemaphores[i].first.GetNativeHandle());
             waitValues.push_back(submitInfo.waitTimelineSemaphores[i].second);
@@ -147,6 +211,17 @@ namespace WilloRHI
             waitStageFlags.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
         }
 
+        std::lock_guard<std::mutex> lock(_submitMutex);
+
+        // changed bindless address table entries are uploaded ahead of this submission
+        VkSemaphore addressTableSemaphore = VK_NULL_HANDLE;
+        uint64_t addressTableValue = 0;
+        if (_device.impl->UploadAddressTable(_vkQueue, _vkQueueIndex, addressTableSemaphore, addressTableValue)) {
+            waitSemaphores.push_back(addressTableSemaphore);
+            waitValues.push_back(addressTableValue);
+            waitStageFlags.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        }
+
         for (int i = 0; i < submitInfo.signalTimelineSemaphores.size(); i++) {
             signalSemaphores.push_back((VkSemaphore)submitInfo.signalTimelineSemaphores[i].first.GetNativeHandle());
             signalValues.push_back(submitInfo.signalTimelineSemaphores[i].second);
@@ -158,13 +233,20 @@ namespace WilloRHI
         }
 
         // submission timeline value
-        _timelineValue += 1;
+        uint64_t timelineValue = _timelineValue.load() + 1;
         signalSemaphores.push_back((VkSemaphore)_submissionTimeline.GetNativeHandle());
-        signalValues.push_back(_timelineValue);
+        signalValues.push_back(timelineValue);
+
+        // runs ahead of the lists in the same batch, after the release it pairs with has been waited on
+        if (!preAcquires.empty()) {
+            VkCommandBuffer acquireBuffer = RecordBarrierCommandBuffer(preAcquires, {});
+            cmdBuffers.insert(cmdBuffers.begin(), acquireBuffer);
+            _pendingReleaseCommandBuffers.push_back(std::pair(timelineValue, acquireBuffer));
+        }
 
         // for garbage collection later
         for (int i = 0; i < commandListCount; i++) {
-            _pendingCommandLists.push_back(std::pair(_timelineValue, submitInfo.commandLists[i]));
+            _pendingCommandLists.push_back(std::pair(timelineValue, submitInfo.commandLists[i]));
         }
 
         VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
@@ -182,13 +264,30 @@ namespace WilloRHI
             .waitSemaphoreCount = (uint32_t)waitSemaphores.size(),
             .pWaitSemaphores = waitSemaphores.data(),
             .pWaitDstStageMask = waitStageFlags.data(),
-            .commandBufferCount = (uint32_t)commandListCount,
+            .commandBufferCount = (uint32_t)cmdBuffers.size(),
             .pCommandBuffers = cmdBuffers.data(),
             .signalSemaphoreCount = (uint32_t)signalSemaphores.size(),
             .pSignalSemaphores = signalSemaphores.data()
         };
 
         _device.ErrorCheck(vkQueueSubmit(_vkQueue, 1, &info, VK_NULL_HANDLE));
+
+        // still under the submit lock, so owners change in the order the queue runs the work
+        {
+            std::lock_guard<std::mutex> ownershipLock(_device.impl->_ownershipMutex);
+            for (int i = 0; i < commandListCount; i++) {
+                ImplCommandList* cmdList = submitInfo.commandLists[i].impl.get();
+                for (BufferResource* resource : cmdList->_usedBuffers)
+                    resource->owner = { .queue = this, .lastUse = timelineValue };
+                for (ImageResource* resource : cmdList->_usedImages)
+                    resource->owner = { .queue = this, .lastUse = timelineValue };
+                cmdList->_usedBuffers.clear();
+                cmdList->_usedImages.clear();
+            }
+        }
+
+        // only published once submitted, so resources retired from here on wait for this submission
+        _timelineValue.store(timelineValue, std::memory_order_release);
     }
 
     void Queue::Present(const PresentInfo& presentInfo) { impl->Present(presentInfo); }
@@ -215,19 +314,134 @@ namespace WilloRHI
             .pResults = {}
         };
 
-        VkResult result = vkQueuePresentKHR(_vkQueue, &info);
+        VkResult result = VK_SUCCESS;
+        {
+            std::lock_guard<std::mutex> lock(_submitMutex);
+            result = vkQueuePresentKHR(_vkQueue, &info);
+        }
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
             presentSwapchain.SetNeedsResize(true);
             _device.LogMessage("Present needs resize", false);
         }
     }
 
+    VkCommandBuffer ImplQueue::RecordBarrierCommandBuffer(const std::vector<VkBufferMemoryBarrier2>& bufferBarriers,
+        const std::vector<VkImageMemoryBarrier2>& imageBarriers)
+    {
+        uint64_t gpuTimeline = _submissionTimeline.GetValue();
+        while (!_pendingReleaseCommandBuffers.empty() && _pendingReleaseCommandBuffers.front().first <= gpuTimeline) {
+            _freeReleaseCommandBuffers.push_back(_pendingReleaseCommandBuffers.front().second);
+            _pendingReleaseCommandBuffers.pop_front();
+        }
+
+        // releases and acquires can come from any thread, so they get their own pool rather than a per-thread one
+        if (_releaseCommandPool == VK_NULL_HANDLE) {
+            VkCommandPoolCreateInfo poolInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .pNext = nullptr,
+                .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = _vkQueueIndex
+            };
+
+            _device.ErrorCheck(vkCreateCommandPool(_vkDevice, &poolInfo, nullptr, &_releaseCommandPool));
+        }
+
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        if (_freeReleaseCommandBuffers.empty()) {
+            VkCommandBufferAllocateInfo allocInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .pNext = nullptr,
+                .commandPool = _releaseCommandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1
+            };
+
+            _device.ErrorCheck(vkAllocateCommandBuffers(_vkDevice, &allocInfo, &commandBuffer));
+        } else {
+            commandBuffer = _freeReleaseCommandBuffers.back();
+            _freeReleaseCommandBuffers.pop_back();
+            vkResetCommandBuffer(commandBuffer, 0);
+        }
+
+        VkCommandBufferBeginInfo beginInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .pNext = nullptr,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = nullptr
+        };
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        VkDependencyInfo dependency = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .pNext = nullptr,
+            .dependencyFlags = 0,
+            .memoryBarrierCount = 0,
+            .pMemoryBarriers = nullptr,
+            .bufferMemoryBarrierCount = (uint32_t)bufferBarriers.size(),
+            .pBufferMemoryBarriers = bufferBarriers.data(),
+            .imageMemoryBarrierCount = (uint32_t)imageBarriers.size(),
+            .pImageMemoryBarriers = imageBarriers.data()
+        };
+
+        vkCmdPipelineBarrier2(commandBuffer, &dependency);
+        vkEndCommandBuffer(commandBuffer);
+
+        return commandBuffer;
+    }
+
+    uint64_t ImplQueue::SubmitOwnershipRelease(const std::vector<VkBufferMemoryBarrier2>& bufferBarriers,
+        const std::vector<VkImageMemoryBarrier2>& imageBarriers, VkSemaphore waitSemaphore, uint64_t waitValue)
+    {
+        std::lock_guard<std::mutex> lock(_submitMutex);
+
+        VkCommandBuffer commandBuffer = RecordBarrierCommandBuffer(bufferBarriers, imageBarriers);
+
+        uint64_t timelineValue = _timelineValue.load() + 1;
+        VkSemaphore timelineSemaphore = static_cast<VkSemaphore>(_submissionTimeline.GetNativeHandle());
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        uint32_t waitCount = waitSemaphore != VK_NULL_HANDLE ? 1 : 0;
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .pNext = nullptr,
+            .waitSemaphoreValueCount = waitCount,
+            .pWaitSemaphoreValues = &waitValue,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &timelineValue
+        };
+
+        VkSubmitInfo info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timelineSubmitInfo,
+            .waitSemaphoreCount = waitCount,
+            .pWaitSemaphores = &waitSemaphore,
+            .pWaitDstStageMask = &waitStage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &commandBuffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &timelineSemaphore
+        };
+
+        _device.ErrorCheck(vkQueueSubmit(_vkQueue, 1, &info, VK_NULL_HANDLE));
+
+        _pendingReleaseCommandBuffers.push_back(std::pair(timelineValue, commandBuffer));
+        _timelineValue.store(timelineValue, std::memory_order_release);
+
+        return timelineValue;
+    }
+
     void Queue::CollectGarbage() { impl->CollectGarbage(); }
     void ImplQueue::CollectGarbage()
     {
         uint64_t gpuTimeline = _submissionTimeline.GetValue();
 
-        while (!_pendingCommandLists.empty()) {
+        while (true) {
+            // only held for the pop, destroying resources below takes device locks
+            std::unique_lock<std::mutex> lock(_submitMutex);
+            if (_pendingCommandLists.empty())
+                break;
+
             std::pair<uint64_t, CommandList> cmdPair = _pendingCommandLists.front();
 
             // if needed value is higher than current timeline value, is in future
@@ -236,6 +450,7 @@ namespace WilloRHI
                 break;
 
             _pendingCommandLists.pop_front();
+            lock.unlock();
 
             CommandList cmdList = cmdPair.second;
             DeviceResources* resources = static_cast<DeviceResources*>(_device.GetDeviceResources());
@@ -266,5 +481,7 @@ namespace WilloRHI
 
             vkResetCommandBuffer((VkCommandBuffer)cmdList.GetNativeHandle(), 0);
         }
+
+        _device.impl->ReleaseRetiredResources();
     }
 }
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <atomic>
 #include <deque>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 #include "concurrentqueue.h"
 
 #include "WilloRHI/Queue.hpp"
@@ -26,7 +29,14 @@ namespace WilloRHI
 
         std::deque<std::pair<uint64_t, CommandList>> _pendingCommandLists;
         TimelineSemaphore _submissionTimeline;
-        uint64_t _timelineValue = 0;
+        std::atomic<uint64_t> _timelineValue = 0;
+
+        // other queues submit ownership releases on this one, so the VkQueue and timeline are guarded
+        std::mutex _submitMutex;
+        // barrier-only command buffers for ownership releases and acquires, recycled once the timeline passes them
+        VkCommandPool _releaseCommandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> _freeReleaseCommandBuffers;
+        std::deque<std::pair<uint64_t, VkCommandBuffer>> _pendingReleaseCommandBuffers;
 
         void Init(Device device, QueueType queueType, Queue parent);
 
@@ -38,6 +48,16 @@ namespace WilloRHI
         void Submit(const CommandSubmitInfo& submitInfo);
         void Present(const PresentInfo& presentInfo);
 
+        // records the release half of queue family ownership transfers away from this queue
+        // waits on the given value first if a semaphore is passed, for work on another queue that last used them
+        // returns the timeline value the acquiring submission has to wait on
+        uint64_t SubmitOwnershipRelease(const std::vector<VkBufferMemoryBarrier2>& bufferBarriers,
+            const std::vector<VkImageMemoryBarrier2>& imageBarriers, VkSemaphore waitSemaphore = VK_NULL_HANDLE, uint64_t waitValue = 0);
+
         void CollectGarbage();
+
+        // takes a recycled command buffer and records the barriers into it, _submitMutex has to be held
+        VkCommandBuffer RecordBarrierCommandBuffer(const std::vector<VkBufferMemoryBarrier2>& bufferBarriers,
+            const std::vector<VkImageMemoryBarrier2>& imageBarriers);
     };
 }
@@ -0,0 +1,360 @@
+#include "ImplReadbackManager.hpp"
+#include "ImplDevice.hpp"
+#include "ImplQueue.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace WilloRHI
+{
+    static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool Readback::IsReady() const { return impl != nullptr && impl->IsReady(); }
+    bool ImplReadback::IsReady()
+    {
+        uint64_t value = _timelineValue.load(std::memory_order_acquire);
+        if (value == 0 || _queue.impl->_submissionTimeline.GetValue() < value)
+            return false;
+
+        // two threads racing here both invalidate, which is harmless
+        if (!_invalidated.load(std::memory_order_acquire)) {
+            MappedRange range = { .buffer = _buffer, .offset = _offset, .size = _size };
+            _device.impl->InvalidateMappedRanges(1, &range);
+            _invalidated.store(true, std::memory_order_release);
+        }
+
+        return true;
+    }
+
+    bool Readback::Wait(uint64_t timeout) const { return impl != nullptr && impl->Wait(timeout); }
+    bool ImplReadback::Wait(uint64_t timeout)
+    {
+        uint64_t value = _timelineValue.load(std::memory_order_acquire);
+        if (value == 0) {
+            _device.LogMessage("Waiting on a readback that hasn't been flushed");
+            return false;
+        }
+
+        _queue.impl->_submissionTimeline.WaitValue(value, timeout);
+        return IsReady();
+    }
+
+    const void* Readback::GetData() const {
+        return IsReady() ? impl->_data : nullptr; }
+    uint64_t Readback::GetSize() const {
+        return impl != nullptr ? impl->_size : 0; }
+
+    ReadbackManager ReadbackManager::Create(Device device, Queue queue, const ReadbackManagerCreateInfo& createInfo)
+    {
+        ReadbackManager newManager;
+        newManager.impl = std::make_shared<ImplReadbackManager>();
+        newManager.impl->Init(device, queue, createInfo);
+        return newManager;
+    }
+
+    void ImplReadbackManager::Init(Device device, Queue queue, const ReadbackManagerCreateInfo& createInfo)
+    {
+        _device = device;
+        _queue = queue;
+        _createInfo = createInfo;
+
+        VkPhysicalDeviceProperties properties = {};
+        vkGetPhysicalDeviceProperties(_device.impl->_vkPhysicalDevice, &properties);
+        _offsetAlignment = std::max<uint64_t>(properties.limits.optimalBufferCopyOffsetAlignment, 16);
+
+        _ringSize = AlignUp(std::max<uint64_t>(createInfo.ringSize, _offsetAlignment), _offsetAlignment);
+
+        // random host access prefers cached memory, reading back from uncached memory is painfully slow
+        BufferCreateInfo bufferInfo = {
+            .size = _ringSize,
+            .usageFlags = BufferUsageFlag::TRANSFER_DST,
+            .allocationFlags = AllocationUsageFlag::HOST_ACCESS_RANDOM
+        };
+
+        // CreateBuffer logs why it failed
+        _ringBuffer = _device.CreateBuffer(bufferInfo);
+        if (_ringBuffer == INVALID_RESOURCE_ID)
+            return;
+
+        _ringPointer = static_cast<uint8_t*>(_device.impl->_resources.buffers.Metadata(_ringBuffer).mappedAddress);
+
+        _device.LogMessage("Created readback manager with a " + std::to_string(_ringSize) + " byte ring on "
+            + _queue.impl->_queueStr, false);
+    }
+
+    ImplReadbackManager::~ImplReadbackManager()
+    {
+        if (_ringBuffer == INVALID_RESOURCE_ID)
+            return;
+
+        // anything requested but never flushed would otherwise never become ready
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            FlushPending();
+        }
+
+        // destruction is deferred by the device, so copies in flight keep their destination
+        _device.DestroyBuffer(_ringBuffer);
+        for (std::shared_ptr<ImplReadback>& readback : _dedicatedReadbacks)
+            _device.DestroyBuffer(readback->_buffer);
+    }
+
+    Readback ReadbackManager::ReadBuffer(BufferId buffer, uint64_t offset, uint64_t size) {
+        return impl->ReadBuffer(buffer, offset, size); }
+    Readback ImplReadbackManager::ReadBuffer(BufferId buffer, uint64_t offset, uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!_device.impl->_resources.buffers.IsValid(buffer)) {
+            _device.LogMessage("Readback from stale or invalid buffer " + std::to_string(buffer));
+            return Readback{};
+        }
+
+        const BufferMetadata& metadata = _device.impl->_resources.buffers.Metadata(buffer);
+        if (!(metadata.createInfo.usageFlags & BufferUsageFlag::TRANSFER_SRC)) {
+            _device.LogMessage("Readback from buffer " + std::to_string(buffer) + " without TRANSFER_SRC usage");
+            return Readback{};
+        }
+
+        std::shared_ptr<ImplReadback> readback = Allocate(size, _offsetAlignment);
+        if (readback == nullptr)
+            return Readback{};
+
+        _pending.push_back({
+            .readback = readback,
+            .srcBuffer = buffer,
+            .bufferRegion = {
+                .srcOffset = offset,
+                .dstOffset = readback->_offset,
+                .size = size
+            }
+        });
+
+        Readback result;
+        result.impl = readback;
+        return result;
+    }
+
+    Readback ReadbackManager::ReadImage(const ImageReadbackInfo& readbackInfo) { return impl->ReadImage(readbackInfo); }
+    Readback ImplReadbackManager::ReadImage(const ImageReadbackInfo& readbackInfo)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (!_device.impl->_resources.images.IsValid(readbackInfo.image)) {
+            _device.LogMessage("Readback from stale or invalid image " + std::to_string(readbackInfo.image));
+            return Readback{};
+        }
+
+        const ImageMetadata& metadata = _device.impl->_resources.images.Metadata(readbackInfo.image);
+        if (!(metadata.createInfo.usageFlags & ImageUsageFlag::TRANSFER_SRC)) {
+            _device.LogMessage("Readback from image " + std::to_string(readbackInfo.image) + " without TRANSFER_SRC usage");
+            return Readback{};
+        }
+
+        // copies go through the image's full aspect, which is only one for everything but combined depth/stencil
+        const FormatInfo& block = GetFormatInfo(metadata.createInfo.format);
+        if (block.bytes == 0 || block.aspect == (FormatAspectFlag::DEPTH | FormatAspectFlag::STENCIL)) {
+            _device.LogMessage("Image readback doesn't support format " + std::to_string((uint32_t)metadata.createInfo.format));
+            return Readback{};
+        }
+
+        const Extent3D& extent = readbackInfo.extent;
+        uint64_t numBlocks = uint64_t((extent.width + block.blockWidth - 1) / block.blockWidth)
+            * ((extent.height + block.blockHeight - 1) / block.blockHeight) * extent.depth;
+        uint64_t size = numBlocks * block.bytes * readbackInfo.subresource.numLayers;
+
+        // copy offsets have to be a multiple of the block size and of 4
+        uint64_t alignment = std::lcm(std::lcm(_offsetAlignment, uint64_t(block.bytes)), uint64_t(4));
+
+        std::shared_ptr<ImplReadback> readback = Allocate(size, alignment);
+        if (readback == nullptr)
+            return Readback{};
+
+        _pending.push_back({
+            .readback = readback,
+            .srcImage = readbackInfo.image,
+            .imageRegion = {
+                .bufferOffset = readback->_offset,
+                .rowLength = 0,
+                .imageHeight = 0,
+                .imageSubresource = readbackInfo.subresource,
+                .imageOffset = readbackInfo.offset,
+                .extent = readbackInfo.extent
+            }
+        });
+
+        Readback result;
+        result.impl = readback;
+        return result;
+    }
+
+    void ReadbackManager::Flush() { impl->Flush(); }
+    void ImplReadbackManager::Flush()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        FlushPending();
+    }
+
+    void ImplReadbackManager::FlushPending()
+    {
+        if (_pending.empty())
+            return;
+
+        std::vector<BufferId> buffers;
+        std::vector<ImageId> images;
+        for (const PendingReadback& pending : _pending) {
+            if (pending.srcImage != INVALID_RESOURCE_ID)
+                images.push_back(pending.srcImage);
+            else
+                buffers.push_back(pending.srcBuffer);
+        }
+
+        std::sort(buffers.begin(), buffers.end());
+        buffers.erase(std::unique(buffers.begin(), buffers.end()), buffers.end());
+        std::sort(images.begin(), images.end());
+        images.erase(std::unique(images.begin(), images.end()), images.end());
+
+        CommandList cmdList = _queue.GetCmdList();
+        cmdList.Begin();
+
+        // copies read whatever was written by earlier work on this queue
+        cmdList.GlobalMemoryBarrier({
+            .srcStage = PipelineStageFlag::ALL_COMMANDS,
+            .dstStage = PipelineStageFlag::COPY,
+            .srcAccess = MemoryAccessFlag::WRITE,
+            .dstAccess = MemoryAccessFlag::READ
+        });
+
+        // also brings sources over from other queue families
+        for (BufferId buffer : buffers)
+            cmdList.BufferMemoryBarrier(buffer, { PipelineStageFlag::COPY, MemoryAccessFlag::READ });
+
+        std::vector<ImageLayout> previousLayouts;
+        for (ImageId image : images) {
+            const ImageCreateInfo& imageInfo = _device.impl->_resources.images.Metadata(image).createInfo;
+            previousLayouts.push_back(static_cast<ImageLayout>(_device.impl->_resources.images.At(image).currentLayout));
+
+            cmdList.ImageMemoryBarrier(image, {
+                .dstStage = PipelineStageFlag::COPY,
+                .dstAccess = MemoryAccessFlag::READ,
+                .dstLayout = ImageLayout::TRANSFER_SRC,
+                .subresourceRange = { 0, imageInfo.numLevels, 0, imageInfo.numLayers }
+            });
+        }
+
+        for (PendingReadback& pending : _pending) {
+            if (pending.srcImage != INVALID_RESOURCE_ID)
+                cmdList.CopyImageToBuffer(pending.srcImage, pending.readback->_buffer, 1, &pending.imageRegion);
+            else
+                cmdList.CopyBuffer(pending.srcBuffer, pending.readback->_buffer, 1, &pending.bufferRegion);
+        }
+
+        cmdList.GlobalMemoryBarrier({
+            .srcStage = PipelineStageFlag::COPY,
+            .dstStage = PipelineStageFlag::HOST,
+            .srcAccess = MemoryAccessFlag::WRITE,
+            .dstAccess = MemoryAccessFlag::READ
+        });
+
+        // images go back to the layout the app left them in
+        for (size_t i = 0; i < images.size(); i++) {
+            if (previousLayouts[i] == ImageLayout::UNDEFINED)
+                continue;
+
+            const ImageCreateInfo& imageInfo = _device.impl->_resources.images.Metadata(images[i]).createInfo;
+            cmdList.ImageMemoryBarrier(images[i], {
+                .dstStage = PipelineStageFlag::ALL_COMMANDS,
+                .dstAccess = MemoryAccessFlag::READ | MemoryAccessFlag::WRITE,
+                .dstLayout = previousLayouts[i],
+                .subresourceRange = { 0, imageInfo.numLevels, 0, imageInfo.numLayers }
+            });
+        }
+
+        cmdList.FlushBarriers();
+        cmdList.End();
+
+        CommandSubmitInfo submitInfo = {};
+        submitInfo.commandLists.push_back(cmdList);
+        _queue.Submit(submitInfo);
+
+        // can include another thread's later submission to the same queue, waiting a little longer is harmless
+        uint64_t value = _queue.impl->_timelineValue.load(std::memory_order_acquire);
+        for (PendingReadback& pending : _pending)
+            pending.readback->_timelineValue.store(value, std::memory_order_release);
+
+        _pending.clear();
+    }
+
+    std::shared_ptr<ImplReadback> ImplReadbackManager::Allocate(uint64_t size, uint64_t alignment)
+    {
+        Reclaim();
+
+        if (_ringReadbacks.empty())
+            _head = _tail = 0;
+
+        std::shared_ptr<ImplReadback> readback = std::make_shared<ImplReadback>();
+        readback->_device = _device;
+        readback->_queue = _queue;
+        readback->_size = size;
+
+        // readbacks never straddle the end of the ring, one that would starts the next lap instead
+        uint64_t lapStart = _head - _head % _ringSize;
+        uint64_t offset = AlignUp(_head - lapStart, alignment);
+        if (offset + size > _ringSize) {
+            lapStart += _ringSize;
+            offset = 0;
+        }
+
+        if (_ringPointer != nullptr && size <= _ringSize && lapStart + offset + size - _tail <= _ringSize) {
+            _head = lapStart + offset + size;
+
+            readback->_buffer = _ringBuffer;
+            readback->_offset = offset;
+            readback->_data = _ringPointer + offset;
+            _ringReadbacks.push_back({ _head, readback });
+            return readback;
+        }
+
+        // the ring is full of readbacks in flight or still held, this one gets a buffer of its own
+        BufferCreateInfo bufferInfo = {
+            .size = size,
+            .usageFlags = BufferUsageFlag::TRANSFER_DST,
+            .allocationFlags = AllocationUsageFlag::HOST_ACCESS_RANDOM
+        };
+
+        // CreateBuffer logs why it failed
+        BufferId buffer = _device.CreateBuffer(bufferInfo);
+        if (buffer == INVALID_RESOURCE_ID)
+            return nullptr;
+
+        readback->_buffer = buffer;
+        readback->_offset = 0;
+        readback->_data = static_cast<const uint8_t*>(_device.impl->_resources.buffers.Metadata(buffer).mappedAddress);
+        _dedicatedReadbacks.push_back(readback);
+        return readback;
+    }
+
+    void ImplReadbackManager::Reclaim()
+    {
+        while (!_ringReadbacks.empty() && IsReclaimable(_ringReadbacks.front().second)) {
+            _tail = _ringReadbacks.front().first;
+            _ringReadbacks.pop_front();
+        }
+
+        std::erase_if(_dedicatedReadbacks, [this](const std::shared_ptr<ImplReadback>& readback) {
+            if (!IsReclaimable(readback))
+                return false;
+            _device.DestroyBuffer(readback->_buffer);
+            return true;
+        });
+    }
+
+    bool ImplReadbackManager::IsReclaimable(const std::shared_ptr<ImplReadback>& readback) const
+    {
+        // only this manager holds it, and the copy into it isn't still running
+        uint64_t value = readback->_timelineValue.load(std::memory_order_acquire);
+        return readback.use_count() == 1 && value != 0 && _queue.impl->_submissionTimeline.GetValue() >= value;
+    }
+}
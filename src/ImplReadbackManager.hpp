@@ -0,0 +1,79 @@
+#pragma once
+
+#include "WilloRHI/ReadbackManager.hpp"
+#include "WilloRHI/CommandList.hpp"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace WilloRHI
+{
+    struct ImplReadback
+    {
+        Device _device;
+        Queue _queue;
+
+        BufferId _buffer = INVALID_RESOURCE_ID;
+        uint64_t _offset = 0;
+        uint64_t _size = 0;
+        const uint8_t* _data = nullptr;
+
+        // 0 until the copy is submitted
+        std::atomic<uint64_t> _timelineValue = 0;
+        // host-cached memory may not be coherent, it's invalidated once when first seen ready
+        std::atomic<bool> _invalidated = false;
+
+        bool IsReady();
+        bool Wait(uint64_t timeout);
+    };
+
+    struct PendingReadback
+    {
+        std::shared_ptr<ImplReadback> readback = nullptr;
+        BufferId srcBuffer = INVALID_RESOURCE_ID;
+        ImageId srcImage = INVALID_RESOURCE_ID;
+        BufferCopyRegion bufferRegion = {};
+        BufferImageCopyRegion imageRegion = {};
+    };
+
+    struct ImplReadbackManager
+    {
+        Device _device;
+        Queue _queue;
+        ReadbackManagerCreateInfo _createInfo = {};
+
+        BufferId _ringBuffer = INVALID_RESOURCE_ID;
+        uint8_t* _ringPointer = nullptr;
+        uint64_t _ringSize = 0;
+        uint64_t _offsetAlignment = 16;
+
+        // same scheme as the upload ring, positions only grow and [_tail, _head) is in use
+        // space is reclaimed in order, once the copy has landed and the app has let go of the readback
+        uint64_t _head = 0;
+        uint64_t _tail = 0;
+        std::deque<std::pair<uint64_t, std::shared_ptr<ImplReadback>>> _ringReadbacks;
+        std::vector<std::shared_ptr<ImplReadback>> _dedicatedReadbacks;
+
+        std::vector<PendingReadback> _pending;
+
+        std::mutex _mutex;
+
+        void Init(Device device, Queue queue, const ReadbackManagerCreateInfo& createInfo);
+
+        ~ImplReadbackManager();
+
+        Readback ReadBuffer(BufferId buffer, uint64_t offset, uint64_t size);
+        Readback ReadImage(const ImageReadbackInfo& readbackInfo);
+        void Flush();
+
+        // expects _mutex to be held
+        void FlushPending();
+        // expects _mutex to be held, returns a readback pointing into the ring or a dedicated buffer
+        std::shared_ptr<ImplReadback> Allocate(uint64_t size, uint64_t alignment);
+        void Reclaim();
+        bool IsReclaimable(const std::shared_ptr<ImplReadback>& readback) const;
+    };
+}
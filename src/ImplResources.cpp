@@ -1,50 +1,258 @@
 #include "ImplResources.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+// -0 folds into 0 and every NaN into one quiet NaN, raw bits would split either into several keys
+static uint32_t SamplerFloatBits(float value)
+{
+    if (value == 0.0f)
+        value = 0.0f;
+    else if (std::isnan(value))
+        value = std::numeric_limits<float>::quiet_NaN();
+    return std::bit_cast<uint32_t>(value);
+}
+
+size_t WilloRHI::SamplerCreateInfoHash::operator()(const SamplerCreateInfo& info) const
+{
+    size_t seed = 0;
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.magFilter));
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.minFilter));
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.mipFilter));
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.reductionMode));
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.addressModeU));
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.addressModeV));
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.addressModeW));
+    HashCombine(seed, std::hash<uint32_t>()(SamplerFloatBits(info.lodBias)));
+    HashCombine(seed, std::hash<bool>()(info.anisotropyEnable));
+    HashCombine(seed, std::hash<uint32_t>()(SamplerFloatBits(info.maxAnisotropy)));
+    HashCombine(seed, std::hash<bool>()(info.compareOpEnable));
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.compareOp));
+    HashCombine(seed, std::hash<uint32_t>()(SamplerFloatBits(info.minLod)));
+    HashCombine(seed, std::hash<uint32_t>()(SamplerFloatBits(info.maxLod)));
+    HashCombine(seed, std::hash<uint32_t>()((uint32_t)info.borderColour));
+    HashCombine(seed, std::hash<bool>()(info.unnormalizedCoordinates));
+    return seed;
+}
+
+bool WilloRHI::SamplerCreateInfoEqual::operator()(const SamplerCreateInfo& a, const SamplerCreateInfo& b) const
+{
+    return a.magFilter == b.magFilter && a.minFilter == b.minFilter && a.mipFilter == b.mipFilter
+        && a.reductionMode == b.reductionMode && a.addressModeU == b.addressModeU && a.addressModeV == b.addressModeV
+        && a.addressModeW == b.addressModeW && SamplerFloatBits(a.lodBias) == SamplerFloatBits(b.lodBias)
+        && a.anisotropyEnable == b.anisotropyEnable && SamplerFloatBits(a.maxAnisotropy) == SamplerFloatBits(b.maxAnisotropy)
+        && a.compareOpEnable == b.compareOpEnable && a.compareOp == b.compareOp
+        && SamplerFloatBits(a.minLod) == SamplerFloatBits(b.minLod) && SamplerFloatBits(a.maxLod) == SamplerFloatBits(b.maxLod)
+        && a.borderColour == b.borderColour && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
 bool WilloRHI::IsDepthFormat(Format format)
 {
-    switch (format)
-    {
-        case Format::D16_UNORM:
-            return true;
-        case Format::X8_D24_UNORM_PACK32:
-            return true;
-        case Format::D32_SFLOAT:
-            return true;
-        case Format::S8_UINT:
-            return true;
-        case Format::D16_UNORM_S8_UINT:
-            return true;
-        case Format::D24_UNORM_S8_UINT:
-            return true;
-        case Format::D32_SFLOAT_S8_UINT:
-            return true;
-        default: 
-            return false;
-    }
+    return (bool)(GetFormatInfo(format).aspect & FormatAspectFlag::DEPTH);
 }
 
 bool WilloRHI::IsStencilFormat(Format format)
 {
-    switch (format)
-    {
-        case Format::S8_UINT:
-            return true;
-        case Format::D16_UNORM_S8_UINT:
-            return true;
-        case Format::D24_UNORM_S8_UINT:
-            return true;
-        case Format::D32_SFLOAT_S8_UINT:
-            return true;
-        default:
-            return false;
-    }
+    return (bool)(GetFormatInfo(format).aspect & FormatAspectFlag::STENCIL);
 }
 
 VkImageAspectFlags WilloRHI::AspectFromFormat(Format format)
 {
-    if (IsDepthFormat(format) || IsStencilFormat(format))
+    return (VkImageAspectFlags)(uint32_t)GetFormatInfo(format).aspect;
+}
+
+VkBufferUsageFlags WilloRHI::BufferUsageFromFlags(BufferUsageFlags usageFlags)
+{
+    // every buffer gets an entry in the address table, beyond that only what was asked for
+    return static_cast<VkBufferUsageFlags>(usageFlags) | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+}
+
+namespace WilloRHI
+{
+    struct SlotCache {
+        // upper half indexes a group of 32 slots, lower half holds the free slots claimed from it
+        // the owning thread pops with a CAS, threads draining it take everything with one exchange
+        alignas(64) std::atomic<uint64_t> claimed = 0;
+
+        // set when the owning thread exits, its slots are handed back by the next registration or drain
+        std::atomic<bool> abandoned = false;
+        // set when the allocator is destroyed, the owning thread drops its reference on its next lookup
+        std::atomic<bool> orphaned = false;
+    };
+
+    // allocator ids are never reused, so a thread can't mistake a cache for one of a newer allocator
+    static std::atomic<uint32_t> nextAllocatorId = 0;
+
+    struct ThreadSlotCaches {
+        struct Entry {
+            uint32_t allocatorId = 0;
+            std::shared_ptr<SlotCache> cache = nullptr;
+        };
+        std::vector<Entry> entries;
+
+        ~ThreadSlotCaches() {
+            for (Entry& entry : entries)
+                entry.cache->abandoned.store(true, std::memory_order_release);
+        }
+
+        SlotCache& Get(SlotAllocator& allocator) {
+            for (Entry& entry : entries) {
+                if (entry.allocatorId == allocator._allocatorId)
+                    return *entry.cache;
+            }
+
+            // first use of this allocator on this thread, a good time to drop caches of destroyed ones
+            std::erase_if(entries, [](const Entry& entry) { return entry.cache->orphaned.load(std::memory_order_acquire); });
+
+            std::shared_ptr<SlotCache> cache = std::make_shared<SlotCache>();
+            allocator.AddCache(cache);
+            entries.push_back({ .allocatorId = allocator._allocatorId, .cache = cache });
+            return *cache;
+        }
+    };
+
+    static thread_local ThreadSlotCaches threadSlotCaches;
+
+    void SlotAllocator::Init(uint32_t maxCount)
     {
-        return (IsDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : 0) | (IsStencilFormat(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+        _maxCount = maxCount;
+        _numWords = (maxCount + 63) / 64;
+        _occupancy = std::make_unique<std::atomic<uint64_t>[]>(_numWords);
+
+        // bits past the end of the ID space are permanently occupied
+        uint32_t tailBits = maxCount % 64;
+        if (tailBits != 0)
+            _occupancy[_numWords - 1].store(~0ull << tailBits, std::memory_order_relaxed);
+
+        // small id spaces claim fewer at a time, so one thread can't hoard most of them
+        _batchSize = std::clamp(maxCount / 64, 1u, MAX_BATCH_SIZE);
+
+        _allocatorId = nextAllocatorId.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    SlotAllocator::~SlotAllocator()
+    {
+        std::lock_guard<std::mutex> lock(_cachesMutex);
+        for (const std::shared_ptr<SlotCache>& cache : _caches)
+            cache->orphaned.store(true, std::memory_order_release);
+        _caches.clear();
+    }
+
+    uint32_t SlotAllocator::Allocate()
+    {
+        SlotCache& cache = threadSlotCaches.Get(*this);
+
+        uint64_t claimed = cache.claimed.load(std::memory_order_relaxed);
+        while ((uint32_t)claimed != 0) {
+            uint32_t bit = (uint32_t)std::countr_zero((uint32_t)claimed);
+            if (cache.claimed.compare_exchange_weak(claimed, claimed & ~(1ull << bit), std::memory_order_acquire, std::memory_order_relaxed))
+                return (uint32_t)(claimed >> 32) * 32 + bit;
+        }
+
+        // the bitmap being empty doesn't mean every slot is in use, other threads may be sitting on free ones
+        // a racing thread can claim what was drained first, so keep going until there's nothing left to drain
+        uint32_t slot = ClaimFromBitmap(cache);
+        while (slot == INVALID_RESOURCE_ID && DrainCaches())
+            slot = ClaimFromBitmap(cache);
+        return slot;
+    }
+
+    uint32_t SlotAllocator::ClaimFromBitmap(SlotCache& cache)
+    {
+        uint32_t startWord = _cursor.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < _numWords; i++) {
+            uint32_t wordIndex = (startWord + i) % _numWords;
+            std::atomic<uint64_t>& word = _occupancy[wordIndex];
+
+            uint64_t current = word.load(std::memory_order_relaxed);
+            while (current != ~0ull) {
+                // lowest free slots first, keeps the ID space dense
+                // a batch stays inside the 32-slot group of the lowest one so the cache can hold it in one word
+                uint64_t free = ~current;
+                uint32_t group = (uint32_t)std::countr_zero(free) / 32;
+                free &= 0xffffffffull << (group * 32);
+
+                uint64_t claimed = 0;
+                for (uint32_t n = 0; n < _batchSize && free != 0; n++) {
+                    claimed |= free & (~free + 1);
+                    free &= free - 1;
+                }
+
+                if (!word.compare_exchange_weak(current, current | claimed, std::memory_order_acquire, std::memory_order_relaxed))
+                    continue;
+
+                // leave the shared cursor on this word until it fills up
+                if ((current | claimed) == ~0ull)
+                    _cursor.store((wordIndex + 1) % _numWords, std::memory_order_relaxed);
+                else if (wordIndex != startWord)
+                    _cursor.store(wordIndex, std::memory_order_relaxed);
+
+                // return the lowest, the cache is empty here and drainers only ever clear it
+                uint32_t slot = wordIndex * 64 + (uint32_t)std::countr_zero(claimed);
+                claimed &= claimed - 1;
+                uint64_t groupIndex = uint64_t(wordIndex) * 2 + group;
+                cache.claimed.store((groupIndex << 32) | (uint32_t)(claimed >> (group * 32)), std::memory_order_release);
+                return slot;
+            }
+        }
+
+        return INVALID_RESOURCE_ID;
+    }
+
+    void SlotAllocator::ReleaseCache(SlotCache& cache)
+    {
+        uint64_t claimed = cache.claimed.exchange(0, std::memory_order_acq_rel);
+        if ((uint32_t)claimed == 0)
+            return;
+
+        uint32_t groupIndex = (uint32_t)(claimed >> 32);
+        uint64_t bits = uint64_t((uint32_t)claimed) << ((groupIndex % 2) * 32);
+        _occupancy[groupIndex / 2].fetch_and(~bits, std::memory_order_release);
+    }
+
+    bool SlotAllocator::DrainCaches()
+    {
+        bool drained = false;
+
+        std::lock_guard<std::mutex> lock(_cachesMutex);
+        for (const std::shared_ptr<SlotCache>& cache : _caches) {
+            if ((uint32_t)cache->claimed.load(std::memory_order_relaxed) == 0)
+                continue;
+
+            ReleaseCache(*cache);
+            drained = true;
+        }
+
+        return drained;
+    }
+
+    void SlotAllocator::AddCache(const std::shared_ptr<SlotCache>& cache)
+    {
+        std::lock_guard<std::mutex> lock(_cachesMutex);
+
+        // caches of exited threads hand back what they held and are dropped
+        std::erase_if(_caches, [&](const std::shared_ptr<SlotCache>& existing) {
+            if (!existing->abandoned.load(std::memory_order_acquire))
+                return false;
+            ReleaseCache(*existing);
+            return true;
+        });
+
+        _caches.push_back(cache);
+    }
+
+    void SlotAllocator::Free(uint32_t slot)
+    {
+        uint32_t wordIndex = slot / 64;
+        _occupancy[wordIndex].fetch_and(~(1ull << (slot % 64)), std::memory_order_release);
+
+        // pull the cursor back so freed slots are reused before fresh ones, keeping the ID space dense
+        if (wordIndex < _cursor.load(std::memory_order_relaxed))
+            _cursor.store(wordIndex, std::memory_order_relaxed);
     }
-    return VK_IMAGE_ASPECT_COLOR_BIT;
 }
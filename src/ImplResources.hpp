@@ -1,116 +1,305 @@
 #pragma once
 
-#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <vulkan/vulkan.h>
 
 #include <concurrentqueue.h>
 #include <vk_mem_alloc.h>
 
 #include "WilloRHI/Resources.hpp"
+#include "WilloRHI/Device.hpp"
 
 namespace WilloRHI
 {
-    static const inline VkBufferUsageFlags BUFFER_USAGE_FLAGS = 
-        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    // resource records are split in two, the hot half holds handles and barrier state
+    // read by every command recorded, the cold half holds everything else
+    // both live in their own dense arrays so recording never pulls cold data into cache
+
+    struct SmallBufferBlock;
+
+    // the queue whose submission last used an exclusive resource, and that submission's timeline value
+    // written by Queue::Submit in submission order, guarded by the device's ownership mutex
+    struct QueueOwnership {
+        ImplQueue* queue = nullptr;
+        uint64_t lastUse = 0;
+    };
 
     struct BufferResource {
         VkBuffer buffer = VK_NULL_HANDLE;
-        VkDeviceAddress deviceAddress = 0;
+        // suballocated buffers share their VkBuffer, everything binding one has to add the offset
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = VK_WHOLE_SIZE;
 
         VkPipelineStageFlags2 currentPipelineStage = VK_PIPELINE_STAGE_2_NONE;
         VkAccessFlags2 currentAccessFlags = VK_ACCESS_2_NONE;
 
+        // queue family the last recorded use of an exclusive buffer ran on, IGNORED until first use
+        // recording state like the access flags, releases are placed by owner instead
+        // concurrent buffers never change hands so never need a transfer
+        uint32_t ownerQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+        bool concurrent = false;
+
+        QueueOwnership owner = {};
+    };
+
+    struct BufferMetadata {
+        VkDeviceAddress deviceAddress = 0;
+
         void* mappedAddress = nullptr;
         bool isMapped = false;
 
         VmaAllocation allocation = VK_NULL_HANDLE;
         BufferCreateInfo createInfo = {};
+
+        // set when carved out of a shared block instead of owning allocation
+        SmallBufferBlock* smallBufferBlock = nullptr;
+        VmaVirtualAllocation virtualAllocation = VK_NULL_HANDLE;
+
+        // set for imported and exportable buffers, which are bound to it directly instead of through vma
+        VkDeviceMemory externalMemory = VK_NULL_HANDLE;
     };
 
     struct ImageResource {
         VkImage image = VK_NULL_HANDLE;
 
+        VkPipelineStageFlags2 currentPipelineStage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 currentAccessFlags = VK_ACCESS_2_NONE;
+        VkImageLayout currentLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_NONE;
+
+        uint32_t ownerQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+        QueueOwnership owner = {};
+    };
+
+    struct ImageViewCacheEntry {
+        ImageViewCreateInfo createInfo = {};
+        ImageViewId imageView = INVALID_RESOURCE_ID;
+    };
+
+    struct ImageMetadata {
         void* mappedAddress = nullptr;
         bool isMapped = false;
 
         VmaAllocation allocation = VK_NULL_HANDLE;
         ImageCreateInfo createInfo = {};
 
-        VkPipelineStageFlags2 currentPipelineStage = VK_PIPELINE_STAGE_2_NONE;
-        VkAccessFlags2 currentAccessFlags = VK_ACCESS_2_NONE;
-        VkImageLayout currentLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_NONE;
+        // every live view of this image, guarded by the device's image view mutex
+        std::vector<ImageViewCacheEntry> views;
+
+        // set for imported and exportable images, which are bound to it directly instead of through vma
+        VkDeviceMemory externalMemory = VK_NULL_HANDLE;
     };
 
     struct ImageViewResource {
         VkImageView imageView = VK_NULL_HANDLE;
+    };
+
+    struct ImageViewMetadata {
         ImageViewCreateInfo createInfo = {};
+
+        // kept on the view itself so it can be released whatever state its parent image is in
+        // guarded by the device's image view mutex
+        uint32_t refCount = 0;
+        bool retired = false;
     };
 
     struct SamplerResource {
         VkSampler sampler = VK_NULL_HANDLE;
+    };
+
+    struct SamplerMetadata {
         SamplerCreateInfo createInfo = {};
     };
 
-    template <typename Resource_T>
+    struct SlotCache;
+
+    // lock-free slot allocator, an occupancy bitmap of atomic words claimed with CAS from a shared atomic cursor
+    // threads claim a small batch of free slots at once into a thread-local cache, so most Allocate() calls
+    // only CAS a cache line no other thread writes, Free() clears the slot's bit straight away
+    // once the bitmap runs dry, slots sitting in other threads' caches are drained back into it
+    struct SlotAllocator {
+        // most slots claimed at a time, less for small id spaces, never more than one 32-slot group
+        static const inline uint32_t MAX_BATCH_SIZE = 16;
+
+        SlotAllocator() = default;
+        SlotAllocator(const SlotAllocator&) = delete;
+        SlotAllocator& operator=(const SlotAllocator&) = delete;
+        ~SlotAllocator();
+
+        void Init(uint32_t maxCount);
+
+        // returns INVALID_RESOURCE_ID once every slot is in use
+        uint32_t Allocate();
+        void Free(uint32_t slot);
+
+        // thread caches register on first use, the allocator drops them when it's destroyed or their thread exits
+        void AddCache(const std::shared_ptr<SlotCache>& cache);
+
+        uint32_t ClaimFromBitmap(SlotCache& cache);
+        // returns whether any slots went back to the bitmap
+        bool DrainCaches();
+        void ReleaseCache(SlotCache& cache);
+
+        std::unique_ptr<std::atomic<uint64_t>[]> _occupancy = nullptr;
+        uint32_t _numWords = 0;
+        uint32_t _maxCount = 0;
+        uint32_t _batchSize = 1;
+        uint32_t _allocatorId = 0;
+
+        // only taken to register a cache, drain them, or on destruction
+        std::mutex _cachesMutex;
+        std::vector<std::shared_ptr<SlotCache>> _caches;
+
+        // word to start scanning from, moved forward as words fill and back as slots are freed below it
+        alignas(64) std::atomic<uint32_t> _cursor = 0;
+    };
+
+    // slots are reserved up front as an ID space, but records are only committed
+    // a page at a time once a slot inside that page is first handed out
+    static const inline uint32_t RESOURCE_PAGE_BITS = 10;
+    static const inline uint32_t RESOURCE_PAGE_SIZE = 1u << RESOURCE_PAGE_BITS;
+    static const inline uint32_t RESOURCE_PAGE_MASK = RESOURCE_PAGE_SIZE - 1;
+
+    // stale ids are caught by comparing their generation against the slot's current one
+    // At/Metadata/Free only check in validating builds, public entry points taking ids check IsValid themselves
+#if !defined(WilloRHI_VALIDATE_HANDLES) && !defined(NDEBUG)
+#define WilloRHI_VALIDATE_HANDLES
+#endif
+
+    template <typename Resource_T, typename Metadata_T>
     struct ResourceMap {
-        Resource_T* resources = nullptr;
-        moodycamel::ConcurrentQueue<uint32_t> freeSlotQueue;
+        std::unique_ptr<std::atomic<Resource_T*>[]> pages = nullptr;
+        std::unique_ptr<std::atomic<Metadata_T*>[]> metadataPages = nullptr;
+        std::unique_ptr<std::atomic<std::atomic<uint32_t>*>[]> generationPages = nullptr;
+        uint32_t numPages = 0;
+
+        SlotAllocator slotAllocator;
         uint32_t maxNumResources = 0;
-        std::string resourceNameHash;
-
-        ResourceMap() {}
-        ResourceMap(uint32_t maxCount) {
-
-            // TODO: investigate getting rid of moodycamel
-            /*
-            just use an atomic counter to index into the list
-            once counter hits max, set to 0 and go again
-            keep an extra list of bools showing which slots are used
-            this would probably perform better and use less RAM, need to test
-            */
-
-            resources = new Resource_T[maxCount];
-            
-            freeSlotQueue = moodycamel::ConcurrentQueue<uint32_t>(maxCount);
+        std::string resourceName;
+        RHILoggingFunc logCallback = nullptr;
+
+        ResourceMap() = default;
+        ResourceMap(const ResourceMap&) = delete;
+        ResourceMap& operator=(const ResourceMap&) = delete;
+
+        ~ResourceMap() {
+            for (uint32_t i = 0; i < numPages; i++) {
+                delete[] pages[i].load(std::memory_order_relaxed);
+                delete[] metadataPages[i].load(std::memory_order_relaxed);
+                delete[] generationPages[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        void Init(uint32_t maxCount, const std::string& name, RHILoggingFunc logFunc) {
             maxNumResources = maxCount;
+            numPages = (maxCount + RESOURCE_PAGE_MASK) >> RESOURCE_PAGE_BITS;
 
-            std::vector<uint32_t> vec;
-            for (uint32_t i = 0; i < maxNumResources; i++)
-                vec.push_back(i);
-            freeSlotQueue.enqueue_bulk(vec.begin(), maxNumResources);
+            // only the page tables are allocated here, pages themselves are committed lazily
+            pages = std::make_unique<std::atomic<Resource_T*>[]>(numPages);
+            metadataPages = std::make_unique<std::atomic<Metadata_T*>[]>(numPages);
+            generationPages = std::make_unique<std::atomic<std::atomic<uint32_t>*>[]>(numPages);
+            slotAllocator.Init(maxCount);
 
-            resourceNameHash = typeid(Resource_T).name();
+            resourceName = name;
+            logCallback = logFunc;
         }
 
         uint32_t Allocate() {
-            uint32_t newSlot = 0;
-            freeSlotQueue.try_dequeue(newSlot);
-            return newSlot;
+            uint32_t newSlot = slotAllocator.Allocate();
+            if (newSlot == INVALID_RESOURCE_ID)
+                return INVALID_RESOURCE_ID;
+
+            CommitPage(pages[newSlot >> RESOURCE_PAGE_BITS]);
+            CommitPage(metadataPages[newSlot >> RESOURCE_PAGE_BITS]);
+            CommitPage(generationPages[newSlot >> RESOURCE_PAGE_BITS]);
+
+            return MakeResourceId(newSlot, Generation(newSlot).load(std::memory_order_relaxed));
+        }
+
+        template <typename T>
+        static void CommitPage(std::atomic<T*>& page) {
+            if (page.load(std::memory_order_acquire) != nullptr)
+                return;
+
+            // several threads may race to commit the same page, only one of them wins
+            T* newPage = new T[RESOURCE_PAGE_SIZE]();
+            T* expected = nullptr;
+            if (!page.compare_exchange_strong(expected, newPage, std::memory_order_acq_rel))
+                delete[] newPage;
+        }
+
+        std::atomic<uint32_t>& Generation(uint32_t index) const {
+            return generationPages[index >> RESOURCE_PAGE_BITS].load(std::memory_order_acquire)[index & RESOURCE_PAGE_MASK];
         }
 
-        Resource_T& At(uint32_t index) const {
-            return resources[index];
+        // ids handed out by Allocate always have their page committed, so past the reserved invalid id
+        // this is a single relaxed load of the slot's generation
+        // never-allocated and out of range ids are only caught when validating
+        bool IsValid(uint32_t id) const {
+            if (id == INVALID_RESOURCE_ID)
+                return false;
+            uint32_t index = ResourceIndex(id);
+#ifdef WilloRHI_VALIDATE_HANDLES
+            if (index >= maxNumResources || generationPages[index >> RESOURCE_PAGE_BITS].load(std::memory_order_acquire) == nullptr)
+                return false;
+#endif
+            return Generation(index).load(std::memory_order_relaxed) == ResourceGeneration(id);
         }
 
-        void Free(uint32_t index) {
-            freeSlotQueue.enqueue(index);
+        bool Validate(uint32_t id) const {
+            if (IsValid(id))
+                return true;
+            if (logCallback)
+                logCallback("WilloRHI Error: Stale or invalid " + resourceName + " id " + std::to_string(id));
+            return false;
         }
+
+        Resource_T& At(uint32_t id) const {
+#ifdef WilloRHI_VALIDATE_HANDLES
+            // bad ids get a scratch record instead of reading through a null or recycled page
+            if (!Validate(id))
+                return invalidRecord = {};
+#endif
+            uint32_t index = ResourceIndex(id);
+            return pages[index >> RESOURCE_PAGE_BITS].load(std::memory_order_acquire)[index & RESOURCE_PAGE_MASK];
+        }
+
+        Metadata_T& Metadata(uint32_t id) const {
+#ifdef WilloRHI_VALIDATE_HANDLES
+            if (!Validate(id))
+                return invalidMetadata = {};
+#endif
+            uint32_t index = ResourceIndex(id);
+            return metadataPages[index >> RESOURCE_PAGE_BITS].load(std::memory_order_acquire)[index & RESOURCE_PAGE_MASK];
+        }
+
+        void Free(uint32_t id) {
+#ifdef WilloRHI_VALIDATE_HANDLES
+            if (!Validate(id))
+                return;
+#endif
+            // bumping the generation invalidates every outstanding copy of this id
+            uint32_t index = ResourceIndex(id);
+            std::atomic<uint32_t>& generation = Generation(index);
+            generation.store((generation.load(std::memory_order_relaxed) + 1) & RESOURCE_GENERATION_MASK, std::memory_order_relaxed);
+            slotAllocator.Free(index);
+        }
+
+#ifdef WilloRHI_VALIDATE_HANDLES
+        mutable Resource_T invalidRecord = {};
+        mutable Metadata_T invalidMetadata = {};
+#endif
     };
 
     struct DeviceResources {
-        ResourceMap<BufferResource> buffers;
-        ResourceMap<ImageResource> images;
-        ResourceMap<ImageViewResource> imageViews;
-        ResourceMap<SamplerResource> samplers;
-
-        std::shared_mutex resourcesMutex;
+        ResourceMap<BufferResource, BufferMetadata> buffers;
+        ResourceMap<ImageResource, ImageMetadata> images;
+        ResourceMap<ImageViewResource, ImageViewMetadata> imageViews;
+        ResourceMap<SamplerResource, SamplerMetadata> samplers;
     };
 
     struct DeletionQueues {
@@ -125,13 +314,50 @@ namespace WilloRHI
         QueueType<SamplerId> samplerQueue = QueueType<SamplerId>();
     };
 
+    inline void HashCombine(size_t& seed, size_t value) {
+        seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+    }
+
+    // floats are compared by normalised bits, so -0 matches 0 and a NaN field still finds its own entry
+    struct SamplerCreateInfoHash {
+        size_t operator()(const SamplerCreateInfo& info) const;
+    };
+
+    struct SamplerCreateInfoEqual {
+        bool operator()(const SamplerCreateInfo& a, const SamplerCreateInfo& b) const;
+    };
+
+    struct SamplerCacheEntry {
+        SamplerId sampler = INVALID_RESOURCE_ID;
+        uint32_t refCount = 0;
+    };
+
     bool IsDepthFormat(Format format);
     bool IsStencilFormat(Format format);
     VkImageAspectFlags AspectFromFormat(Format format);
+    VkBufferUsageFlags BufferUsageFromFlags(BufferUsageFlags usageFlags);
+
+    // bindings 0-4 in WilloRHI_Shared.h
+    constexpr uint32_t GLOBAL_DESCRIPTOR_BINDING_COUNT = 5;
 
     struct GlobalDescriptors {
-        VkDescriptorPool pool;
-        VkDescriptorSetLayout setLayout;
-        VkDescriptorSet descriptorSet;
+        VkDescriptorPool pool = VK_NULL_HANDLE;
+        VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        // VK_EXT_descriptor_buffer backend, replaces the pool and set when supported
+        bool useDescriptorBuffer = false;
+        VkBuffer descriptorBuffer = VK_NULL_HANDLE;
+        VmaAllocation descriptorBufferAllocation = VK_NULL_HANDLE;
+        VkDeviceAddress descriptorBufferAddress = 0;
+        uint8_t* descriptorBufferPtr = nullptr;
+        VkDeviceSize bindingOffsets[GLOBAL_DESCRIPTOR_BINDING_COUNT] = {};
+        VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProperties = {};
+
+        PFN_vkGetDescriptorSetLayoutSizeEXT pfnGetDescriptorSetLayoutSize = nullptr;
+        PFN_vkGetDescriptorSetLayoutBindingOffsetEXT pfnGetDescriptorSetLayoutBindingOffset = nullptr;
+        PFN_vkGetDescriptorEXT pfnGetDescriptor = nullptr;
+        PFN_vkCmdBindDescriptorBuffersEXT pfnCmdBindDescriptorBuffers = nullptr;
+        PFN_vkCmdSetDescriptorBufferOffsetsEXT pfnCmdSetDescriptorBufferOffsets = nullptr;
     };
 }
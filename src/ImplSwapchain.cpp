@@ -65,16 +65,22 @@ namespace WilloRHI
         for (uint32_t i = 0; i < createInfo.framesInFlight; i++)
         {
             uint32_t imageId = resources->images.Allocate();
+            if (imageId == INVALID_RESOURCE_ID) {
+                device.LogMessage("Out of image slots for swapchain images");
+                break;
+            }
 
             ImageResource resource = {
                 .image = vkImages.at(i),
-                .createInfo = {
-                    .size = {createInfo.width, createInfo.height, 1}
-                },
                 .aspect = VK_IMAGE_ASPECT_COLOR_BIT
             };
 
             resources->images.At(imageId) = resource;
+            resources->images.Metadata(imageId) = ImageMetadata{
+                .createInfo = {
+                    .size = {createInfo.width, createInfo.height, 1}
+                }
+            };
             _images.at(i) = ImageId{imageId};
 
             _imageSync.push_back(WilloRHI::BinarySemaphore::Create(pDevice));
@@ -90,7 +96,7 @@ namespace WilloRHI
     void ImplSwapchain::Cleanup() {
         DeviceResources* resources = (DeviceResources*)device.GetDeviceResources();
         for (int i = 0; i < _framesInFlight; i++) {
-            resources->images.freeSlotQueue.enqueue(_images.at(i));
+            resources->images.Free(_images.at(i));
         }
 
         vkDestroySwapchainKHR(vkDevice, _vkSwapchain, nullptr);
@@ -215,16 +221,22 @@ namespace WilloRHI
         {
             resources->images.Free(_images.at(i));
             uint32_t imageId = resources->images.Allocate();
+            if (imageId == INVALID_RESOURCE_ID) {
+                device.LogMessage("Out of image slots for swapchain images");
+                break;
+            }
 
             ImageResource resource = {
                 .image = vkImages.at(i),
-                .createInfo = {
-                    .size = {width, height, 1}
-                },
                 .aspect = VK_IMAGE_ASPECT_COLOR_BIT
             };
 
             resources->images.At(imageId) = resource;
+            resources->images.Metadata(imageId) = ImageMetadata{
+                .createInfo = {
+                    .size = {width, height, 1}
+                }
+            };
             _images.at(i) = ImageId{imageId};
         }
 
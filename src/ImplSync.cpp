@@ -2,6 +2,32 @@
 
 namespace WilloRHI
 {
+    // what the driver can do with opaque fds of timeline semaphores
+    static VkExternalSemaphoreFeatureFlags OpaqueFdTimelineFeatures(Device device)
+    {
+        VkSemaphoreTypeCreateInfo typeInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .pNext = nullptr,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        };
+
+        VkPhysicalDeviceExternalSemaphoreInfo externalInfo = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO,
+            .pNext = &typeInfo,
+            .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT
+        };
+
+        VkExternalSemaphoreProperties properties = {
+            .sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES,
+            .pNext = nullptr
+        };
+
+        vkGetPhysicalDeviceExternalSemaphoreProperties(static_cast<VkPhysicalDevice>(device.GetPhysicalDeviceNativeHandle()),
+            &externalInfo, &properties);
+        return properties.externalSemaphoreFeatures;
+    }
+
     BinarySemaphore BinarySemaphore::Create(Device device)
     {
         BinarySemaphore newSemaphore;
@@ -34,11 +60,21 @@ namespace WilloRHI
         vkDestroySemaphore(m_vkDevice, vkSemaphore, nullptr);
     }
 
-    TimelineSemaphore TimelineSemaphore::Create(Device device, uint64_t value)
+    TimelineSemaphore TimelineSemaphore::Create(Device device, uint64_t value, bool exportable)
     {
         TimelineSemaphore newSemaphore;
         newSemaphore.impl = std::make_shared<ImplTimelineSemaphore>();
-        newSemaphore.impl->Init(device, value);
+        newSemaphore.impl->Init(device, value, exportable);
+        return newSemaphore;
+    }
+
+    TimelineSemaphore TimelineSemaphore::Import(Device device, int fd)
+    {
+        TimelineSemaphore newSemaphore;
+        newSemaphore.impl = std::make_shared<ImplTimelineSemaphore>();
+        newSemaphore.impl->Init(device, 0, false);
+        if (!newSemaphore.impl->Import(fd))
+            newSemaphore.impl = nullptr;
         return newSemaphore;
     }
 
@@ -46,14 +82,27 @@ namespace WilloRHI
         return static_cast<void*>(impl->vkSemaphore);
     }
 
-    void ImplTimelineSemaphore::Init(Device device, uint64_t value)
+    void ImplTimelineSemaphore::Init(Device device, uint64_t value, bool exportable)
     {
         m_Device = device;
         m_vkDevice = static_cast<VkDevice>(device.GetDeviceNativeHandle());
 
+        // chaining the export info for a handle type the driver can't export is invalid
+        if (exportable && !(OpaqueFdTimelineFeatures(device) & VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT)) {
+            m_Device.LogMessage("Timeline semaphores can't be exported as opaque fds on this device, creating it unexportable");
+            exportable = false;
+        }
+        this->exportable = exportable;
+
+        VkExportSemaphoreCreateInfo exportInfo = {
+            .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+            .pNext = nullptr,
+            .handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT
+        };
+
         VkSemaphoreTypeCreateInfo typeInfo = {
             .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
-            .pNext = nullptr,
+            .pNext = exportable ? &exportInfo : nullptr,
             .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
             .initialValue = value
         };
@@ -92,4 +141,55 @@ namespace WilloRHI
         m_Device.ErrorCheck(vkGetSemaphoreCounterValue(m_vkDevice, vkSemaphore, &result));
         return result;
     }
+
+    int TimelineSemaphore::ExportFd() { return impl->ExportFd(); }
+    int ImplTimelineSemaphore::ExportFd() {
+        // null unless VK_KHR_external_semaphore_fd was enabled
+        auto pfnGetSemaphoreFd = reinterpret_cast<PFN_vkGetSemaphoreFdKHR>(vkGetDeviceProcAddr(m_vkDevice, "vkGetSemaphoreFdKHR"));
+        if (!exportable || pfnGetSemaphoreFd == nullptr) {
+            m_Device.LogMessage("Timeline semaphore isn't exportable");
+            return -1;
+        }
+
+        VkSemaphoreGetFdInfoKHR getFdInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+            .pNext = nullptr,
+            .semaphore = vkSemaphore,
+            .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT
+        };
+
+        int fd = -1;
+        m_Device.ErrorCheck(pfnGetSemaphoreFd(m_vkDevice, &getFdInfo, &fd));
+        return fd;
+    }
+
+    bool ImplTimelineSemaphore::Import(int fd) {
+        auto pfnImportSemaphoreFd = reinterpret_cast<PFN_vkImportSemaphoreFdKHR>(vkGetDeviceProcAddr(m_vkDevice, "vkImportSemaphoreFdKHR"));
+        if (pfnImportSemaphoreFd == nullptr) {
+            m_Device.LogMessage("Importing semaphores needs VK_KHR_external_semaphore_fd");
+            return false;
+        }
+
+        if (!(OpaqueFdTimelineFeatures(m_Device) & VK_EXTERNAL_SEMAPHORE_FEATURE_IMPORTABLE_BIT)) {
+            m_Device.LogMessage("Timeline semaphores can't be imported from opaque fds on this device");
+            return false;
+        }
+
+        // permanent, timeline semaphores can't be imported temporarily
+        VkImportSemaphoreFdInfoKHR importInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+            .pNext = nullptr,
+            .semaphore = vkSemaphore,
+            .flags = 0,
+            .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT,
+            .fd = fd
+        };
+
+        VkResult result = pfnImportSemaphoreFd(m_vkDevice, &importInfo);
+        if (result != VK_SUCCESS) {
+            m_Device.LogMessage("Failed to import timeline semaphore");
+            return false;
+        }
+        return true;
+    }
 }
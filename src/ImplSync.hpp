@@ -18,15 +18,18 @@ namespace WilloRHI
     };
 
     struct ImplTimelineSemaphore {
-        void Init(Device device, uint64_t value);
+        void Init(Device device, uint64_t value, bool exportable);
+        bool Import(int fd);
         ~ImplTimelineSemaphore();
 
         void WaitValue(uint64_t value, uint64_t timeout);
         uint64_t GetValue();
+        int ExportFd();
 
         Device m_Device;
         VkDevice m_vkDevice = VK_NULL_HANDLE;
 
         VkSemaphore vkSemaphore = VK_NULL_HANDLE;
+        bool exportable = false;
     };
 }
@@ -0,0 +1,184 @@
+#include "ImplTransientAllocator.hpp"
+#include "ImplDevice.hpp"
+#include "ImplQueue.hpp"
+
+#include <algorithm>
+
+namespace WilloRHI
+{
+    TransientAllocator TransientAllocator::Create(Device device, Queue queue, const TransientAllocatorCreateInfo& createInfo)
+    {
+        TransientAllocator newAllocator;
+        newAllocator.impl = std::make_shared<ImplTransientAllocator>();
+        newAllocator.impl->Init(device, queue, createInfo);
+        return newAllocator;
+    }
+
+    void ImplTransientAllocator::Init(Device device, Queue queue, const TransientAllocatorCreateInfo& createInfo)
+    {
+        _device = device;
+        _queue = queue;
+        _createInfo = createInfo;
+
+        for (uint32_t i = 0; i < createInfo.initialChunkCount; i++) {
+            if (TransientChunk* chunk = CreateChunk(createInfo.chunkSize))
+                _freeChunks.push_back(chunk);
+        }
+
+        _currentChunk.store(AcquireChunk(), std::memory_order_release);
+
+        _device.LogMessage("Created transient allocator with " + std::to_string(createInfo.initialChunkCount)
+            + " chunks of " + std::to_string(createInfo.chunkSize) + " bytes", false);
+    }
+
+    ImplTransientAllocator::~ImplTransientAllocator()
+    {
+        // destruction is deferred by the device, chunks still in flight stay alive until their work completes
+        for (std::unique_ptr<TransientChunk>& chunk : _chunks)
+            _device.DestroyBuffer(chunk->buffer);
+    }
+
+    TransientAllocation TransientAllocator::Allocate(uint64_t size, uint64_t alignment) {
+        return impl->Allocate(size, alignment); }
+    TransientAllocation ImplTransientAllocator::Allocate(uint64_t size, uint64_t alignment)
+    {
+        alignment = std::max<uint64_t>(alignment, 1);
+
+        // too big for a shared chunk, give it one of its own for this frame
+        if (size > _createInfo.chunkSize) {
+            std::lock_guard<std::mutex> lock(_chunkMutex);
+            TransientChunk* dedicated = CreateChunk(size);
+            if (dedicated == nullptr)
+                return TransientAllocation{};
+
+            dedicated->head.store(size, std::memory_order_relaxed);
+            _frameChunks.push_back(dedicated);
+            return TransientAllocation{
+                .buffer = dedicated->buffer,
+                .offset = 0,
+                .deviceAddress = dedicated->deviceAddress,
+                .hostPointer = dedicated->hostPointer
+            };
+        }
+
+        while (true) {
+            TransientChunk* chunk = _currentChunk.load(std::memory_order_acquire);
+
+            uint64_t offset = 0;
+            bool fits = false;
+            if (chunk != nullptr) {
+                uint64_t head = chunk->head.load(std::memory_order_relaxed);
+                do {
+                    offset = (head + alignment - 1) / alignment * alignment;
+                    fits = offset + size <= chunk->size;
+                } while (fits && !chunk->head.compare_exchange_weak(head, offset + size, std::memory_order_relaxed));
+            }
+
+            if (fits) {
+                return TransientAllocation{
+                    .buffer = chunk->buffer,
+                    .offset = offset,
+                    .deviceAddress = chunk->deviceAddress + offset,
+                    .hostPointer = chunk->hostPointer + offset
+                };
+            }
+
+            // chunk is full, whoever gets here first swaps in the next one
+            std::lock_guard<std::mutex> lock(_chunkMutex);
+            if (_currentChunk.load(std::memory_order_relaxed) == chunk) {
+                TransientChunk* next = AcquireChunk();
+                if (next == nullptr)
+                    return TransientAllocation{};
+
+                if (chunk != nullptr)
+                    _frameChunks.push_back(chunk);
+                _currentChunk.store(next, std::memory_order_release);
+            }
+        }
+    }
+
+    void TransientAllocator::EndFrame() { impl->EndFrame(); }
+    void ImplTransientAllocator::EndFrame()
+    {
+        std::lock_guard<std::mutex> lock(_chunkMutex);
+
+        // everything used this frame is referenced by work submitted up to now
+        uint64_t frameValue = _queue.impl->_timelineValue.load(std::memory_order_acquire);
+
+        TransientChunk* current = _currentChunk.load(std::memory_order_relaxed);
+        if (current != nullptr && current->head.load(std::memory_order_relaxed) != 0) {
+            _frameChunks.push_back(current);
+            _currentChunk.store(nullptr, std::memory_order_relaxed);
+        }
+
+        for (TransientChunk* chunk : _frameChunks)
+            _pendingChunks.push_back({ frameValue, chunk });
+        _frameChunks.clear();
+
+        uint64_t gpuValue = _queue.impl->_submissionTimeline.GetValue();
+        while (!_pendingChunks.empty() && _pendingChunks.front().first <= gpuValue) {
+            TransientChunk* chunk = _pendingChunks.front().second;
+            _pendingChunks.pop_front();
+
+            if (chunk->size != _createInfo.chunkSize) {
+                DestroyChunk(chunk);
+                continue;
+            }
+
+            chunk->head.store(0, std::memory_order_relaxed);
+            _freeChunks.push_back(chunk);
+        }
+
+        if (_currentChunk.load(std::memory_order_relaxed) == nullptr)
+            _currentChunk.store(AcquireChunk(), std::memory_order_release);
+    }
+
+    TransientChunk* ImplTransientAllocator::CreateChunk(uint64_t size)
+    {
+        BufferCreateInfo bufferInfo = {
+            .size = size,
+            // transient data ends up as anything from shader constants to copy sources
+            .usageFlags = BufferUsageFlag::STORAGE | BufferUsageFlag::TRANSFER_SRC | BufferUsageFlag::VERTEX
+                | BufferUsageFlag::INDEX | BufferUsageFlag::INDIRECT,
+            .allocationFlags = AllocationUsageFlag::HOST_ACCESS_SEQUENTIAL_WRITE
+        };
+
+        // CreateBuffer logs why it failed
+        BufferId buffer = _device.CreateBuffer(bufferInfo);
+        if (buffer == INVALID_RESOURCE_ID)
+            return nullptr;
+
+        const BufferMetadata& metadata = _device.impl->_resources.buffers.Metadata(buffer);
+
+        std::unique_ptr<TransientChunk> chunk = std::make_unique<TransientChunk>();
+        chunk->buffer = buffer;
+        chunk->size = size;
+        chunk->hostPointer = static_cast<uint8_t*>(metadata.mappedAddress);
+        chunk->deviceAddress = metadata.deviceAddress;
+
+        _chunks.push_back(std::move(chunk));
+        return _chunks.back().get();
+    }
+
+    TransientChunk* ImplTransientAllocator::AcquireChunk()
+    {
+        if (_freeChunks.empty()) {
+            _device.LogMessage("Transient allocator out of chunks, creating another", false);
+            return CreateChunk(_createInfo.chunkSize);
+        }
+
+        TransientChunk* chunk = _freeChunks.back();
+        _freeChunks.pop_back();
+        return chunk;
+    }
+
+    void ImplTransientAllocator::DestroyChunk(TransientChunk* chunk)
+    {
+        _device.DestroyBuffer(chunk->buffer);
+
+        auto it = std::find_if(_chunks.begin(), _chunks.end(), [chunk](const std::unique_ptr<TransientChunk>& owned) {
+            return owned.get() == chunk; });
+        if (it != _chunks.end())
+            _chunks.erase(it);
+    }
+}
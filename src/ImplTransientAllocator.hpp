@@ -0,0 +1,52 @@
+#pragma once
+
+#include "WilloRHI/TransientAllocator.hpp"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace WilloRHI
+{
+    struct TransientChunk
+    {
+        BufferId buffer = INVALID_RESOURCE_ID;
+        uint8_t* hostPointer = nullptr;
+        uint64_t deviceAddress = 0;
+        uint64_t size = 0;
+
+        std::atomic<uint64_t> head = 0;
+    };
+
+    struct ImplTransientAllocator
+    {
+        Device _device;
+        Queue _queue;
+        TransientAllocatorCreateInfo _createInfo = {};
+
+        // owns every chunk, everything else refers into this
+        std::vector<std::unique_ptr<TransientChunk>> _chunks;
+
+        std::atomic<TransientChunk*> _currentChunk = nullptr;
+        // chunks filled or dedicated during the current frame
+        std::vector<TransientChunk*> _frameChunks;
+        // chunks waiting on the queue timeline value of the frame that used them
+        std::deque<std::pair<uint64_t, TransientChunk*>> _pendingChunks;
+        std::vector<TransientChunk*> _freeChunks;
+
+        std::mutex _chunkMutex;
+
+        void Init(Device device, Queue queue, const TransientAllocatorCreateInfo& createInfo);
+
+        ~ImplTransientAllocator();
+
+        TransientAllocation Allocate(uint64_t size, uint64_t alignment);
+        void EndFrame();
+
+        TransientChunk* CreateChunk(uint64_t size);
+        TransientChunk* AcquireChunk();
+        void DestroyChunk(TransientChunk* chunk);
+    };
+}
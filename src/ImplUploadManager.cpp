@@ -0,0 +1,672 @@
+#include "ImplUploadManager.hpp"
+#include "ImplDevice.hpp"
+#include "ImplQueue.hpp"
+#include "ImplFileReader.hpp"
+#include "WilloRHI/StagingWriter.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace WilloRHI
+{
+    static constexpr uint64_t INVALID_STAGING_OFFSET = ~0ull;
+
+    static uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // writes numTexels texels of the image's format into staging, converting from the upload's source format
+    using StagingConversion = void (*)(void* dst, const void* src, uint64_t numTexels);
+
+    // null when there's no conversion between the two
+    static StagingConversion GetStagingConversion(Format source, Format destination)
+    {
+        auto isPair = [&](Format from, Format to) { return source == from && destination == to; };
+
+        if (isPair(Format::R8G8B8_UNORM, Format::R8G8B8A8_UNORM) || isPair(Format::R8G8B8_SRGB, Format::R8G8B8A8_SRGB)
+            || isPair(Format::B8G8R8_UNORM, Format::B8G8R8A8_UNORM) || isPair(Format::B8G8R8_SRGB, Format::B8G8R8A8_SRGB))
+            return [](void* dst, const void* src, uint64_t numTexels) { ExpandRGB8ToRGBA8(dst, src, numTexels); };
+
+        if (isPair(Format::R32_SFLOAT, Format::R16_SFLOAT))
+            return [](void* dst, const void* src, uint64_t numTexels) {
+                ConvertFloatToHalf(dst, static_cast<const float*>(src), numTexels); };
+        if (isPair(Format::R32G32_SFLOAT, Format::R16G16_SFLOAT))
+            return [](void* dst, const void* src, uint64_t numTexels) {
+                ConvertFloatToHalf(dst, static_cast<const float*>(src), numTexels * 2); };
+        if (isPair(Format::R32G32B32A32_SFLOAT, Format::R16G16B16A16_SFLOAT))
+            return [](void* dst, const void* src, uint64_t numTexels) {
+                ConvertFloatToHalf(dst, static_cast<const float*>(src), numTexels * 4); };
+
+        if (isPair(Format::R32G32B32A32_SFLOAT, Format::R8G8B8A8_SRGB))
+            return [](void* dst, const void* src, uint64_t numTexels) {
+                PackRGBA32FToSRGB8(dst, static_cast<const float*>(src), numTexels); };
+
+        return nullptr;
+    }
+
+    UploadManager UploadManager::Create(Device device, Queue queue, const UploadManagerCreateInfo& createInfo)
+    {
+        UploadManager newManager;
+        newManager.impl = std::make_shared<ImplUploadManager>();
+        newManager.impl->Init(device, queue, createInfo);
+        return newManager;
+    }
+
+    void ImplUploadManager::Init(Device device, Queue queue, const UploadManagerCreateInfo& createInfo)
+    {
+        _device = device;
+        _queue = queue;
+        _createInfo = createInfo;
+
+        VkPhysicalDeviceProperties properties = {};
+        vkGetPhysicalDeviceProperties(_device.impl->_vkPhysicalDevice, &properties);
+        _offsetAlignment = std::max<uint64_t>(properties.limits.optimalBufferCopyOffsetAlignment, 16);
+        _rowPitchAlignment = std::max<uint64_t>(properties.limits.optimalBufferCopyRowPitchAlignment, 1);
+
+        uint32_t numQueueFamilies = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(_device.impl->_vkPhysicalDevice, &numQueueFamilies, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(numQueueFamilies);
+        vkGetPhysicalDeviceQueueFamilyProperties(_device.impl->_vkPhysicalDevice, &numQueueFamilies, queueFamilies.data());
+
+        // some dedicated transfer queues can only copy in coarse blocks or whole mip levels
+        VkExtent3D granularity = queueFamilies[_queue.impl->_vkQueueIndex].minImageTransferGranularity;
+        _texelGranularity = granularity.width == 1 && granularity.height == 1 && granularity.depth == 1;
+        _depthGranularity = granularity.depth;
+
+        _stagingSize = AlignUp(std::max<uint64_t>(createInfo.stagingSize, _offsetAlignment), _offsetAlignment);
+        _maxPieceSize = std::max<uint64_t>(_stagingSize / 4, _offsetAlignment);
+
+        BufferCreateInfo bufferInfo = {
+            .size = _stagingSize,
+            .usageFlags = BufferUsageFlag::TRANSFER_SRC,
+            .allocationFlags = AllocationUsageFlag::HOST_ACCESS_SEQUENTIAL_WRITE
+        };
+
+        // CreateBuffer logs why it failed
+        _stagingBuffer = _device.CreateBuffer(bufferInfo);
+        if (_stagingBuffer == INVALID_RESOURCE_ID)
+            return;
+
+        const BufferMetadata& stagingMetadata = _device.impl->_resources.buffers.Metadata(_stagingBuffer);
+        _stagingPointer = static_cast<uint8_t*>(stagingMetadata.mappedAddress);
+
+        // O_DIRECT has the kernel pin the destination pages, which a device-local bar mapping can't be
+        VkMemoryPropertyFlags memoryFlags = 0;
+        if (stagingMetadata.allocation != VK_NULL_HANDLE)
+            vmaGetAllocationMemoryProperties(_device.impl->_allocator, stagingMetadata.allocation, &memoryFlags);
+        _stagingHostCached = (memoryFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) && !(memoryFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        _device.LogMessage("Created upload manager with " + std::to_string(_stagingSize) + " bytes of staging on "
+            + _queue.impl->_queueStr, false);
+    }
+
+    ImplUploadManager::~ImplUploadManager()
+    {
+        if (_stagingBuffer == INVALID_RESOURCE_ID)
+            return;
+
+        // anything staged but never flushed would be lost otherwise
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            FlushPending();
+        }
+
+        // destruction is deferred by the device, so copies in flight keep their source
+        _device.DestroyBuffer(_stagingBuffer);
+    }
+
+    void UploadManager::UploadBuffer(BufferId buffer, uint64_t offset, const void* data, uint64_t size) {
+        impl->UploadBuffer(buffer, offset, data, size); }
+    void ImplUploadManager::UploadBuffer(BufferId buffer, uint64_t offset, const void* data, uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_stagingPointer == nullptr)
+            return;
+
+        if (!_device.impl->_resources.buffers.IsValid(buffer)) {
+            _device.LogMessage("Upload to stale or invalid buffer " + std::to_string(buffer));
+            return;
+        }
+
+        const BufferMetadata& metadata = _device.impl->_resources.buffers.Metadata(buffer);
+
+        // UPLOAD buffers that ended up mapped live in host-visible device memory, staging them would only add a copy
+        // every upload to such a buffer goes this way, so it never races a staged copy to the same range
+        if ((metadata.createInfo.allocationFlags & AllocationUsageFlag::UPLOAD) && metadata.isMapped) {
+            StreamCopy(static_cast<uint8_t*>(metadata.mappedAddress) + offset, data, size);
+
+            MappedRange range = { .buffer = buffer, .offset = offset, .size = size };
+            _device.impl->FlushMappedRanges(1, &range);
+            return;
+        }
+
+        if (!(metadata.createInfo.usageFlags & BufferUsageFlag::TRANSFER_DST)) {
+            _device.LogMessage("Upload to buffer " + std::to_string(buffer) + " without TRANSFER_DST usage");
+            return;
+        }
+
+        const uint8_t* source = static_cast<const uint8_t*>(data);
+
+        for (uint64_t uploaded = 0; uploaded < size;) {
+            uint64_t pieceSize = std::min(size - uploaded, _maxPieceSize);
+
+            uint64_t stagingOffset = Reserve(pieceSize, _offsetAlignment);
+            if (stagingOffset == INVALID_STAGING_OFFSET)
+                return;
+
+            StreamCopy(_stagingPointer + stagingOffset, source + uploaded, pieceSize);
+            _stagedRanges.push_back({ .buffer = _stagingBuffer, .offset = stagingOffset, .size = pieceSize });
+
+            _pendingBuffers.push_back({
+                .buffer = buffer,
+                .region = {
+                    .srcOffset = stagingOffset,
+                    .dstOffset = offset + uploaded,
+                    .size = pieceSize
+                }
+            });
+
+            uploaded += pieceSize;
+            _batchBytes += pieceSize;
+            if (_batchBytes >= _createInfo.batchSize)
+                FlushPending();
+        }
+    }
+
+    void UploadManager::UploadImage(const ImageUploadInfo& uploadInfo) { impl->UploadImage(uploadInfo); }
+    void ImplUploadManager::UploadImage(const ImageUploadInfo& uploadInfo)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_stagingPointer == nullptr)
+            return;
+
+        if (!_device.impl->_resources.images.IsValid(uploadInfo.image)) {
+            _device.LogMessage("Upload to stale or invalid image " + std::to_string(uploadInfo.image));
+            return;
+        }
+
+        const ImageMetadata& metadata = _device.impl->_resources.images.Metadata(uploadInfo.image);
+        if (!(metadata.createInfo.usageFlags & ImageUsageFlag::TRANSFER_DST)) {
+            _device.LogMessage("Upload to image " + std::to_string(uploadInfo.image) + " without TRANSFER_DST usage");
+            return;
+        }
+
+        // copies go through the image's full aspect, which is only one for everything but combined depth/stencil
+        const FormatInfo& block = GetFormatInfo(metadata.createInfo.format);
+        if (block.bytes == 0 || block.aspect == (FormatAspectFlag::DEPTH | FormatAspectFlag::STENCIL)) {
+            _device.LogMessage("Image upload doesn't support format " + std::to_string((uint32_t)metadata.createInfo.format));
+            return;
+        }
+
+        // the conversions only cover uncompressed formats, so a block is a texel on both sides
+        StagingConversion conversion = nullptr;
+        uint64_t sourceBytes = block.bytes;
+        if (uploadInfo.sourceFormat != Format::UNDEFINED && uploadInfo.sourceFormat != metadata.createInfo.format) {
+            conversion = GetStagingConversion(uploadInfo.sourceFormat, metadata.createInfo.format);
+            if (conversion == nullptr) {
+                _device.LogMessage("Image upload can't convert format " + std::to_string((uint32_t)uploadInfo.sourceFormat)
+                    + " to " + std::to_string((uint32_t)metadata.createInfo.format));
+                return;
+            }
+            sourceBytes = GetFormatInfo(uploadInfo.sourceFormat).bytes;
+        }
+
+        const Extent3D& extent = uploadInfo.extent;
+        uint32_t numBlocksX = (extent.width + block.blockWidth - 1) / block.blockWidth;
+        uint32_t numBlocksY = (extent.height + block.blockHeight - 1) / block.blockHeight;
+
+        uint32_t sourceWidth = uploadInfo.rowLength != 0 ? uploadInfo.rowLength : extent.width;
+        uint32_t sourceHeight = uploadInfo.imageHeight != 0 ? uploadInfo.imageHeight : extent.height;
+        uint64_t sourceRowPitch = uint64_t((sourceWidth + block.blockWidth - 1) / block.blockWidth) * sourceBytes;
+        uint64_t sourceSlicePitch = sourceRowPitch * ((sourceHeight + block.blockHeight - 1) / block.blockHeight);
+        uint64_t sourceLayerPitch = sourceSlicePitch * extent.depth;
+
+        // staged rows are padded to the device's preferred pitch as long as that still holds whole blocks
+        uint64_t rowBytes = uint64_t(numBlocksX) * block.bytes;
+        uint64_t rowPitch = AlignUp(rowBytes, _rowPitchAlignment);
+        if (rowPitch % block.bytes != 0)
+            rowPitch = rowBytes;
+
+        // copy offsets have to be a multiple of the block size and of 4
+        uint64_t alignment = std::lcm(std::lcm(_offsetAlignment, uint64_t(block.bytes)), uint64_t(4));
+
+        // rows of one slice when the queue copies single texels, otherwise as many whole slices as fit in a piece
+        // in multiples of its depth granularity
+        uint32_t rowsPerPiece = numBlocksY;
+        uint32_t slicesPerPiece = 1;
+        if (_texelGranularity) {
+            rowsPerPiece = (uint32_t)std::clamp<uint64_t>(_maxPieceSize / rowPitch, 1, numBlocksY);
+        } else if (_depthGranularity == 0) {
+            slicesPerPiece = extent.depth;
+        } else {
+            uint64_t slicesThatFit = _maxPieceSize / (rowPitch * numBlocksY) / _depthGranularity * _depthGranularity;
+            slicesPerPiece = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(slicesThatFit, _depthGranularity), std::max(extent.depth, 1u));
+        }
+
+        const uint8_t* source = static_cast<const uint8_t*>(uploadInfo.data);
+
+        for (uint32_t layer = 0; layer < uploadInfo.subresource.numLayers; layer++) {
+            for (uint32_t slice = 0; slice < extent.depth; slice += slicesPerPiece) {
+                uint32_t numSlices = std::min(slicesPerPiece, extent.depth - slice);
+                for (uint32_t row = 0; row < numBlocksY; row += rowsPerPiece) {
+                    uint32_t numRows = std::min(rowsPerPiece, numBlocksY - row);
+                    uint64_t pieceSize = rowPitch * numRows * numSlices;
+
+                    BufferId pieceBuffer = _stagingBuffer;
+                    uint64_t stagingOffset = 0;
+                    uint8_t* piecePointer = nullptr;
+                    if (pieceSize + alignment > _stagingSize) {
+                        pieceBuffer = CreateTemporaryStaging(pieceSize, piecePointer);
+                        if (pieceBuffer == INVALID_RESOURCE_ID)
+                            return;
+                    } else {
+                        stagingOffset = Reserve(pieceSize, alignment);
+                        if (stagingOffset == INVALID_STAGING_OFFSET)
+                            return;
+                        piecePointer = _stagingPointer + stagingOffset;
+                    }
+
+                    for (uint32_t s = 0; s < numSlices; s++) {
+                        const uint8_t* sourceSlice = source + layer * sourceLayerPitch + (slice + s) * sourceSlicePitch;
+                        uint8_t* stagingSlice = piecePointer + uint64_t(s) * numRows * rowPitch;
+
+                        if (conversion != nullptr) {
+                            // tightly packed on both sides converts as one run
+                            if (rowPitch == rowBytes && sourceRowPitch == uint64_t(numBlocksX) * sourceBytes) {
+                                conversion(stagingSlice, sourceSlice + row * sourceRowPitch, uint64_t(numRows) * numBlocksX);
+                                continue;
+                            }
+                            for (uint32_t r = 0; r < numRows; r++)
+                                conversion(stagingSlice + r * rowPitch, sourceSlice + (row + r) * sourceRowPitch, numBlocksX);
+                            continue;
+                        }
+
+                        // matching pitches copy as one run, the gaps between rows are padding either way
+                        if (rowPitch == sourceRowPitch) {
+                            StreamCopy(stagingSlice, sourceSlice + row * sourceRowPitch, uint64_t(numRows - 1) * rowPitch + rowBytes);
+                            continue;
+                        }
+                        for (uint32_t r = 0; r < numRows; r++)
+                            StreamCopy(stagingSlice + r * rowPitch, sourceSlice + (row + r) * sourceRowPitch, rowBytes);
+                    }
+                    _stagedRanges.push_back({ .buffer = pieceBuffer, .offset = stagingOffset, .size = pieceSize });
+
+                    _pendingImages.push_back({
+                        .image = uploadInfo.image,
+                        .source = pieceBuffer,
+                        .region = {
+                            .bufferOffset = stagingOffset,
+                            .rowLength = (uint32_t)(rowPitch / block.bytes) * block.blockWidth,
+                            .imageHeight = numRows * block.blockHeight,
+                            .imageSubresource = {
+                                .level = uploadInfo.subresource.level,
+                                .baseLayer = uploadInfo.subresource.baseLayer + layer,
+                                .numLayers = 1
+                            },
+                            .imageOffset = {
+                                uploadInfo.offset.x,
+                                uploadInfo.offset.y + (int32_t)(row * block.blockHeight),
+                                uploadInfo.offset.z + (int32_t)slice
+                            },
+                            .extent = {
+                                extent.width,
+                                std::min(numRows * block.blockHeight, extent.height - row * block.blockHeight),
+                                numSlices
+                            }
+                        },
+                        .finalLayout = uploadInfo.finalLayout
+                    });
+
+                    _batchBytes += pieceSize;
+                    if (_batchBytes >= _createInfo.batchSize)
+                        FlushPending();
+                }
+            }
+        }
+    }
+
+    bool UploadManager::UploadBufferFromFile(BufferId buffer, uint64_t offset, const std::string& path, uint64_t fileOffset, uint64_t size) {
+        return impl->UploadBufferFromFile(buffer, offset, path, fileOffset, size); }
+    bool ImplUploadManager::UploadBufferFromFile(BufferId buffer, uint64_t offset, const std::string& path, uint64_t fileOffset, uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_stagingPointer == nullptr)
+            return false;
+
+        if (!_device.impl->_resources.buffers.IsValid(buffer)) {
+            _device.LogMessage("Upload to stale or invalid buffer " + std::to_string(buffer));
+            return false;
+        }
+
+        const BufferMetadata& metadata = _device.impl->_resources.buffers.Metadata(buffer);
+        if (!(metadata.createInfo.usageFlags & BufferUsageFlag::TRANSFER_DST)) {
+            _device.LogMessage("Upload to buffer " + std::to_string(buffer) + " without TRANSFER_DST usage");
+            return false;
+        }
+
+        // unbuffered reads dma straight into staging, which needs the mapping itself page aligned and in system memory
+        // FileReader still redoes a read buffered if the kernel turns the destination down
+        bool unbuffered = _stagingHostCached && reinterpret_cast<uintptr_t>(_stagingPointer) % 4096 == 0;
+
+        FileReader reader;
+        if (!reader.Open(path, _createInfo.maxFileReadsInFlight, unbuffered)) {
+            _device.LogMessage("Failed to open " + path + " for upload");
+            return false;
+        }
+
+        struct FileRead {
+            uint64_t ringPosition = 0;
+            uint64_t stagingOffset = 0;
+            // unbuffered reads start at an aligned file offset before the wanted data
+            uint64_t skip = 0;
+            uint64_t dstOffset = 0;
+            uint64_t size = 0;
+        };
+
+        std::vector<FileRead> reads(reader.queueDepth);
+        std::vector<uint32_t> freeReads;
+        for (uint32_t i = reader.queueDepth; i > 0; i--)
+            freeReads.push_back(i - 1);
+
+        uint64_t alignment = std::max(reader.alignment, _offsetAlignment);
+        uint64_t maxReadSize = std::max(_maxPieceSize / reader.alignment * reader.alignment, reader.alignment);
+
+        std::vector<FileReadCompletion> completions;
+        uint64_t requested = 0;
+        bool failed = false;
+
+        while ((requested < size && !failed) || reader.numInFlight > 0) {
+            // keep reads going for as long as the ring has room without waiting
+            while (requested < size && !failed && !freeReads.empty()) {
+                uint64_t fileStart = fileOffset + requested;
+                uint64_t skip = fileStart % reader.alignment;
+                uint64_t pieceSize = std::min(size - requested, maxReadSize - skip);
+                uint64_t readSize = AlignUp(skip + pieceSize, reader.alignment);
+
+                uint64_t stagingOffset = 0;
+                if (reader.numInFlight == 0) {
+                    stagingOffset = Reserve(readSize, alignment);
+                    if (stagingOffset == INVALID_STAGING_OFFSET) {
+                        failed = true;
+                        break;
+                    }
+                } else if (!TryReserve(readSize, alignment, stagingOffset)) {
+                    break;
+                }
+
+                uint32_t readIndex = freeReads.back();
+                freeReads.pop_back();
+
+                reads[readIndex] = {
+                    .ringPosition = _head - readSize,
+                    .stagingOffset = stagingOffset,
+                    .skip = skip,
+                    .dstOffset = offset + requested,
+                    .size = pieceSize
+                };
+
+                _fileReadPositions.insert(reads[readIndex].ringPosition);
+                reader.Read(_stagingPointer + stagingOffset, readSize, fileStart - skip, readIndex);
+                requested += pieceSize;
+            }
+
+            completions.clear();
+            int pollResult = reader.Poll(completions, true);
+            if (pollResult < 0) {
+                _device.LogMessage("Reading " + path + " failed, error " + std::to_string(-pollResult));
+
+                // the staging space of reads that never completed is free again once the reader is closed
+                reader.Close();
+                for (uint32_t i = 0; i < reads.size(); i++) {
+                    if (std::find(freeReads.begin(), freeReads.end(), i) == freeReads.end())
+                        _fileReadPositions.erase(reads[i].ringPosition);
+                }
+                return false;
+            }
+
+            // the copy for each piece is queued as soon as its read lands
+            for (const FileReadCompletion& completion : completions) {
+                const FileRead& read = reads[completion.userData];
+                _fileReadPositions.erase(read.ringPosition);
+                freeReads.push_back((uint32_t)completion.userData);
+
+                if (completion.result < (int64_t)(read.skip + read.size)) {
+                    if (!failed)
+                        _device.LogMessage("Reading " + path + " failed at offset " + std::to_string(fileOffset + read.dstOffset - offset)
+                            + (completion.result < 0 ? ", error " + std::to_string(-completion.result) : ", file too short"));
+                    failed = true;
+                    continue;
+                }
+
+                _stagedRanges.push_back({ .buffer = _stagingBuffer, .offset = read.stagingOffset + read.skip, .size = read.size });
+                _pendingBuffers.push_back({
+                    .buffer = buffer,
+                    .region = {
+                        .srcOffset = read.stagingOffset + read.skip,
+                        .dstOffset = read.dstOffset,
+                        .size = read.size
+                    }
+                });
+
+                _batchBytes += read.size;
+                if (_batchBytes >= _createInfo.batchSize)
+                    FlushPending();
+            }
+        }
+
+        return !failed;
+    }
+
+    uint64_t UploadManager::Flush() { return impl->Flush(); }
+    uint64_t ImplUploadManager::Flush()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return FlushPending();
+    }
+
+    TimelineSemaphore UploadManager::GetTimeline() const { return impl->GetTimeline(); }
+    TimelineSemaphore ImplUploadManager::GetTimeline() const
+    {
+        return _queue.impl->_submissionTimeline;
+    }
+
+    bool UploadManager::IsComplete(uint64_t value) const { return impl->IsComplete(value); }
+    bool ImplUploadManager::IsComplete(uint64_t value) const
+    {
+        return _queue.impl->_submissionTimeline.GetValue() >= value;
+    }
+
+    uint64_t ImplUploadManager::FlushPending()
+    {
+        if (_pendingBuffers.empty() && _pendingImages.empty())
+            return _lastFlushValue;
+
+        _device.impl->FlushMappedRanges((uint32_t)_stagedRanges.size(), _stagedRanges.data());
+        _stagedRanges.clear();
+
+        // one run of copies per destination
+        std::stable_sort(_pendingBuffers.begin(), _pendingBuffers.end(), [](const PendingBufferUpload& a, const PendingBufferUpload& b) {
+            return a.buffer < b.buffer; });
+        std::stable_sort(_pendingImages.begin(), _pendingImages.end(), [](const PendingImageUpload& a, const PendingImageUpload& b) {
+            return a.image < b.image; });
+
+        CommandList cmdList = _queue.GetCmdList();
+        cmdList.Begin();
+
+        // earlier work on the destinations has to finish before they're overwritten
+        // on another queue family this is also where ownership comes over to this queue
+        for (size_t i = 0; i < _pendingBuffers.size(); i++) {
+            if (i == 0 || _pendingBuffers[i].buffer != _pendingBuffers[i - 1].buffer)
+                cmdList.BufferMemoryBarrier(_pendingBuffers[i].buffer, { PipelineStageFlag::COPY, MemoryAccessFlag::WRITE });
+        }
+
+        // only the levels and layers being written, as one range per image since layouts are tracked per image
+        std::vector<ImageSubresourceRange> uploadRanges;
+        for (size_t i = 0; i < _pendingImages.size(); i++) {
+            const ImageSubresourceLayers& layers = _pendingImages[i].region.imageSubresource;
+            if (i == 0 || _pendingImages[i].image != _pendingImages[i - 1].image) {
+                uploadRanges.push_back({ layers.level, 1, layers.baseLayer, layers.numLayers });
+                continue;
+            }
+
+            ImageSubresourceRange& range = uploadRanges.back();
+            uint32_t endLevel = std::max(range.baseLevel + range.numLevels, layers.level + 1);
+            uint32_t endLayer = std::max(range.baseLayer + range.numLayers, layers.baseLayer + layers.numLayers);
+            range.baseLevel = std::min(range.baseLevel, layers.level);
+            range.baseLayer = std::min(range.baseLayer, layers.baseLayer);
+            range.numLevels = endLevel - range.baseLevel;
+            range.numLayers = endLayer - range.baseLayer;
+        }
+
+        for (size_t i = 0, image = 0; i < _pendingImages.size(); i++) {
+            if (i != 0 && _pendingImages[i].image == _pendingImages[i - 1].image)
+                continue;
+
+            cmdList.ImageMemoryBarrier(_pendingImages[i].image, {
+                .dstStage = PipelineStageFlag::COPY,
+                .dstAccess = MemoryAccessFlag::WRITE,
+                .dstLayout = ImageLayout::TRANSFER_DST,
+                .subresourceRange = uploadRanges[image++]
+            });
+        }
+
+        std::vector<BufferCopyRegion> bufferRegions;
+        for (size_t i = 0; i < _pendingBuffers.size(); i++) {
+            bufferRegions.push_back(_pendingBuffers[i].region);
+
+            bool lastOfRun = i + 1 == _pendingBuffers.size() || _pendingBuffers[i + 1].buffer != _pendingBuffers[i].buffer;
+            if (!lastOfRun)
+                continue;
+
+            BufferId buffer = _pendingBuffers[i].buffer;
+            cmdList.CopyBuffer(_stagingBuffer, buffer, (uint32_t)bufferRegions.size(), bufferRegions.data());
+            cmdList.BufferMemoryBarrier(buffer, { PipelineStageFlag::ALL_COMMANDS, MemoryAccessFlag::READ | MemoryAccessFlag::WRITE });
+            bufferRegions.clear();
+        }
+
+        std::vector<BufferImageCopyRegion> imageRegions;
+        for (size_t i = 0, image = 0; i < _pendingImages.size(); i++) {
+            imageRegions.push_back(_pendingImages[i].region);
+
+            bool lastOfImage = i + 1 == _pendingImages.size() || _pendingImages[i + 1].image != _pendingImages[i].image;
+            bool lastOfRun = lastOfImage || _pendingImages[i + 1].source != _pendingImages[i].source;
+            if (!lastOfRun)
+                continue;
+
+            cmdList.CopyBufferToImage(_pendingImages[i].source, _pendingImages[i].image, (uint32_t)imageRegions.size(), imageRegions.data());
+            imageRegions.clear();
+
+            // the most recent upload decides the layout the image is left in
+            if (lastOfImage) {
+                cmdList.ImageMemoryBarrier(_pendingImages[i].image, {
+                    .dstStage = PipelineStageFlag::ALL_COMMANDS,
+                    .dstAccess = MemoryAccessFlag::READ | MemoryAccessFlag::WRITE,
+                    .dstLayout = _pendingImages[i].finalLayout,
+                    .subresourceRange = uploadRanges[image++]
+                });
+            }
+        }
+
+        cmdList.FlushBarriers();
+        cmdList.End();
+
+        CommandSubmitInfo submitInfo = {};
+        submitInfo.commandLists.push_back(cmdList);
+        _queue.Submit(submitInfo);
+
+        // destruction waits for the submission above
+        for (BufferId buffer : _temporaryBuffers)
+            _device.DestroyBuffer(buffer);
+        _temporaryBuffers.clear();
+
+        // can include another thread's later submission to the same queue, waiting a little longer is harmless
+        _lastFlushValue = _queue.impl->_timelineValue.load(std::memory_order_acquire);
+        _inFlight.push_back({ _fileReadPositions.empty() ? _head : *_fileReadPositions.begin(), _lastFlushValue });
+
+        _pendingBuffers.clear();
+        _pendingImages.clear();
+        _batchBytes = 0;
+
+        return _lastFlushValue;
+    }
+
+    uint64_t ImplUploadManager::Reserve(uint64_t size, uint64_t alignment)
+    {
+        if (size + alignment > _stagingSize) {
+            _device.LogMessage("Upload piece of " + std::to_string(size) + " bytes doesn't fit in the staging ring");
+            return INVALID_STAGING_OFFSET;
+        }
+
+        uint64_t stagingOffset = 0;
+        while (!TryReserve(size, alignment, stagingOffset)) {
+            // the ring is full, get what's staged on its way and wait for the oldest batch to land
+            if (!_pendingBuffers.empty() || !_pendingImages.empty()) {
+                FlushPending();
+                continue;
+            }
+
+            // nothing in use at all, a large piece just needs a fresh lap to itself
+            if (_inFlight.empty()) {
+                _head = _tail = AlignUp(_head, _stagingSize);
+                continue;
+            }
+
+            _queue.impl->_submissionTimeline.WaitValue(_inFlight.front().second, UINT64_MAX);
+        }
+
+        return stagingOffset;
+    }
+
+    BufferId ImplUploadManager::CreateTemporaryStaging(uint64_t size, uint8_t*& pointer)
+    {
+        BufferCreateInfo bufferInfo = {
+            .size = size,
+            .usageFlags = BufferUsageFlag::TRANSFER_SRC,
+            .allocationFlags = AllocationUsageFlag::HOST_ACCESS_SEQUENTIAL_WRITE
+        };
+
+        BufferId buffer = _device.CreateBuffer(bufferInfo);
+        if (buffer == INVALID_RESOURCE_ID) {
+            _device.LogMessage("Upload piece of " + std::to_string(size) + " bytes doesn't fit in the staging ring or a buffer of its own");
+            return INVALID_RESOURCE_ID;
+        }
+
+        pointer = static_cast<uint8_t*>(_device.impl->_resources.buffers.Metadata(buffer).mappedAddress);
+        _temporaryBuffers.push_back(buffer);
+
+        _device.LogMessage("Upload piece of " + std::to_string(size) + " bytes is larger than the staging ring, staging it separately", false);
+        return buffer;
+    }
+
+    bool ImplUploadManager::TryReserve(uint64_t size, uint64_t alignment, uint64_t& stagingOffset)
+    {
+        Reclaim();
+
+        // pieces never straddle the end of the buffer, a piece that would starts the next lap instead
+        uint64_t lapStart = _head - _head % _stagingSize;
+        uint64_t offset = AlignUp(_head - lapStart, alignment);
+        if (offset + size > _stagingSize) {
+            lapStart += _stagingSize;
+            offset = 0;
+        }
+
+        if (lapStart + offset + size - _tail > _stagingSize)
+            return false;
+
+        _head = lapStart + offset + size;
+        stagingOffset = offset;
+        return true;
+    }
+
+    void ImplUploadManager::Reclaim()
+    {
+        uint64_t gpuValue = _queue.impl->_submissionTimeline.GetValue();
+        while (!_inFlight.empty() && _inFlight.front().second <= gpuValue) {
+            _tail = _inFlight.front().first;
+            _inFlight.pop_front();
+        }
+    }
+}
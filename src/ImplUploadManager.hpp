@@ -0,0 +1,91 @@
+#pragma once
+
+#include "WilloRHI/UploadManager.hpp"
+#include "WilloRHI/CommandList.hpp"
+
+#include <deque>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace WilloRHI
+{
+    struct PendingBufferUpload
+    {
+        BufferId buffer = INVALID_RESOURCE_ID;
+        BufferCopyRegion region = {};
+    };
+
+    struct PendingImageUpload
+    {
+        ImageId image = INVALID_RESOURCE_ID;
+        // the staging ring, or a temporary buffer for a slice too large for it
+        BufferId source = INVALID_RESOURCE_ID;
+        BufferImageCopyRegion region = {};
+        ImageLayout finalLayout = ImageLayout::READ_ONLY;
+    };
+
+    struct ImplUploadManager
+    {
+        Device _device;
+        Queue _queue;
+        UploadManagerCreateInfo _createInfo = {};
+
+        BufferId _stagingBuffer = INVALID_RESOURCE_ID;
+        uint8_t* _stagingPointer = nullptr;
+        uint64_t _stagingSize = 0;
+        // system memory the cpu caches, the only kind unbuffered file reads go straight into
+        bool _stagingHostCached = false;
+        // no single piece takes more than this, so the queue copies one while the next is being staged
+        uint64_t _maxPieceSize = 0;
+
+        // ring positions only ever grow, the offset into the staging buffer is the position modulo its size
+        // [_tail, _head) is in use, by copies in flight or staged since the last flush
+        uint64_t _head = 0;
+        uint64_t _tail = 0;
+        // ring head at each flush and the queue timeline value that frees everything before it
+        std::deque<std::pair<uint64_t, uint64_t>> _inFlight;
+        // ring positions of file reads still landing, a flush only frees space up to the oldest
+        std::set<uint64_t> _fileReadPositions;
+
+        std::vector<PendingBufferUpload> _pendingBuffers;
+        std::vector<PendingImageUpload> _pendingImages;
+        // one-off staging for slices that don't fit in the ring, destroyed once their batch is submitted
+        std::vector<BufferId> _temporaryBuffers;
+        // staging memory written since the last flush, in case the ring isn't host coherent
+        std::vector<MappedRange> _stagedRanges;
+        uint64_t _batchBytes = 0;
+        uint64_t _lastFlushValue = 0;
+
+        uint64_t _offsetAlignment = 16;
+        uint64_t _rowPitchAlignment = 1;
+        // image pieces split by rows only when the queue can copy single texels, otherwise by slices
+        bool _texelGranularity = true;
+        // slices per piece have to be a multiple of this, 0 when the queue only copies whole regions
+        uint32_t _depthGranularity = 1;
+
+        std::mutex _mutex;
+
+        void Init(Device device, Queue queue, const UploadManagerCreateInfo& createInfo);
+
+        ~ImplUploadManager();
+
+        void UploadBuffer(BufferId buffer, uint64_t offset, const void* data, uint64_t size);
+        void UploadImage(const ImageUploadInfo& uploadInfo);
+        bool UploadBufferFromFile(BufferId buffer, uint64_t offset, const std::string& path, uint64_t fileOffset, uint64_t size);
+        uint64_t Flush();
+
+        TimelineSemaphore GetTimeline() const;
+        bool IsComplete(uint64_t value) const;
+
+        // expects _mutex to be held
+        uint64_t FlushPending();
+        // returns the offset into the staging buffer, flushing and waiting on earlier batches if the ring is full
+        // only called with no file reads in flight
+        uint64_t Reserve(uint64_t size, uint64_t alignment);
+        bool TryReserve(uint64_t size, uint64_t alignment, uint64_t& stagingOffset);
+        // a mapped buffer of its own for a piece larger than the ring, released with the next flush
+        BufferId CreateTemporaryStaging(uint64_t size, uint8_t*& pointer);
+        void Reclaim();
+    };
+}
@@ -0,0 +1,404 @@
+#include "WilloRHI/StagingWriter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define WilloRHI_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define WilloRHI_TARGET(features)
+#else
+#include <cpuid.h>
+#define WilloRHI_TARGET(features) __attribute__((target(features)))
+#endif
+#endif
+
+namespace WilloRHI
+{
+    // below this, lining up the destination for streaming stores costs more than it saves
+    static constexpr uint64_t MIN_STREAM_SIZE = 256;
+
+    // linear values in 16 bit fixed point to srgb8
+    // padded so 32 bit gathers of the last entry stay in bounds
+    struct SRGBTable {
+        uint8_t values[65536 + 4] = {};
+
+        SRGBTable() {
+            for (uint32_t i = 0; i < 65536; i++) {
+                double linear = i / 65535.0;
+                double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                values[i] = (uint8_t)(encoded * 255.0 + 0.5);
+            }
+        }
+    };
+
+    static const SRGBTable& GetSRGBTable() {
+        static const SRGBTable table;
+        return table;
+    }
+
+    // scalar
+
+    static void StreamCopyScalar(uint8_t* dst, const uint8_t* src, uint64_t size) {
+        std::memcpy(dst, src, size);
+    }
+
+    static inline void ExpandPixel(uint8_t* dst, const uint8_t* src, uint8_t alpha) {
+        // one 4 byte store per pixel, write-combining buffers handle those well
+        uint8_t pixel[4] = { src[0], src[1], src[2], alpha };
+        std::memcpy(dst, pixel, 4);
+    }
+
+    static void ExpandRGB8ToRGBA8Scalar(uint8_t* dst, const uint8_t* src, uint64_t numPixels, uint8_t alpha) {
+        for (uint64_t i = 0; i < numPixels; i++)
+            ExpandPixel(dst + i * 4, src + i * 3, alpha);
+    }
+
+    static inline uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits = 0;
+        std::memcpy(&bits, &value, 4);
+
+        uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+        uint32_t magnitude = bits & 0x7FFFFFFF;
+
+        // infinity and nan, which stays a quiet nan
+        if (magnitude >= 0x7F800000)
+            return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x0200 : 0);
+
+        // 65520 and up round past the largest half
+        if (magnitude >= 0x477FF000)
+            return sign | 0x7C00;
+
+        // below the smallest normal half, rounded to a multiple of 2^-24
+        if (magnitude < 0x38800000) {
+            if (magnitude <= 0x33000000)
+                return sign;
+
+            uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+            uint32_t shift = 126 - (magnitude >> 23);
+            uint32_t result = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (result & 1)))
+                result++;
+            return sign | (uint16_t)result;
+        }
+
+        // rebias the exponent and round the mantissa to nearest even, a carry correctly bumps the exponent
+        uint32_t result = (magnitude - 0x38000000) >> 13;
+        uint32_t remainder = magnitude & 0x1FFF;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1)))
+            result++;
+        return sign | (uint16_t)result;
+    }
+
+    static void ConvertFloatToHalfScalar(uint8_t* dst, const float* src, uint64_t count) {
+        for (uint64_t i = 0; i < count; i++) {
+            uint16_t half = FloatToHalf(src[i]);
+            std::memcpy(dst + i * 2, &half, 2);
+        }
+    }
+
+    static inline float Saturate(float value) {
+        // written so nan comes out as 0
+        return value > 0.0f ? std::min(value, 1.0f) : 0.0f;
+    }
+
+    static inline void PackSRGBPixel(const SRGBTable& table, uint8_t* dst, const float* src) {
+        uint8_t pixel[4] = {
+            table.values[(uint32_t)(Saturate(src[0]) * 65535.0f + 0.5f)],
+            table.values[(uint32_t)(Saturate(src[1]) * 65535.0f + 0.5f)],
+            table.values[(uint32_t)(Saturate(src[2]) * 65535.0f + 0.5f)],
+            (uint8_t)(Saturate(src[3]) * 255.0f + 0.5f)
+        };
+        std::memcpy(dst, pixel, 4);
+    }
+
+    static void PackRGBA32FToSRGB8Scalar(uint8_t* dst, const float* src, uint64_t numPixels) {
+        const SRGBTable& table = GetSRGBTable();
+        for (uint64_t i = 0; i < numPixels; i++)
+            PackSRGBPixel(table, dst + i * 4, src + i * 4);
+    }
+
+#if defined(WilloRHI_X86)
+    // each of these writes scalar until the destination is aligned for streaming stores, and finishes the tail scalar
+    // a destination that can't ever line up just takes the scalar path the whole way
+
+    WilloRHI_TARGET("sse2")
+    static void StreamCopySSE2(uint8_t* dst, const uint8_t* src, uint64_t size)
+    {
+        uint64_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+        std::memcpy(dst, src, head);
+        dst += head;
+        src += head;
+        size -= head;
+
+        for (; size >= 64; size -= 64, dst += 64, src += 64) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst), a);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), d);
+        }
+
+        for (; size >= 16; size -= 16, dst += 16, src += 16)
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+
+        std::memcpy(dst, src, size);
+        _mm_sfence();
+    }
+
+    WilloRHI_TARGET("avx2")
+    static void StreamCopyAVX2(uint8_t* dst, const uint8_t* src, uint64_t size)
+    {
+        uint64_t head = (32 - (reinterpret_cast<uintptr_t>(dst) & 31)) & 31;
+        std::memcpy(dst, src, head);
+        dst += head;
+        src += head;
+        size -= head;
+
+        for (; size >= 128; size -= 128, dst += 128, src += 128) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), a);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 32), b);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 64), c);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + 96), d);
+        }
+
+        for (; size >= 32; size -= 32, dst += 32, src += 32)
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+
+        std::memcpy(dst, src, size);
+        _mm_sfence();
+    }
+
+    WilloRHI_TARGET("ssse3")
+    static void ExpandRGB8ToRGBA8SSSE3(uint8_t* dst, const uint8_t* src, uint64_t numPixels, uint8_t alpha)
+    {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alphaMask = _mm_set1_epi32((int)((uint32_t)alpha << 24));
+
+        uint64_t i = 0;
+        for (; i < numPixels && (reinterpret_cast<uintptr_t>(dst + i * 4) & 15) != 0; i++)
+            ExpandPixel(dst + i * 4, src + i * 3, alpha);
+
+        // 16 byte loads for 12 bytes of pixels, so stop while that would still read past the source
+        for (; i + 6 <= numPixels; i += 4) {
+            __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+            __m128i rgba = _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alphaMask);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i * 4), rgba);
+        }
+        _mm_sfence();
+
+        for (; i < numPixels; i++)
+            ExpandPixel(dst + i * 4, src + i * 3, alpha);
+    }
+
+    WilloRHI_TARGET("avx2")
+    static void ExpandRGB8ToRGBA8AVX2(uint8_t* dst, const uint8_t* src, uint64_t numPixels, uint8_t alpha)
+    {
+        // shuffles stay within 128 bit lanes, so each lane gets its own 4 pixels loaded
+        const __m256i shuffle = _mm256_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m256i alphaMask = _mm256_set1_epi32((int)((uint32_t)alpha << 24));
+
+        uint64_t i = 0;
+        for (; i < numPixels && (reinterpret_cast<uintptr_t>(dst + i * 4) & 31) != 0; i++)
+            ExpandPixel(dst + i * 4, src + i * 3, alpha);
+
+        for (; i + 10 <= numPixels; i += 8) {
+            const uint8_t* pixels = src + i * 3;
+            __m256i rgb = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 12)), 1);
+            __m256i rgba = _mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), alphaMask);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i * 4), rgba);
+        }
+        _mm_sfence();
+
+        for (; i < numPixels; i++)
+            ExpandPixel(dst + i * 4, src + i * 3, alpha);
+    }
+
+    WilloRHI_TARGET("avx,f16c")
+    static void ConvertFloatToHalfF16C(uint8_t* dst, const float* src, uint64_t count)
+    {
+        uint64_t i = 0;
+        for (; i < count && (reinterpret_cast<uintptr_t>(dst + i * 2) & 15) != 0; i++) {
+            uint16_t half = FloatToHalf(src[i]);
+            std::memcpy(dst + i * 2, &half, 2);
+        }
+
+        for (; i + 8 <= count; i += 8) {
+            __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i * 2), halves);
+        }
+        _mm_sfence();
+
+        for (; i < count; i++) {
+            uint16_t half = FloatToHalf(src[i]);
+            std::memcpy(dst + i * 2, &half, 2);
+        }
+    }
+
+    WilloRHI_TARGET("avx2")
+    static inline __m256i PackSRGBTwoPixels(const SRGBTable& table, const float* src)
+    {
+        // max returns its second operand for nan, so nan comes out as 0 like the scalar path
+        __m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src), _mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+
+        __m256i index = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(65535.0f)), _mm256_set1_ps(0.5f)));
+        __m256i colour = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int*>(table.values), index, 1), _mm256_set1_epi32(0xFF));
+        __m256i alpha = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+
+        return _mm256_blend_epi32(colour, alpha, 0x88);
+    }
+
+    WilloRHI_TARGET("avx2")
+    static void PackRGBA32FToSRGB8AVX2(uint8_t* dst, const float* src, uint64_t numPixels)
+    {
+        const SRGBTable& table = GetSRGBTable();
+        // packing interleaves the lanes, this puts the pixels back in order
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+        uint64_t i = 0;
+        for (; i < numPixels && (reinterpret_cast<uintptr_t>(dst + i * 4) & 31) != 0; i++)
+            PackSRGBPixel(table, dst + i * 4, src + i * 4);
+
+        for (; i + 8 <= numPixels; i += 8) {
+            const float* pixels = src + i * 4;
+            __m256i ab = _mm256_packus_epi32(PackSRGBTwoPixels(table, pixels), PackSRGBTwoPixels(table, pixels + 8));
+            __m256i cd = _mm256_packus_epi32(PackSRGBTwoPixels(table, pixels + 16), PackSRGBTwoPixels(table, pixels + 24));
+            __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i * 4), packed);
+        }
+        _mm_sfence();
+
+        for (; i < numPixels; i++)
+            PackSRGBPixel(table, dst + i * 4, src + i * 4);
+    }
+
+    struct CpuFeatures {
+        bool sse2 = false;
+        bool ssse3 = false;
+        bool avx2 = false;
+        bool f16c = false;
+    };
+
+    static void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4])
+    {
+#if defined(_MSC_VER)
+        int info[4] = {};
+        __cpuidex(info, (int)leaf, (int)subleaf);
+        for (uint32_t i = 0; i < 4; i++)
+            registers[i] = (uint32_t)info[i];
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    static uint64_t ReadXCR0()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax = 0, edx = 0;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((uint64_t)edx << 32) | eax;
+#endif
+    }
+
+    static CpuFeatures DetectCpuFeatures()
+    {
+        CpuFeatures features;
+        uint32_t registers[4] = {}; // eax, ebx, ecx, edx
+
+        Cpuid(0, 0, registers);
+        uint32_t maxLeaf = registers[0];
+
+        Cpuid(1, 0, registers);
+        features.sse2 = registers[3] & (1u << 26);
+        features.ssse3 = registers[2] & (1u << 9);
+
+        // avx needs the os to save the ymm registers as well as the cpu supporting it
+        bool avx = (registers[2] & (1u << 27)) && (registers[2] & (1u << 28)) && (ReadXCR0() & 6) == 6;
+        features.f16c = avx && (registers[2] & (1u << 29));
+
+        if (maxLeaf >= 7) {
+            Cpuid(7, 0, registers);
+            features.avx2 = avx && (registers[1] & (1u << 5));
+        }
+
+        return features;
+    }
+#endif
+
+    struct StagingWriterFunctions {
+        void (*streamCopy)(uint8_t*, const uint8_t*, uint64_t) = StreamCopyScalar;
+        void (*expandRGB8ToRGBA8)(uint8_t*, const uint8_t*, uint64_t, uint8_t) = ExpandRGB8ToRGBA8Scalar;
+        void (*convertFloatToHalf)(uint8_t*, const float*, uint64_t) = ConvertFloatToHalfScalar;
+        void (*packRGBA32FToSRGB8)(uint8_t*, const float*, uint64_t) = PackRGBA32FToSRGB8Scalar;
+    };
+
+    static StagingWriterFunctions SelectFunctions()
+    {
+        StagingWriterFunctions functions;
+
+#if defined(WilloRHI_X86)
+        CpuFeatures features = DetectCpuFeatures();
+
+        if (features.avx2) {
+            functions.streamCopy = StreamCopyAVX2;
+            functions.expandRGB8ToRGBA8 = ExpandRGB8ToRGBA8AVX2;
+            functions.packRGBA32FToSRGB8 = PackRGBA32FToSRGB8AVX2;
+        } else {
+            if (features.sse2)
+                functions.streamCopy = StreamCopySSE2;
+            if (features.ssse3)
+                functions.expandRGB8ToRGBA8 = ExpandRGB8ToRGBA8SSSE3;
+        }
+
+        if (features.f16c)
+            functions.convertFloatToHalf = ConvertFloatToHalfF16C;
+#endif
+
+        return functions;
+    }
+
+    static const StagingWriterFunctions& GetFunctions() {
+        static const StagingWriterFunctions functions = SelectFunctions();
+        return functions;
+    }
+
+    void StreamCopy(void* dst, const void* src, uint64_t size)
+    {
+        if (size < MIN_STREAM_SIZE) {
+            std::memcpy(dst, src, size);
+            return;
+        }
+        GetFunctions().streamCopy(static_cast<uint8_t*>(dst), static_cast<const uint8_t*>(src), size);
+    }
+
+    void ExpandRGB8ToRGBA8(void* dst, const void* src, uint64_t numPixels, uint8_t alpha) {
+        GetFunctions().expandRGB8ToRGBA8(static_cast<uint8_t*>(dst), static_cast<const uint8_t*>(src), numPixels, alpha);
+    }
+
+    void ConvertFloatToHalf(void* dst, const float* src, uint64_t count) {
+        GetFunctions().convertFloatToHalf(static_cast<uint8_t*>(dst), src, count);
+    }
+
+    void PackRGBA32FToSRGB8(void* dst, const float* src, uint64_t numPixels) {
+        GetFunctions().packRGBA32FToSRGB8(static_cast<uint8_t*>(dst), src, numPixels);
+    }
+}
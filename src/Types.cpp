@@ -2,8 +2,24 @@
 
 #include <iostream>
 
+namespace WilloRHI
+{
+    // every format but UNDEFINED has to have landed in one of BuildFormatTable's groups
+    static constexpr bool FormatTableComplete()
+    {
+        for (uint32_t i = 1; i < FORMAT_TABLE.size(); i++) {
+            if (!FORMAT_TABLE[i].aspect)
+                return false;
+        }
+        return !FORMAT_TABLE[0].aspect;
+    }
+    static_assert(FormatTableComplete(), "Format missing from the format table");
+    static_assert(FORMAT_RANGES[0].first == 0, "FormatIndex expects the core range first");
+    static_assert(FormatIndex(Format::PVRTC2_4BPP_SRGB_BLOCK_IMG) == FormatTableSize() - 1);
+}
+
 uint32_t WilloRHI::get_bpp(Format format)
 {
-    // I'll just implement this if/when I actually need it LMAO
-    return 0;
+    const FormatInfo& info = GetFormatInfo(format);
+    return (info.bytes * 8) / (info.blockWidth * info.blockHeight);
 }